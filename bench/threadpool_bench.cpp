@@ -0,0 +1,253 @@
+// Submission and dispatch overhead of ThreadPool against the mutex/condvar pool it replaced, under 1M no-op tasks.
+//
+//   cmake -S . -B build -DRVIEW_BUILD_BENCHMARKS=ON && cmake --build build --target threadpool_bench
+//   ./build/threadpool_bench [numTasks] [numThreads]
+
+#include <threadpool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// ###########################################################################################################################################
+// BaselineThreadPool
+// ###########################################################################################################################################
+
+// The pool before the work-stealing one: a single binary heap of std::function under a mutex, and submit() wrapping packaged_task in a shared_ptr
+class BaselineThreadPool {
+ public:
+  BaselineThreadPool(int numThreads)
+      : _workers(),
+        _taskMutex(),
+        _isRunning(true),
+        _condition(),
+        _tasks(),
+        _nextSequence(0) {
+    for (int i = 0; i < numThreads; ++i) {
+      _workers.emplace_back(&BaselineThreadPool::worker, this);
+    }
+  }
+
+  ~BaselineThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(_taskMutex);
+      _isRunning = false;
+    }
+
+    _condition.notify_all();
+
+    for (auto& worker : _workers) {
+      worker.join();
+    }
+  }
+
+  template <typename F>
+  auto submit(F&& func, int priority = 0) -> std::future<std::invoke_result_t<F>> {
+    using R = std::invoke_result_t<F>;
+
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(func));
+    auto future = task->get_future();
+
+    post([task]() { (*task)(); }, priority);
+
+    return future;
+  }
+
+  // Fire-and-forget through the same queue, which the loader used to do with submit()
+  template <typename F>
+  void post(const F& func, int priority = 0) {
+    {
+      std::lock_guard<std::mutex> lock(_taskMutex);
+      _tasks.push_back(Task{std::function<void()>(func), priority, _nextSequence++});
+      std::push_heap(_tasks.begin(), _tasks.end(), TaskCompare());
+    }
+
+    _condition.notify_one();
+  }
+
+ private:
+  struct Task {
+    std::function<void()> func;
+    int priority = 0;
+    uint64_t sequence = 0;
+  };
+
+  struct TaskCompare {
+    bool operator()(const Task& a, const Task& b) const {
+      return a.priority != b.priority ? a.priority < b.priority : a.sequence > b.sequence;
+    }
+  };
+
+  std::vector<std::thread> _workers;
+  std::mutex _taskMutex;
+  bool _isRunning;
+  std::condition_variable _condition;
+  std::vector<Task> _tasks;
+  uint64_t _nextSequence;
+
+  void worker() {
+    for (;;) {
+      Task task;
+
+      {
+        std::unique_lock<std::mutex> lock(_taskMutex);
+        _condition.wait(lock, [this] { return !_isRunning || !_tasks.empty(); });
+
+        if (!_isRunning && _tasks.empty()) {
+          return;
+        }
+
+        std::pop_heap(_tasks.begin(), _tasks.end(), TaskCompare());
+        task = std::move(_tasks.back());
+        _tasks.pop_back();
+      }
+
+      task.func();
+    }
+  }
+};
+
+// ###########################################################################################################################################
+// Benchmarks
+// ###########################################################################################################################################
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+  double submitSeconds;  // Until the last task is queued, or the time in spawn() on the workers
+  double totalSeconds;   // Until the last task has run
+};
+
+// Counts the tasks run, and lets the caller wait for all of them
+class Counter {
+ public:
+  explicit Counter(int numTasks) : _numRemaining(numTasks) {}
+
+  void done() {
+    if (_numRemaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      _numRemaining.notify_all();
+    }
+  }
+
+  void wait() {
+    for (int numRemaining = _numRemaining.load(); numRemaining > 0; numRemaining = _numRemaining.load()) {
+      _numRemaining.wait(numRemaining);
+    }
+  }
+
+ private:
+  std::atomic<int> _numRemaining;
+};
+
+template <typename Pool>
+Result benchmarkSubmit(Pool& pool, int numTasks) {
+  std::vector<std::future<void>> futures;
+  futures.reserve(numTasks);
+
+  const auto startTime = Clock::now();
+  for (int i = 0; i < numTasks; ++i) {
+    futures.push_back(pool.submit([]() {}));
+  }
+  const auto submitTime = Clock::now();
+
+  for (auto& future : futures) {
+    future.wait();
+  }
+  const auto endTime = Clock::now();
+
+  return {std::chrono::duration<double>(submitTime - startTime).count(), std::chrono::duration<double>(endTime - startTime).count()};
+}
+
+template <typename Pool>
+Result benchmarkPost(Pool& pool, int numTasks) {
+  Counter counter(numTasks);
+  Counter* counterPtr = &counter;
+
+  const auto startTime = Clock::now();
+  for (int i = 0; i < numTasks; ++i) {
+    pool.post([counterPtr]() { counterPtr->done(); });
+  }
+  const auto submitTime = Clock::now();
+
+  counter.wait();
+  const auto endTime = Clock::now();
+
+  return {std::chrono::duration<double>(submitTime - startTime).count(), std::chrono::duration<double>(endTime - startTime).count()};
+}
+
+// Subtasks queued from the workers, which go to their own deques instead of the shared queue.
+// The subtasks are spawned in batches that fit in a deque, since a full deque runs the subtask inline.
+Result benchmarkSpawn(ThreadPool& pool, int numTasks) {
+  static constexpr int BATCH_SIZE = static_cast<int>(WorkStealingDeque::CAPACITY / 2);
+  const int numBatches = (numTasks + BATCH_SIZE - 1) / BATCH_SIZE;
+
+  Counter counter(numTasks);
+  Counter* counterPtr = &counter;
+  ThreadPool* poolPtr = &pool;
+
+  // Time spent in spawn() on the workers, summed over the batches
+  std::atomic<int64_t> spawnNanoseconds(0);
+  std::atomic<int64_t>* spawnNanosecondsPtr = &spawnNanoseconds;
+
+  const auto startTime = Clock::now();
+  for (int batch = 0; batch < numBatches; ++batch) {
+    const int batchSize = std::min(BATCH_SIZE, numTasks - batch * BATCH_SIZE);
+    pool.post([poolPtr, counterPtr, spawnNanosecondsPtr, batchSize]() {
+      const auto batchStartTime = Clock::now();
+      for (int i = 0; i < batchSize; ++i) {
+        poolPtr->spawn([counterPtr]() { counterPtr->done(); });
+      }
+      const auto batchEndTime = Clock::now();
+
+      spawnNanosecondsPtr->fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(batchEndTime - batchStartTime).count(), std::memory_order_relaxed);
+    });
+  }
+
+  counter.wait();
+  const auto endTime = Clock::now();
+
+  // NOTE: The submission time is the time in spawn() on the workers, not the time to post the batches from outside.
+  //       The subtasks stolen by the other workers may run while a batch is being spawned.
+  return {static_cast<double>(spawnNanoseconds.load()) * 1e-9, std::chrono::duration<double>(endTime - startTime).count()};
+}
+
+void printResult(const char* name, int numTasks, const Result& result) {
+  std::printf("%-28s submit %8.1f ns/task   total %8.1f ns/task\n", name, result.submitSeconds * 1e9 / numTasks, result.totalSeconds * 1e9 / numTasks);
+}
+
+int main(int argc, char** argv) {
+  const int numTasks = argc > 1 ? std::atoi(argv[1]) : 1000000;
+  const int numThreads = argc > 2 ? std::atoi(argv[2]) : std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+  if (numTasks <= 0 || numThreads <= 0) {
+    std::fprintf(stderr, "Usage: %s [numTasks] [numThreads]\n", argv[0]);
+    return 1;
+  }
+
+  std::printf("%d no-op tasks on %d threads\n\n", numTasks, numThreads);
+
+  {
+    BaselineThreadPool pool(numThreads);
+    printResult("Baseline submit()", numTasks, benchmarkSubmit(pool, numTasks));
+    printResult("Baseline post()", numTasks, benchmarkPost(pool, numTasks));
+  }
+
+  {
+    ThreadPool pool(numThreads);
+    printResult("ThreadPool submit()", numTasks, benchmarkSubmit(pool, numTasks));
+    printResult("ThreadPool post()", numTasks, benchmarkPost(pool, numTasks));
+    printResult("ThreadPool spawn()", numTasks, benchmarkSpawn(pool, numTasks));
+  }
+
+  return 0;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <QString>
+#include <cstdint>
 
 class Common {
  public:
@@ -9,6 +10,50 @@ class Common {
 
   static inline const float DEFAULT_GLWIDGET_WIDTH_RATIO = 0.7f;
 
+  // Initial values until the first decode is measured. Both are then sized from the measured decode time and size and the navigation speed alone.
   static inline const int NUM_THREADS = 8;
   static inline const int NUM_PRELOADED_IMAGES = 8;
+
+  static inline const int MIN_NUM_THREADS = 2;
+  static inline const int MIN_NUM_PRELOADED_IMAGES = 2;
+  static inline const int MAX_NUM_PRELOADED_IMAGES = 64;
+  static inline const double PREFETCH_MEMORY_RATIO = 0.5;        // Ratio of the image cache capacity the prefetched images may take
+  static inline const double DECODE_STATISTICS_SMOOTHING = 0.2;  // Weight of the latest sample in the moving averages
+
+  static inline const size_t DEFAULT_IMAGE_CACHE_CAPACITY_BYTES = static_cast<size_t>(2) * 1024 * 1024 * 1024;  // 2 GiB
+  static inline const size_t IMAGE_CACHE_MEMORY_RESERVE_BYTES = static_cast<size_t>(512) * 1024 * 1024;        // Keep free for the rest of the system
+  static inline const int IMAGE_CACHE_MEMORY_CHECK_INTERVAL_MS = 500;
+
+  static inline const int NAVIGATION_HISTORY_DURATION_MS = 1000;  // Steps older than this are forgotten
+  static inline const double FAST_NAVIGATION_STEP_RATE = 3.0;     // Steps per second regarded as fast navigation
+  static inline const double PREFETCH_LOOKAHEAD_SECONDS = 1.5;    // Time to look ahead when navigating fast
+
+  static inline const int PREVIEW_THUMBNAIL_SIZE = 256;                                                   // Long side of the thumbnails in pixels
+  static inline const int PREVIEW_SCREEN_SIZE = 2048;                                                     // Long side of the screen-size previews in pixels
+  static inline const int PREVIEW_JPEG_QUALITY = 90;
+  static inline const size_t PREVIEW_STORE_CAPACITY_BYTES = static_cast<size_t>(1) * 1024 * 1024 * 1024;  // 1 GiB
+  static inline const double PREVIEW_STORE_EVICTION_RATIO = 0.9;                                          // Ratio of the capacity the eviction shrinks the store to
+  static inline const int PREVIEW_STORE_EVICTION_INTERVAL = 256;                                          // Number of stored previews between the evictions
+
+  static inline const uint32_t EMBEDDED_PREVIEW_MAX_BYTES = 8 * 1024 * 1024;  // Larger embedded previews are not worth decoding first
+
+  static inline const int PIXEL_TRANSPOSE_TILE_SIZE = 64;        // Side of the tiles rotated by 90 degrees at once, small enough to stay in the cache
+  static inline const int PARALLEL_CHUNK_VALUES = 4 * 1024 * 1024;  // Values of the pixels in a chunk of the work split across the workers
+
+  static inline const int TILED_RENDERING_MIN_SIZE = 8192;                                        // Images with the longer side above this are drawn in tiles
+  static inline const int TILE_SIZE = 256;                                                        // Side of the tiles in texels
+  static inline const int TILE_FILTER_MARGIN = 4;                                                 // Texels around the visible region read by the resampling filters
+  static inline const size_t TILE_CACHE_CAPACITY_BYTES = static_cast<size_t>(256) * 1024 * 1024;  // 256 MiB of the GPU memory for the resident tiles
+  static inline const int TILE_POLL_INTERVAL_MS = 16;                                             // Interval to upload the tiles read in the background
+
+  static inline const int KERNEL_LUT_SAMPLES_PER_TEXEL = 64;  // Weights of the resampling kernels tabulated per texel of the distance
+
+  static inline const size_t TEXTURE_STREAMING_MIN_BYTES = static_cast<size_t>(32) * 1024 * 1024;  // Larger images are uploaded in bands across the frames
+  static inline const size_t TEXTURE_UPLOAD_BAND_BYTES = static_cast<size_t>(8) * 1024 * 1024;     // Size of each pixel buffer in the ring
+  static inline const int TEXTURE_UPLOAD_NUM_BUFFERS = 3;                                          // Pixel buffers in the ring
+  static inline const int TEXTURE_UPLOAD_BUDGET_MS = 8;                                            // Time per frame to spend on copying the bands
+  static inline const int TEXTURE_UPLOAD_POLL_INTERVAL_MS = 4;                                     // Interval to issue the next bands
+
+  static inline const size_t TEXTURE_CACHE_CAPACITY_BYTES = static_cast<size_t>(512) * 1024 * 1024;  // 512 MiB of the GPU memory for the textures uploaded ahead
+  static inline const size_t TEXTURE_CACHE_MAX_PENDING_UPLOADS = 8;                                  // Older uploads are dropped
 };
@@ -6,21 +6,31 @@
 #include <QOperatingSystemVersion>
 #include <QProcess>
 #include <QString>
+#include <cstdint>
 #include <filesystem>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <string>
+#include <vector>
 
 #ifdef _WIN32
 #include <shlobj.h>
 #include <windows.h>
 #elif __APPLE__
+#include <fcntl.h>
 #include <pwd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include <cstdlib>
 #elif __linux__
+#include <fcntl.h>
 #include <pwd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #endif
@@ -54,4 +64,40 @@ class FileUtil {
   static bool moveToTrash(const fs::path& path);
 };
 
+// Size and modification time of a file, which change when the file is rewritten
+struct FileStamp {
+  uintmax_t size = 0;
+  fs::file_time_type lastWriteTime;
+
+  static std::optional<FileStamp> read(const fs::path& filePath);  // std::nullopt if the file is gone
+
+  bool operator==(const FileStamp& other) const = default;
+};
+
+// Read-only content of a whole file. The file is opened only once, and the decoder and the metadata parsers share the content.
+// The file is memory-mapped if possible, and read into memory otherwise.
+class MappedFile {
+ public:
+  MappedFile(const fs::path& filePath);  // Throws std::runtime_error if the file cannot be read
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const fs::path& getPath() const;
+  const uint8_t* getData() const;
+  size_t getSize() const;
+
+  const std::optional<FileStamp>& getStamp() const;  // Stamp of the file when it was opened
+
+ private:
+  fs::path _filePath;
+  void* _mappedView;             // Start of the mapping, or nullptr if the file is read into _buffer
+  size_t _size;
+  std::optional<FileStamp> _stamp;
+  std::vector<uint8_t> _buffer;  // Content of the file when it cannot be mapped
+};
+
+using MappedFile_t = std::shared_ptr<MappedFile>;
+
 #endif  // FILEUTIL_H
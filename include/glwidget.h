@@ -3,16 +3,24 @@
 #define GLM_FORCE_SWIZZLE
 #define GLM_FORCE_RADIANS
 #define GLM_ENABLE_EXPERIMENTAL
+#include <image.h>
 #include <shaders.h>
+#include <texturecache.h>
+#include <textureuploader.h>
+#include <tiledtexture.h>
 
+#include <QGenericMatrix>
 #include <QMouseEvent>
 #include <QOpenGLBuffer>
 #include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
 #include <QOpenGLFunctions>
+#include <QOpenGLPixelTransferOptions>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLTexture>
 #include <QOpenGLVertexArrayObject>
 #include <QOpenGLWidget>
+#include <QTimer>
 #include <QWheelEvent>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -43,9 +51,14 @@ class GLWidget : public QOpenGLWidget {
   GLWidget(QWidget *parent = nullptr);
   ~GLWidget();
 
-  void updateTexture(const cv::Mat &image);
+  void updateTexture(const ImageData &imageData);
+  void prefetchTexture(const ImageData &imageData);  // Upload the image ahead to show it without uploading. Thread-safe.
   void setShaderType(ImageShaderType type);
 
+  // Rotate or mirror the image on the screen. The texture is untouched. Reset when another image is shown.
+  void rotateView(bool isClockwise);
+  void flipView(bool isHorizontal);
+
  protected:
   void initializeGL() override;
   void resizeGL(int w, int h) override;
@@ -57,7 +70,16 @@ class GLWidget : public QOpenGLWidget {
   void wheelEvent(QWheelEvent *event) override;
 
  private:
+  fs::path _imagePath;
   glm::ivec2 _textureSize;
+  glm::ivec2 _imageSize;  // Size the rect is laid out for. The full size of the preview before the full image is loaded.
+  QOpenGLTexture::TextureFormat _textureFormat;
+  int _orientation;          // EXIF orientation of the image
+  glm::mat3 _viewTransform;  // Rotation and flip by the user. Maps the rect coordinates to the ones before the rotation and flip.
+  float _valueScale;
+  float _valueOffset;
+  int _numChannels;
+  bool _swapRedBlue;
   glm::vec2 _rectTopLeft;
   glm::vec2 _rectBottomRight;
 
@@ -71,6 +93,23 @@ class GLWidget : public QOpenGLWidget {
   QOpenGLBuffer _indexBuffer;
   QOpenGLTexture *_texture;
 
+  // Large images are streamed into the back texture over the frames while the current one is drawn, and swapped in once uploaded
+  QOpenGLTexture *_backTexture;
+  std::unique_ptr<TextureUploader> _textureUploader;
+  ImageData _uploadingImageData;
+
+  // The textures of the prefetched images uploaded ahead, drawn instead of _texture when set
+  std::unique_ptr<TextureCache> _textureCache;
+  CachedTexture_t _cachedTexture;
+
+  // Images larger than a single texture are drawn from the tiles instead of _texture
+  TiledTexture_t _tiledTexture;
+  bool _isTiled;
+  int _maxTextureSize;
+
+  // Texel rows filtered by the first pass of the separable filters
+  std::unique_ptr<QOpenGLFramebufferObject> _intermediateFramebuffer;
+
   QOpenGLFunctions *_glFunctions;
 
   bool _isDragging;
@@ -80,4 +119,21 @@ class GLWidget : public QOpenGLWidget {
   glm::ivec2 _oldWindowSize;
 
   void resetRectPosition();
+  void setImageProperties(const ImageData &imageData, const cv::Size &imageSize, QOpenGLTexture::TextureFormat textureFormat, bool isTiled);
+  void updateUpload();
+  void setImageUniforms(QOpenGLShaderProgram &program, const glm::ivec2 &textureSize, int textureLod);
+  bool drawSeparablePasses(const glm::ivec2 &textureSize, int textureLod, float visibleVMin, float visibleVMax);  // False if not drawn
+
+  static void allocateTexture(QOpenGLTexture *texture, const cv::Size &size, QOpenGLTexture::TextureFormat textureFormat, QOpenGLTexture::PixelFormat pixelFormat, QOpenGLTexture::PixelType pixelType);
+  static bool hasMipLevels(const ImageData &imageData, const QOpenGLTexture *texture);  // True if the image has all the mip levels of the texture
+  static int selectMipLevel(const glm::ivec2 &size, float texelsPerPixel);
+
+  glm::mat3 getUVTransform() const;
+  glm::ivec2 getDisplaySize(const glm::ivec2 &size) const;  // Size of the image on the screen, which is swapped if rotated by 90 degrees
+
+  static glm::mat3 getOrientationTransform(int orientation);
+
+  static QOpenGLTexture::TextureFormat getTextureFormat(int depth, int channels);
+  static QOpenGLTexture::PixelFormat getPixelFormat(int channels);
+  static QOpenGLTexture::PixelType getPixelType(int depth);
 };
@@ -2,22 +2,146 @@
 
 #include <TinyEXIF.h>
 #include <fileutil.h>
+#include <tiledimage.h>
 
+#include <cstdint>
+#include <limits>
 #include <opencv2/opencv.hpp>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct ImageData;
+
+// Properties of an image read from the header of the file without decoding
+struct ImageInfo {
+  cv::Size size;        // Size of the pixels as stored, before the orientation is applied
+  int channels = 0;     // Number of the channels of the decoded image
+  int depth = CV_8U;    // Depth of the decoded image after the conversion for the upload
+  int orientation = 1;  // EXIF orientation (1-8)
+
+  size_t getSizeInBytes() const { return static_cast<size_t>(size.width) * size.height * channels * CV_ELEM_SIZE1(depth); }  // Size of the decoded pixel data
+};
 
 class ImagingUtil {
  public:
-  static cv::Mat correctOrientation(const cv::Mat& img, const fs::path& filePath);
+  // Bring the decoded image into the layout for the upload in a single pass over the pixels: the conversion of the depths that cannot be
+  // uploaded as is to float32, and the EXIF orientation (1-8) if it is baked into the pixels. The range of the pixel values is computed along the way.
+  // The rows are split into chunks across the workers of the pool if given, at the priority of the calling task.
+  // NOTE: The image is not copied if it is already uploadable and the orientation is 1.
+  static void transformPixels(cv::Mat& img, int orientation, double& minValue, double& maxValue, const ThreadPool_t& threadPool = nullptr);
+
+  // Downscale the image by halves down to 1x1 with the area average, in the sizes of the OpenGL mip levels 1 onward (the halves rounded down).
+  // Each level is averaged from the previous one, so that the whole pyramid costs a third of the image.
+  static std::vector<cv::Mat> buildMipLevels(const cv::Mat& img);
+
+  // Decode the image in memory without copying the encoded bytes
+  static cv::Mat decodeImage(const MappedFile& file, int flags);
+
+  // Refer to the pixels of an uncompressed image (binary PGM/PPM, PFM, BMP, TIFF and NumPy .npy) in the mapped file without decoding nor copying.
+  // The rows are referred to with their stride, and the bottom-up rows are drawn upright by the orientation.
+  // The pixels are copied only if the byte order differs from the CPU's, or if they are not aligned to their values.
+  // Returns false if the file is not in a layout that can be referred to as is.
+  static bool mapRawImage(const MappedFile_t& file, ImageData& imageData);
+
+  // Read the EXIF orientation of JPEG and TIFF files. Returns 1 (no transform) if the file has no orientation.
+  static int readOrientation(const MappedFile& file);
+
+  // Read the properties of the image from the header without decoding: the SOF segment of JPEG, IHDR of PNG, IFD0 of TIFF and the header of OpenEXR.
+  // Returns std::nullopt if the file is not of the format.
+  static std::optional<ImageInfo> probeJpeg(const MappedFile& file);
+  static std::optional<ImageInfo> probePng(const MappedFile& file);
+  static std::optional<ImageInfo> probeTiff(const MappedFile& file);
+  static std::optional<ImageInfo> probeExr(const MappedFile& file);
+
+  // Decode the JPEG preview embedded by cameras in the EXIF IFD1 of JPEG files, or in IFD1 and the SubIFDs of TIFF files.
+  // The preview is corrected for the orientation of the main image.
+  static bool readEmbeddedPreview(const MappedFile& file, ImageData& preview);
+
+ private:
+  struct EmbeddedPreviewInfo {
+    int orientation = 1;  // EXIF orientation of the main image
+    size_t offset = 0;    // Offset of the JPEG stream in the file
+    uint32_t length = 0;  // Length of the JPEG stream in bytes
+  };
+
+  // The kernels process the source rows in [rowBegin, rowEnd). The range is left as min > max if all the values are NaN.
+  template <typename SrcT, typename DstT>
+  static void transformPixelsImpl(const cv::Mat& src, cv::Mat& dst, int orientation, int rowBegin, int rowEnd, double& minValue, double& maxValue);
+  template <typename SrcT, typename DstT, int CN>
+  static void transformPixelsKernel(const cv::Mat& src, cv::Mat& dst, int orientation, int rowBegin, int rowEnd, double& minValue, double& maxValue);
+  template <typename T>
+  static void computeValueRange(const cv::Mat& img, int rowBegin, int rowEnd, double& minValue, double& maxValue);
+  template <typename F>
+  static void forEachRowChunk(const cv::Mat& img, int rowAlignment, const ThreadPool_t& threadPool, F&& func, double& minValue, double& maxValue);
+
+  static bool mapNetpbm(const MappedFile_t& file, ImageData& imageData);
+  static bool mapPfm(const MappedFile_t& file, ImageData& imageData);
+  static bool mapBmp(const MappedFile_t& file, ImageData& imageData);
+  static bool mapTiff(const MappedFile_t& file, ImageData& imageData);
+  static bool mapNpy(const MappedFile_t& file, ImageData& imageData);
+  static bool wrapPixels(const MappedFile_t& file, size_t offset, int rows, int cols, int type, size_t step, bool isLittleEndian, ImageData& imageData);
+  template <int N>
+  static void swapBytes(const cv::Mat& src, cv::Mat& dst);
+  static std::optional<std::string> readHeaderToken(const MappedFile& file, size_t& pos);  // Token of an ASCII header delimited by whitespaces
+
+  // Fields of IFD0 of a classic TIFF file
+  struct TiffImageHeader {
+    bool isLittleEndian = true;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t bitsPerSample = 1;
+    uint32_t samplesPerPixel = 1;
+    uint32_t compression = 1;
+    uint32_t photometric = 0;
+    uint32_t planarConfig = 1;
+    uint32_t sampleFormat = 1;
+    uint32_t rowsPerStrip = std::numeric_limits<uint32_t>::max();
+    uint32_t orientation = 1;
+    bool isTiled = false;
+    size_t stripOffsetsEntry = 0;  // Offset of the StripOffsets entry in the file
+    uint32_t stripOffsetsType = 0;
+    uint32_t stripOffsetsCount = 0;
+  };
+
+  static bool parseTiffImageHeader(const MappedFile& file, TiffImageHeader& header);
+  static int getTiffDepth(const TiffImageHeader& header);  // OpenCV depth of the samples, or -1 if not supported
+  static std::optional<uint32_t> readTiffValue(const MappedFile& file, size_t entryOffset, uint32_t type, uint32_t count, uint32_t index, bool isLittleEndian);
+
+  static std::optional<size_t> findTiffHeader(const MappedFile& file);
+  static bool parseTiffStructure(const MappedFile& file, size_t tiffOffset, EmbeddedPreviewInfo& info);
+  static std::optional<uint32_t> readTiffInteger(const MappedFile& file, size_t offset, int numBytes, bool isLittleEndian);
+};
+
+enum class ChannelOrder {
+  RGB,  // R, G, B(, A) in memory
+  BGR,  // B, G, R(, A) in memory (OpenCV's default)
 };
 
 struct ImageData {
   ImageData() = default;                                                     // Default constructor
   ImageData(const cv::Mat& img, const fs::path& p) : image(img), path(p) {}  // Constructor with image and path
 
-  cv::Mat image;  // OpenCV Mat object to hold the image data
+  cv::Mat image;  // OpenCV Mat object to hold the image data. The depth is one of CV_8U, CV_16U and CV_32F with 1, 3 or 4 channels.
   fs::path path;  // Path to the image file
 
-  bool empty() const { return image.empty(); }  // Check if the image is empty
+  ChannelOrder channelOrder = ChannelOrder::BGR;  // Order of the color channels in memory
+  int orientation = 1;                            // EXIF orientation (1-8) applied when drawing. The rows are stored top to bottom as decoded.
+  double minValue = 0.0;                          // Minimum pixel value, used to normalize the image for display
+  double maxValue = 1.0;                          // Maximum pixel value, used to normalize the image for display
+  bool isPreview = false;                         // Downscaled preview shown until the full image is loaded
+  TiledImage_t tiledImage;                        // Full image read by region when too large to decode at once. The image is an overview of it then.
+  MappedFile_t mappedFile;                        // Mapped file the pixels refer to until the loader copies them. Not set on the loaded images.
+  std::optional<FileStamp> fileStamp;             // Stamp of the file the image is loaded from, which tells if the cached image is stale
+  uint64_t generation = 0;                        // Number of the decode the full image comes from, which differs when the file is loaded again. 0 if not loaded by the loader.
+  std::vector<cv::Mat> mipLevels;                 // Mip levels 1 onward of the image uploaded as is. Generated by OpenGL instead if empty.
+  cv::Size fullSize;                              // Size of the full image from the header in the layout of the preview's pixels. Empty if unknown.
+
+  int depth() const { return image.depth(); }        // CV_8U, CV_16U or CV_32F
+  int channels() const { return image.channels(); }  // 1, 3 or 4
+
+  bool empty() const { return image.empty(); }                                // Check if the image is empty
+  size_t getSizeInBytes() const;                                              // Size of the pixel data in bytes including the mip levels
 };
 
 using ImageData_t = std::shared_ptr<ImageData>;
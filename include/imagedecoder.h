@@ -0,0 +1,150 @@
+#pragma once
+
+#include <fileutil.h>
+#include <image.h>
+#include <threadpool.h>
+#include <tiledimage.h>
+
+#include <memory>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <optional>
+#include <string>
+#include <vector>
+
+// ###########################################################################################################################################
+// ImageDecoder
+// ###########################################################################################################################################
+
+// What a decoder can do beyond the full decode, so that the loader picks the cheapest way for each request
+struct DecoderCapabilities {
+  bool reducedScale = false;     // Decode at 1/2, 1/4 or 1/8 of the size without decoding the full image
+  bool region = false;           // Read the image by region without decoding the whole
+  bool headerProbe = false;      // Read the size, the channels, the depth and the orientation from the header without decoding
+  bool embeddedPreview = false;  // Read the preview embedded in the file
+};
+
+// Backend decoding the formats it recognizes by the magic bytes.
+// The methods of the capabilities the backend does not have return false or std::nullopt.
+// NOTE: The methods are called from the worker threads concurrently, and must be thread-safe.
+class ImageDecoder {
+ public:
+  virtual ~ImageDecoder();
+
+  virtual std::string getName() const = 0;
+  virtual std::vector<std::string> getExtensions() const = 0;  // Extensions of the files listed in lower case with the dot
+  virtual DecoderCapabilities getCapabilities() const = 0;
+
+  virtual bool canDecode(const MappedFile& file) const = 0;  // True if the magic bytes are of a format of this backend
+
+  // Decode the full image with its channel order and orientation. Returns false if the backend cannot decode the file after all.
+  virtual bool decode(const MappedFile_t& file, ImageData& imageData) const = 0;
+
+  virtual std::optional<ImageInfo> probe(const MappedFile& file) const;
+  virtual bool decodeReduced(const MappedFile& file, int reduction, ImageData& imageData) const;  // The reduction is 2, 4 or 8
+  virtual bool readEmbeddedPreview(const MappedFile& file, ImageData& preview) const;
+
+  // Open the file to read by region. Sets the tiled image, the channel order and the orientation, leaving the image empty.
+  virtual bool openTiledImage(const fs::path& filePath, const ThreadPool_t& threadPool, ImageData& imageData) const;
+};
+
+using ImageDecoder_t = std::shared_ptr<ImageDecoder>;
+
+// ###########################################################################################################################################
+// Built-in decoders
+// ###########################################################################################################################################
+
+// Any format OpenCV decodes. The fallback for the files no other backend decodes.
+class OpenCVImageDecoder : public ImageDecoder {
+ public:
+  std::string getName() const override;
+  std::vector<std::string> getExtensions() const override;
+  DecoderCapabilities getCapabilities() const override;
+
+  bool canDecode(const MappedFile& file) const override;
+  bool decode(const MappedFile_t& file, ImageData& imageData) const override;
+};
+
+// JPEG scaled down in the DCT, with the size from the SOF segment and the EXIF thumbnail
+class JpegImageDecoder : public OpenCVImageDecoder {
+ public:
+  std::string getName() const override;
+  std::vector<std::string> getExtensions() const override;
+  DecoderCapabilities getCapabilities() const override;
+
+  bool canDecode(const MappedFile& file) const override;
+
+  std::optional<ImageInfo> probe(const MappedFile& file) const override;
+  bool decodeReduced(const MappedFile& file, int reduction, ImageData& imageData) const override;
+  bool readEmbeddedPreview(const MappedFile& file, ImageData& preview) const override;
+};
+
+// PNG with the properties from the IHDR chunk
+class PngImageDecoder : public OpenCVImageDecoder {
+ public:
+  std::string getName() const override;
+  std::vector<std::string> getExtensions() const override;
+  DecoderCapabilities getCapabilities() const override;
+
+  bool canDecode(const MappedFile& file) const override;
+
+  std::optional<ImageInfo> probe(const MappedFile& file) const override;
+};
+
+// OpenEXR with the properties from the header
+class ExrImageDecoder : public OpenCVImageDecoder {
+ public:
+  std::string getName() const override;
+  std::vector<std::string> getExtensions() const override;
+  DecoderCapabilities getCapabilities() const override;
+
+  bool canDecode(const MappedFile& file) const override;
+
+  std::optional<ImageInfo> probe(const MappedFile& file) const override;
+};
+
+// TIFF with the properties from IFD0 and the preview of camera raw files, and read by region with libtiff if available
+class TiffImageDecoder : public OpenCVImageDecoder {
+ public:
+  std::string getName() const override;
+  std::vector<std::string> getExtensions() const override;
+  DecoderCapabilities getCapabilities() const override;
+
+  bool canDecode(const MappedFile& file) const override;
+
+  std::optional<ImageInfo> probe(const MappedFile& file) const override;
+  bool readEmbeddedPreview(const MappedFile& file, ImageData& preview) const override;
+  bool openTiledImage(const fs::path& filePath, const ThreadPool_t& threadPool, ImageData& imageData) const override;
+};
+
+// Uncompressed images referred to in the mapped file without decoding. See ImagingUtil::mapRawImage().
+class RawImageDecoder : public ImageDecoder {
+ public:
+  std::string getName() const override;
+  std::vector<std::string> getExtensions() const override;
+  DecoderCapabilities getCapabilities() const override;
+
+  bool canDecode(const MappedFile& file) const override;
+  bool decode(const MappedFile_t& file, ImageData& imageData) const override;
+};
+
+// ###########################################################################################################################################
+// ImageDecoderRegistry
+// ###########################################################################################################################################
+
+class ImageDecoderRegistry {
+ public:
+  ImageDecoderRegistry() = delete;  // Prevent instantiation of this class
+
+  // Add a backend. The backends added later take precedence over the earlier ones and the built-in ones for the same format.
+  static void registerDecoder(const ImageDecoder_t& decoder);
+
+  // Backends recognizing the file, in the order of precedence. The OpenCV backend always comes last as the fallback.
+  static std::vector<ImageDecoder_t> findDecoders(const MappedFile& file);
+
+  static bool isSupportedExtension(const fs::path& filePath);
+
+ private:
+  static std::mutex& getMutex();
+  static std::vector<ImageDecoder_t>& getDecoders();  // Guarded by getMutex(). The fallback is the last one.
+};
@@ -2,70 +2,260 @@
 
 #include <fileutil.h>
 #include <image.h>
+#include <imagedecoder.h>
+#include <previewstore.h>
+#include <threadpool.h>
 
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <functional>
 #include <future>
+#include <limits>
+#include <list>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <opencv2/opencv.hpp>
-#include <queue>
+#include <optional>
 #include <thread>
 #include <vector>
 
+// The backends of cv::parallel_for_() are pluggable since OpenCV 4.5.2
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && (CV_VERSION_MINOR > 5 || (CV_VERSION_MINOR == 5 && CV_VERSION_REVISION >= 2)))
+#define RVIEW_HAS_OPENCV_PARALLEL_BACKEND
+#include <opencv2/core/parallel/parallel_backend.hpp>
+#endif
+
 // ###########################################################################################################################################
-// ThreadPool
+// ImageCache
 // ###########################################################################################################################################
 
-class ThreadPool {
-  // https://contentsviewer.work/Master/software/cpp/how-to-implement-a-thread-pool/article
+// LRU cache of decoded images bounded by the total size of the pixel data.
+// The capacity shrinks automatically when the process is running out of memory.
+// The images are evicted when looked up after their file has been modified.
+// NOTE: This class is not thread-safe. The owner must guard it.
+class ImageCache {
+ public:
+  ImageCache(size_t capacityBytes);
+  ~ImageCache();
+
+  bool tryGet(const fs::path& filePath, ImageData& imageData);  // Marks the entry as the most recently used
+  bool contains(const fs::path& filePath);  // Evicts the entry if it is stale
+  void put(const fs::path& filePath, const ImageData& imageData);
+  void erase(const fs::path& filePath);
+  void clear();
+
+  void setCapacity(size_t capacityBytes);
+  size_t getCapacity() const;
+  size_t getSizeInBytes() const;
+  size_t size() const;
+
+ private:
+  using Entry = std::pair<fs::path, ImageData>;
+
+  std::list<Entry> _entries;  // The most recently used entry comes first
+  std::map<fs::path, std::list<Entry>::iterator> _entryIndex;
+
+  size_t _capacityBytes;
+  size_t _sizeInBytes;
+
+  std::chrono::steady_clock::time_point _lastMemoryCheckTime;
+  size_t _memoryLimitBytes;
+
+  size_t getEffectiveCapacity();
+  void evict();
+  bool eraseIfStale(const fs::path& filePath);
+
+  static bool isStale(const fs::path& filePath, const ImageData& imageData);
+};
+
+// ###########################################################################################################################################
+// NavigationTracker
+// ###########################################################################################################################################
 
+// Tracks the recent navigation of the user to predict the images requested next
+class NavigationTracker {
  public:
-  ThreadPool(int numThreads);
-  ~ThreadPool();
+  NavigationTracker();
+  ~NavigationTracker();
+
+  void record(int index);
+  void reset();
 
-  template <typename F>
-  auto submit(F&& func) -> std::future<std::invoke_result_t<F>>;
+  int getDirection() const;    // +1 for forward, -1 for backward and 0 if the user is not moving
+  double getStepRate() const;  // Number of steps per second
 
  private:
-  std::vector<std::thread> _workers;
-  mutable std::mutex _taskMutex;
-  bool _isRunning;
-  std::condition_variable _condition;
-  std::queue<std::function<void()>> _tasks;
-
-  template <typename F>
-  void pushTask(const F& task);
-  void worker();
+  using Clock = std::chrono::steady_clock;
+
+  std::deque<std::pair<Clock::time_point, int>> _history;  // Pairs of the time and the index
+
+  void removeExpired(Clock::time_point now);
+};
+
+// ###########################################################################################################################################
+// PrefetchStatistics
+// ###########################################################################################################################################
+
+struct PrefetchStatistics {
+  size_t numRequests = 0;      // Number of requested images
+  size_t numCacheHits = 0;     // Requested images already decoded
+  size_t numInFlightHits = 0;  // Requested images already being decoded
+  size_t numMisses = 0;        // Requested images not prefetched at all
+
+  size_t numCoalescedDecodes = 0;  // Consumers served by a decode started for another consumer, counted once it succeeds. Prefetches are not counted.
+
+  int numThreads = 0;                 // Current number of decoding threads
+  int numPreloadedImages = 0;         // Current prefetch depth
+  double averageDecodeSeconds = 0.0;  // Moving average of the time to load an image
+  double averageImageBytes = 0.0;     // Moving average of the size of a decoded image
+
+  double getHitRate() const { return numRequests > 0 ? static_cast<double>(numCacheHits + numInFlightHits) / numRequests : 0.0; }
 };
 
-using ThreadPool_t = std::shared_ptr<ThreadPool>;
+#if defined(RVIEW_HAS_OPENCV_PARALLEL_BACKEND)
+
+// ###########################################################################################################################################
+// OpenCVParallelBackend
+// ###########################################################################################################################################
+
+// Runs cv::parallel_for_() on the workers of the pool instead of the threads of OpenCV, so that the conversions and the resizing inside
+// OpenCV share the cores with the loading instead of oversubscribing them. The stripes run at the priority of the calling task.
+// NOTE: The pool is not kept alive by OpenCV. The stripes run on the calling thread once the pool is shut down or gone.
+class OpenCVParallelBackend : public cv::parallel::ParallelForAPI {
+ public:
+  OpenCVParallelBackend(const ThreadPool_t& threadPool);
+
+  void parallel_for(int tasks, FN_parallel_for_body_cb_t body_callback, void* callback_data) override;
+  int getThreadNum() const override;
+  int getNumThreads() const override;
+  int setNumThreads(int nThreads) override;  // Ignored. The pool adapts the number of the threads by itself.
+  const char* getName() const override;
+
+ private:
+  std::weak_ptr<ThreadPool> _threadPool;
+};
+
+#endif
 
 // ###########################################################################################################################################
 // AsyncImageLoader
 // ###########################################################################################################################################
 
+using ImageCallback_t = std::function<void(const ImageData&)>;
+
 class AsyncImageLoader {
  public:
   AsyncImageLoader(int numThreads,
-                   int numPreloadedImages);
+                   int numPreloadedImages,
+                   size_t cacheCapacityBytes);
   ~AsyncImageLoader();
 
-  void loadImageImpl(const fs::path& filePath, std::promise<ImageData>&& promise);
+  void loadImageImpl(const fs::path& filePath, std::promise<ImageData>&& promise, const CancellationToken_t& token);
 
   void loadImages(const std::vector<fs::path>& filePaths);
   ImageData getImage(const fs::path& filePath);
+  // The callback may be called with a preview (ImageData::isPreview) before the full image
+  void requestImage(const fs::path& filePath, ImageCallback_t callback);
+
+  // The image for the consumers other than the view, such as the exports and the batch jobs. Any number of consumers share a single decode.
+  // The future is ready at once if the image is cached, or joins the decode in flight. Otherwise, a new decode is started, which is kept
+  // while the view moves to the other images. get() throws if the image fails to load or the directory is changed meanwhile.
+  std::shared_future<ImageData> loadImageAsync(const fs::path& filePath);
+
+  // Called on the worker with each image decoded ahead of the request, such as the prefetched ones. Not called after this returns.
+  void setImageLoadedCallback(ImageCallback_t callback);
+
+  void setCacheCapacity(size_t capacityBytes);
+  size_t getCacheCapacity() const;
+
+  // Size of the view in pixels. The preview decoded at reduced resolution covers it.
+  void setViewportSize(int width, int height);
+
+  // Properties of the image read from the header without decoding, or std::nullopt if the format has no probe.
+  // The results are cached per file, and the files of the current directory are probed in the background.
+  std::optional<ImageInfo> probeImage(const fs::path& filePath);
+
+  PrefetchStatistics getPrefetchStatistics() const;
 
  private:
+  struct PendingRequest {
+    fs::path path;
+    ImageCallback_t callback;
+  };
+
+  // Decode in flight. The consumers wait on copies of the future, and the entry is removed when the decode finishes.
+  struct LoadTask {
+    std::shared_future<ImageData> future;
+    CancellationToken_t token;
+    bool isKept;        // Started by loadImageAsync(). Not cancelled when the prefetch window moves.
+    bool isPrefetched;       // Started for an image in the window other than the requested one
+    int numSharedConsumers;  // Consumers attached after the start, unless prefetched. Counted as coalesced once the image is loaded.
+  };
+
+  struct ProbedImage {
+    std::optional<ImageInfo> info;
+    fs::file_time_type writeTime;  // The probe is redone once the file is modified
+  };
+
+  // The preview of the requested image runs first, since it is much faster to load than the full image.
+  // The requested image follows, and the others are prioritized by the distance from the requested one.
+  // The probe of the headers is so fast that it runs before the other images to budget them.
+  // The background work runs only while nothing else is queued.
+  // NOTE: The preview and the requested image go to the shared queue of the pool (ThreadPool::URGENT_PRIORITY), and the others to the queues of the workers.
+  inline static const int PRIORITY_PREVIEW = std::numeric_limits<int>::max();
+  inline static const int PRIORITY_REQUESTED_IMAGE = ThreadPool::URGENT_PRIORITY;
+  inline static const int PRIORITY_PROBE = std::numeric_limits<int>::max() - 2;
+  inline static const int PRIORITY_BACKGROUND = std::numeric_limits<int>::min();
+
   ThreadPool_t _threadPool;
+#if defined(RVIEW_HAS_OPENCV_PARALLEL_BACKEND)
+  std::shared_ptr<OpenCVParallelBackend> _parallelBackend;  // Installed for the lifetime of the loader
+#endif
+
+  PreviewStore_t _previewStore;
+  CancellationToken_t _backgroundToken;  // Cancelled on destruction to drop the background work
 
-  std::mutex _imageMutex;
-  std::map<fs::path, std::future<ImageData>> _futures;
+  mutable std::mutex _imageMutex;
+  std::map<fs::path, LoadTask> _loadTasks;
 
   int _numPreloadedImages;
   std::vector<fs::path> _imagePaths;
 
-  std::map<fs::path, ImageData> _imageCache;
+  ImageCache _imageCache;
+
+  std::map<fs::path, ProbedImage> _probedImages;
+  CancellationToken_t _probeToken;  // Cancelled when the directory is changed
+
+  // The latest image requested with requestImage(). Older requests are superseded and never delivered.
+  PendingRequest _pendingRequest;
+
+  std::mutex _imageLoadedMutex;  // Held while the callback is called
+  ImageCallback_t _imageLoadedCallback;
+
+  cv::Size _viewportSize;
+
+  NavigationTracker _navigationTracker;
+  PrefetchStatistics _prefetchStatistics;
+  size_t _numDecodeSamples;
+
+  std::atomic<uint64_t> _nextGeneration;  // Numbers the decodes. See ImageData::generation.
+
+  std::vector<std::pair<int, int>> getPreloadWindow(int currentIndex) const;
+  void recordRequest(const fs::path& filePath, bool isCached);
+  void recordDecode(double decodeSeconds, size_t imageBytes);
+  void adaptPrefetchDepth();
+  void updatePreloadQueue(const fs::path& filePath);
+  void submitLoadTask(const fs::path& filePath, int priority, bool isKept, bool isPrefetched);
+  bool finishLoadTask(const fs::path& filePath, const CancellationToken_t& token, bool isLoaded);  // Returns false if the task has been superseded
+  void loadPreviewImpl(const fs::path& filePath);
+  void deliverPreview(const ImageData& preview);
+  bool decodeReducedImage(const std::vector<ImageDecoder_t>& decoders, const std::optional<ImageInfo>& imageInfo, const MappedFile& file, ImageData& imageData) const;
+  std::optional<ImageInfo> probeImageImpl(const MappedFile& file, const std::vector<ImageDecoder_t>& decoders);
+  bool isTooLargeToPrefetch(const fs::path& filePath) const;
+  bool decodeFullImage(const std::vector<ImageDecoder_t>& decoders, const MappedFile_t& file, ImageData& imageData) const;
+  bool openTiledImage(const std::vector<ImageDecoder_t>& decoders, const fs::path& filePath, const std::optional<ImageInfo>& imageInfo, ImageData& imageData) const;  // Returns false if the image is decoded at once
 };
 
 using AsyncImageLoader_t = std::shared_ptr<AsyncImageLoader>;
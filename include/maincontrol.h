@@ -4,6 +4,7 @@
 #include <filelistmodel.h>
 #include <fileutil.h>
 #include <image.h>
+#include <imagedecoder.h>
 #include <imageloader.h>
 
 #include <cctype>
@@ -17,15 +18,6 @@ class MainControl {
 
  public:
   inline static const uint32_t NUM_IMAGES_TO_LOAD = 50;
-  inline static const std::set<std::string> SUPPORTED_IMAGE_EXTENSIONS = {
-      ".png",
-      ".jpg",
-      ".jpeg",
-      ".bmp",
-      ".tiff",
-      ".tif",
-      ".exr",
-  };
 
   MainControl();
   ~MainControl();
@@ -40,6 +32,15 @@ class MainControl {
   void goForward();
 
   ImageData getImageData(const fs::path& filename) const;
+  void requestImageData(const fs::path& filename, ImageCallback_t callback) const;
+  void setImageLoadedCallback(ImageCallback_t callback) const;
+
+  void setImageCacheCapacity(size_t capacityBytes);
+  size_t getImageCacheCapacity() const;
+
+  void setViewportSize(int width, int height);
+
+  PrefetchStatistics getPrefetchStatistics() const;
 };
 
 using MainControl_t = std::shared_ptr<MainControl>;
@@ -23,10 +23,13 @@ class MainWindow : public QMainWindow {
   Ui::MainWindow *_ui;
   MainControl_t _control;
   QActionGroup *_resampleActionGroup;
+  fs::path _requestedImagePath;
+  bool _isRequestedImageLoaded;  // False while nothing or only the preview of the requested image is shown
 
   void updateFileList();
   void updateImage(const fs::path &fileName);
   void updateImage(const ImageData &imageData);
+  void onImageLoaded(const ImageData &imageData);
 
   void goParent();
   void goChild();
@@ -46,7 +49,15 @@ class MainWindow : public QMainWindow {
   void on_actionOpenDir_triggered();
   void on_actionBilinear_triggered();
   void on_actionBicubic_triggered();
+  void on_actionMitchell_triggered();
+  void on_actionLanczos2_triggered();
+  void on_actionLanczos3_triggered();
   void on_actionLanczos4_triggered();
+  void on_actionGaussian_triggered();
+  void on_actionRotateClockwise_triggered();
+  void on_actionRotateCounterclockwise_triggered();
+  void on_actionFlipHorizontally_triggered();
+  void on_actionFlipVertically_triggered();
 
  protected:
   void dragEnterEvent(QDragEnterEvent *event) override;
@@ -0,0 +1,28 @@
+#ifndef MEMORYUTIL_H
+#define MEMORYUTIL_H
+
+#include <cstddef>
+#include <optional>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+class MemoryUtil {
+ public:
+  MemoryUtil() = delete;  // Prevent instantiation of this class
+
+  // Returns the number of bytes this process can still allocate before running into the system memory
+  // or the cgroup memory limit. Returns std::nullopt if it cannot be determined on this platform.
+  static std::optional<size_t> getAvailableMemory();
+
+ private:
+#ifdef __linux__
+  static std::optional<size_t> readMemAvailable();
+  static std::optional<size_t> readCgroupAvailable();
+  static std::optional<size_t> readSizeFromFile(const std::string& filePath);
+#endif
+};
+
+#endif  // MEMORYUTIL_H
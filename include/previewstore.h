@@ -0,0 +1,62 @@
+#pragma once
+
+#include <fileutil.h>
+#include <image.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <optional>
+#include <string>
+
+// ###########################################################################################################################################
+// PreviewStore
+// ###########################################################################################################################################
+
+// Persistent store of downscaled previews under the user cache directory, which survives the restart of the application.
+// A preview is keyed by the path, the size and the modification time of the image, so that a modified image never gets a stale preview.
+// Every preview is written to a temporary file and renamed into place, so that RView processes sharing the store never read a partial file.
+// NOTE: This class is thread-safe.
+class PreviewStore {
+ public:
+  enum class Level {
+    Thumbnail,  // Fits in Common::PREVIEW_THUMBNAIL_SIZE
+    Screen,     // Fits in Common::PREVIEW_SCREEN_SIZE
+  };
+
+  PreviewStore(const fs::path& storeDir, size_t capacityBytes);
+  ~PreviewStore();
+
+  static fs::path getDefaultDirectory();
+
+  // Create a preview of the decoded image, which fits in the screen level. The preview is always 8-bit BGR(A).
+  static ImageData createPreview(const ImageData& imageData);
+
+  bool isAvailable() const;
+  bool contains(const fs::path& filePath, Level level) const;
+  bool load(const fs::path& filePath, Level level, ImageData& preview) const;  // Marks the preview as the most recently used
+  void store(const fs::path& filePath, const ImageData& preview);              // Store all the levels of a preview from createPreview()
+  void storeThumbnail(const fs::path& filePath, const ImageData& preview);     // Store only the thumbnail level, e.g. from an embedded preview
+
+  // Remove the least recently used previews until the store fits in the capacity
+  void evict();
+
+ private:
+  fs::path _storeDir;
+  size_t _capacityBytes;
+  bool _isAvailable;
+
+  std::atomic<uint64_t> _nextTemporaryId;
+  std::atomic<int> _numStoresSinceEviction;
+
+  std::optional<std::string> getKey(const fs::path& filePath) const;
+  std::optional<fs::path> findPreview(const std::string& key, Level level) const;
+  void storeLevel(const std::string& key, Level level, const cv::Mat& image);
+  void storeThumbnailLevel(const std::string& key, const cv::Mat& image);
+  void countStore();
+
+  static int getMaxSize(Level level);
+};
+
+using PreviewStore_t = std::shared_ptr<PreviewStore>;
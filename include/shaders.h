@@ -1,8 +1,15 @@
 #pragma once
 
+#include <common.h>
+
 #include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
 #include <QString>
+#include <array>
+#include <cmath>
+#include <functional>
 #include <memory>
+#include <numbers>
 #include <string>
 #include <vector>
 
@@ -49,6 +56,21 @@ class ImageShaderBase : public DefaultVertexShader {
   inline static const char* UNIFORM_NAME_RECT_BOTTOM_RIGHT = "u_rectBottomRight";
   inline static const char* UNIFORM_NAME_BACKGROUND_COLOR  = "u_backgroundColor";
   inline static const char* UNIFORM_NAME_TEXTURE_SIZE      = "u_textureSize";
+  inline static const char* UNIFORM_NAME_TEXTURE_LOD       = "u_textureLod";
+  inline static const char* UNIFORM_NAME_VALUE_SCALE       = "u_valueScale";
+  inline static const char* UNIFORM_NAME_VALUE_OFFSET      = "u_valueOffset";
+  inline static const char* UNIFORM_NAME_NUM_CHANNELS      = "u_numChannels";
+  inline static const char* UNIFORM_NAME_SWAP_RED_BLUE     = "u_swapRedBlue";
+  inline static const char* UNIFORM_NAME_UV_TRANSFORM      = "u_uvTransform";
+  inline static const char* UNIFORM_NAME_IS_TILED          = "u_isTiled";
+  inline static const char* UNIFORM_NAME_TILE_TABLE        = "u_tileTable";
+  inline static const char* UNIFORM_NAME_TILE_SIZE         = "u_tileSize";
+  inline static const char* UNIFORM_NAME_INTERMEDIATE      = "u_intermediate";
+  inline static const char* UNIFORM_NAME_PASS_AXIS         = "u_passAxis";
+  inline static const char* UNIFORM_NAME_PASS_NUM_PIXELS   = "u_passNumPixels";
+  inline static const char* UNIFORM_NAME_PASS_ROW_BEGIN    = "u_passRowBegin";
+  inline static const char* UNIFORM_NAME_PASS_NUM_ROWS     = "u_passNumRows";
+  inline static const char* UNIFORM_NAME_KERNEL_LUT        = "u_kernelLut";
   // clang-format on
 
   inline static const char* FRAGMENT_SHADER_CODE_PRE = R"(
@@ -62,10 +84,59 @@ uniform vec2 u_pixelSize;
 uniform vec2 u_rectTopLeft;
 uniform vec2 u_rectBottomRight;
 uniform vec3 u_backgroundColor;
-uniform vec2 u_textureSize; // Texture size
+uniform vec2 u_textureSize; // Size of the mip level read, or of the tiled image
+uniform float u_textureLod; // Mip level of u_texture pre-filtered for the zoom. The filters are applied to the texels of this level.
+uniform float u_valueScale; // Scale to normalize the texel values to [0, 1]
+uniform float u_valueOffset; // Offset to normalize the texel values to [0, 1]
+uniform int u_numChannels; // Number of channels of the texture (1, 3 or 4)
+uniform bool u_swapRedBlue; // True if the texture is stored in BGR(A) order
+uniform mat3 u_uvTransform; // Maps the coordinates in the image rect to the texture coordinates (orientation, rotation and flip)
+uniform bool u_isTiled; // True if u_texture is an atlas of the tiles of the image
+uniform sampler2D u_tileTable; // Slot of each tile in the atlas and the scale of the texel coordinates to it. The slot is negative if nothing is resident.
+uniform int u_tileSize; // Side of the tiles in texels
 
 out vec4 out_color;
 
+// Map the coordinates on the screen to the texture coordinates
+vec2 toTextureCoord(vec2 screenCoord) {
+  vec2 rectCoord = (screenCoord - u_rectTopLeft) / (u_rectBottomRight - u_rectTopLeft); // Ranged in [0, 1]
+  return (u_uvTransform * vec3(rectCoord, 1.0)).xy;
+}
+
+// Look up the texel in the atlas through the tile table if tiled
+vec4 sampleTexture(vec2 uv) {
+  if (!u_isTiled) {
+    return textureLod(u_texture, uv, u_textureLod);
+  }
+
+  ivec2 texel = ivec2(clamp(uv * u_textureSize, vec2(0.0), u_textureSize - 1.0));
+  vec4 entry = texelFetch(u_tileTable, texel / u_tileSize, 0);
+
+  if (entry.x < 0.0) {
+    return vec4(0.0);
+  }
+
+  // The scale is 1 for the tile itself, or less for a tile of a coarser level drawn while the tile is read
+  ivec2 texelInSlot = ivec2((vec2(texel) + 0.5) * entry.zw) % u_tileSize;
+  return texelFetch(u_texture, ivec2(entry.xy) * u_tileSize + texelInSlot, 0);
+}
+
+// Fetch the texel as normalized RGBA
+vec4 fetchTexel(vec2 uv) {
+  vec4 color = sampleTexture(uv);
+
+  if (u_swapRedBlue) {
+    color = color.bgra;
+  }
+  if (u_numChannels == 1) {
+    color = vec4(color.rrr, 1.0);
+  }
+
+  color.rgb = color.rgb * u_valueScale + u_valueOffset;
+
+  return color;
+}
+
   )";
 
   QString getFragmentShaderCode() const {
@@ -85,7 +156,7 @@ void main() {
 
   if (f_uv.x >= u_rectTopLeft.x && f_uv.x <= u_rectBottomRight.x &&
       f_uv.y >= u_rectTopLeft.y && f_uv.y <= u_rectBottomRight.y) {
-    vec2 uv = (f_uv - u_rectTopLeft) / (u_rectBottomRight - u_rectTopLeft); // Ranged in [0, 1]
+    vec2 uv = toTextureCoord(f_uv); // Ranged in [0, 1]
 
     // Calc the pixel index of nearest pixel
     // Note: The pixel index is calculated based on the texture size
@@ -104,7 +175,7 @@ void main() {
     float pixelY = (float(pixelIdxY) + 0.5) / float(u_textureSize.y);
 
     // Calc the color
-    out_color = texture(u_texture, vec2(pixelX, pixelY));
+    out_color = fetchTexel(vec2(pixelX, pixelY));
   }
 }
   )";
@@ -120,7 +191,7 @@ void main() {
 
   if (f_uv.x >= u_rectTopLeft.x && f_uv.x <= u_rectBottomRight.x &&
       f_uv.y >= u_rectTopLeft.y && f_uv.y <= u_rectBottomRight.y) {
-    vec2 uv = (f_uv - u_rectTopLeft) / (u_rectBottomRight - u_rectTopLeft); // Ranged in [0, 1]
+    vec2 uv = toTextureCoord(f_uv); // Ranged in [0, 1]
     
     float strideX = 1.0 / float(u_textureSize.x);
     float strideY = 1.0 / float(u_textureSize.y);
@@ -150,10 +221,10 @@ void main() {
     float validPixelYLow = max(0.0, min(1.0, pixelYLow));
     float validPixelYHigh = max(0.0, min(1.0, pixelYHigh));
 
-    vec4 colorUL = texture(u_texture, vec2(validPixelXLow, validPixelYLow));
-    vec4 colorUR = texture(u_texture, vec2(validPixelXHigh, validPixelYLow));
-    vec4 colorLL = texture(u_texture, vec2(validPixelXLow, validPixelYHigh));
-    vec4 colorLR = texture(u_texture, vec2(validPixelXHigh, validPixelYHigh));
+    vec4 colorUL = fetchTexel(vec2(validPixelXLow, validPixelYLow));
+    vec4 colorUR = fetchTexel(vec2(validPixelXHigh, validPixelYLow));
+    vec4 colorLL = fetchTexel(vec2(validPixelXLow, validPixelYHigh));
+    vec4 colorLR = fetchTexel(vec2(validPixelXHigh, validPixelYHigh));
 
     out_color = weightUL * colorUL + weightUR * colorUR +
                 weightLL * colorLL + weightLR * colorLR;
@@ -167,265 +238,180 @@ void main() {
   }
 };
 
-class BicubicImageShader : public ImageShaderBase {
- protected:
-  const char* getFragmentShaderMainFuncCode() const override {
-    return R"(
-float sinc_taylor_expanded(float x, float a) {
-  float x_abs = abs(x);
-  float res = 0.0;
-
-  if (x_abs <= 1.0) {
-    float x_abs_2 = x_abs * x_abs;
-    float x_abs_3 = x_abs_2 * x_abs;
-    res = (a + 2.0) * x_abs_3 - (a + 3.0) * x_abs_2 + 1.0;
-  } else if (x_abs <= 2.0) {
-    float x_abs_2 = x_abs * x_abs;
-    float x_abs_3 = x_abs_2 * x_abs;
-    res = a * x_abs_3 - 5.0 * a * x_abs_2 + 8.0 * a * x_abs - 4.0 * a;
-  }
+// ###########################################################################################################################################
+// Kernel shaders
+// ###########################################################################################################################################
+
+// The weights of the kernel looked up in a texture tabulated on the CPU, instead of evaluated per tap.
+// KERNEL_RADIUS is defined per kernel when the program is built, so that the loops over the taps are unrolled.
+inline static const char* KERNEL_LUT_CODE = R"(
+#define KERNEL_LUT_SIZE (KERNEL_RADIUS * KERNEL_LUT_SAMPLES_PER_TEXEL + 1)
 
-  return res;
+uniform sampler2D u_kernelLut; // Weights over the distance in [0, KERNEL_RADIUS] texels, interpolated linearly between the samples
+
+float kernel_weight(float x) {
+  float position = abs(x) * float(KERNEL_LUT_SAMPLES_PER_TEXEL);
+  return texture(u_kernelLut, vec2((position + 0.5) / float(KERNEL_LUT_SIZE), 0.5)).r;
 }
+)";
+
+inline static std::string getKernelCode(int radius) {
+  return "#define KERNEL_RADIUS " + std::to_string(radius) + "\n" +
+         "#define KERNEL_LUT_SAMPLES_PER_TEXEL " + std::to_string(Common::KERNEL_LUT_SAMPLES_PER_TEXEL) + "\n" +
+         KERNEL_LUT_CODE;
+}
+
+// The kernel in a single pass reading (2 * radius)^2 texels. Drawn if the intermediate texture of the separable passes cannot be allocated.
+class KernelImageShader : public ImageShaderBase {
+ public:
+  explicit KernelImageShader(int radius)
+      : _mainFuncCode(getKernelCode(radius) + MAIN_FUNC_CODE) {}
 
+ protected:
+  const char* getFragmentShaderMainFuncCode() const override { return _mainFuncCode.c_str(); }
+
+ private:
+  std::string _mainFuncCode;
+
+  inline static const char* MAIN_FUNC_CODE = R"(
 void main() {
   out_color = vec4(u_backgroundColor, 1.0);
 
   if (f_uv.x >= u_rectTopLeft.x && f_uv.x <= u_rectBottomRight.x &&
       f_uv.y >= u_rectTopLeft.y && f_uv.y <= u_rectBottomRight.y) {
-    vec2 uv = (f_uv - u_rectTopLeft) / (u_rectBottomRight - u_rectTopLeft); // Ranged in [0, 1]
-    
-    float strideX = 1.0 / float(u_textureSize.x);
-    float strideY = 1.0 / float(u_textureSize.y);
-
-    // Calc the pixel index of nearest Left-top pixel
-    int pixelIdxX = int((uv.x - strideX / 2.0) / strideX);
-    int pixelIdxY = int((uv.y - strideY / 2.0) / strideY);
+    vec2 uv = toTextureCoord(f_uv); // Ranged in [0, 1]
+
+    vec2 center = uv * u_textureSize - 0.5;
+    ivec2 first = ivec2(floor(center)) - KERNEL_RADIUS + 1;
+    ivec2 last = ivec2(u_textureSize) - 1;
+
+    // The weights along each axis are looked up once
+    float weightX[2 * KERNEL_RADIUS];
+    float weightY[2 * KERNEL_RADIUS];
+    vec2 weightSum = vec2(0.0);
+    for (int i = 0; i < 2 * KERNEL_RADIUS; ++i) {
+      weightX[i] = kernel_weight(center.x - float(first.x + i));
+      weightY[i] = kernel_weight(center.y - float(first.y + i));
+      weightSum += vec2(weightX[i], weightY[i]);
+    }
 
-    // Calc the pixel coordinates
-    float pixelX1 = float(pixelIdxX) * strideX + strideX / 2.0;
-    float pixelX0 = pixelX1 - strideX;
-    float pixelX2 = pixelX1 + strideX;
-    float pixelX3 = pixelX2 + strideX;
-    float pixelY1 = float(pixelIdxY) * strideY + strideY / 2.0;
-    float pixelY0 = pixelY1 - strideY;
-    float pixelY2 = pixelY1 + strideY;
-    float pixelY3 = pixelY2 + strideY;
-
-    // Calc distance
-    float distX0 = uv.x - pixelX0;
-    float distX1 = uv.x - pixelX1;
-    float distX2 = pixelX2 - uv.x;
-    float distX3 = pixelX3 - uv.x;
-
-    float distY0 = uv.y - pixelY0;
-    float distY1 = uv.y - pixelY1;
-    float distY2 = pixelY2 - uv.y;
-    float distY3 = pixelY3 - uv.y;
+    vec4 color = vec4(0.0);
+    for (int j = 0; j < 2 * KERNEL_RADIUS; ++j) {
+      float v = (float(clamp(first.y + j, 0, last.y)) + 0.5) / u_textureSize.y;
 
-    // Calc weights
-    float a = -0.5;
-    vec4 weightX = vec4(sinc_taylor_expanded(distX0 / strideX, a),
-                        sinc_taylor_expanded(distX1 / strideX, a),
-                        sinc_taylor_expanded(distX2 / strideX, a),
-                        sinc_taylor_expanded(distX3 / strideX, a));
-    vec4 weightY = vec4(sinc_taylor_expanded(distY0 / strideY, a),
-                        sinc_taylor_expanded(distY1 / strideY, a),
-                        sinc_taylor_expanded(distY2 / strideY, a),
-                        sinc_taylor_expanded(distY3 / strideY, a));
+      vec4 rowColor = vec4(0.0);
+      for (int i = 0; i < 2 * KERNEL_RADIUS; ++i) {
+        float u = (float(clamp(first.x + i, 0, last.x)) + 0.5) / u_textureSize.x;
+        rowColor += fetchTexel(vec2(u, v)) * weightX[i];
+      }
 
-    // Calc the color
-    float validPixelX0 = max(0.0, min(1.0, pixelX0));
-    float validPixelX1 = max(0.0, min(1.0, pixelX1));
-    float validPixelX2 = max(0.0, min(1.0, pixelX2));
-    float validPixelX3 = max(0.0, min(1.0, pixelX3));
-
-    float validPixelY0 = max(0.0, min(1.0, pixelY0));
-    float validPixelY1 = max(0.0, min(1.0, pixelY1));
-    float validPixelY2 = max(0.0, min(1.0, pixelY2));
-    float validPixelY3 = max(0.0, min(1.0, pixelY3));
-
-    vec4 colorX0Y0 = texture(u_texture, vec2(validPixelX0, validPixelY0));
-    vec4 colorX1Y0 = texture(u_texture, vec2(validPixelX1, validPixelY0));
-    vec4 colorX2Y0 = texture(u_texture, vec2(validPixelX2, validPixelY0));
-    vec4 colorX3Y0 = texture(u_texture, vec2(validPixelX3, validPixelY0));
-
-    vec4 colorX0Y1 = texture(u_texture, vec2(validPixelX0, validPixelY1));
-    vec4 colorX1Y1 = texture(u_texture, vec2(validPixelX1, validPixelY1));
-    vec4 colorX2Y1 = texture(u_texture, vec2(validPixelX2, validPixelY1));
-    vec4 colorX3Y1 = texture(u_texture, vec2(validPixelX3, validPixelY1));
-    
-    vec4 colorX0Y2 = texture(u_texture, vec2(validPixelX0, validPixelY2));
-    vec4 colorX1Y2 = texture(u_texture, vec2(validPixelX1, validPixelY2));
-    vec4 colorX2Y2 = texture(u_texture, vec2(validPixelX2, validPixelY2));
-    vec4 colorX3Y2 = texture(u_texture, vec2(validPixelX3, validPixelY2));
-    
-    vec4 colorX0Y3 = texture(u_texture, vec2(validPixelX0, validPixelY3));
-    vec4 colorX1Y3 = texture(u_texture, vec2(validPixelX1, validPixelY3));
-    vec4 colorX2Y3 = texture(u_texture, vec2(validPixelX2, validPixelY3));
-    vec4 colorX3Y3 = texture(u_texture, vec2(validPixelX3, validPixelY3));
-    
-    // Calc color * weightX
-    vec4 tmpColor0 = colorX0Y0 * weightX.x + colorX1Y0 * weightX.y + colorX2Y0 * weightX.z + colorX3Y0 * weightX.w;
-    vec4 tmpColor1 = colorX0Y1 * weightX.x + colorX1Y1 * weightX.y + colorX2Y1 * weightX.z + colorX3Y1 * weightX.w;
-    vec4 tmpColor2 = colorX0Y2 * weightX.x + colorX1Y2 * weightX.y + colorX2Y2 * weightX.z + colorX3Y2 * weightX.w;
-    vec4 tmpColor3 = colorX0Y3 * weightX.x + colorX1Y3 * weightX.y + colorX2Y3 * weightX.z + colorX3Y3 * weightX.w;
+      color += rowColor * weightY[j];
+    }
 
-    // Calc weightY * color
-    out_color = tmpColor0 * weightY.x + tmpColor1 * weightY.y + tmpColor2 * weightY.z + tmpColor3 * weightY.w;
+    color /= weightSum.x * weightSum.y;
 
-    out_color.r = clamp(out_color.r, 0.0, 1.0);
-    out_color.g = clamp(out_color.g, 0.0, 1.0);
-    out_color.b = clamp(out_color.b, 0.0, 1.0);
-    out_color.a = 1.0;
+    out_color = vec4(clamp(color.rgb, 0.0, 1.0), 1.0);
   }
 }
   )";
-  }
 };
 
-class Lanczos4ImageShader : public ImageShaderBase {
+// The first pass filters the texel rows along the texture x into the intermediate texture.
+// Its columns are the pixels on the screen along the axis the texture x changes on, and its rows are the texel rows around the visible ones.
+// NOTE: The transform between the screen and the texture is axis-aligned, so that the 2D kernel separates into the texture x and y.
+class SeparableHorizontalPassShader : public ImageShaderBase {
+ public:
+  explicit SeparableHorizontalPassShader(int radius)
+      : _mainFuncCode(getKernelCode(radius) + MAIN_FUNC_CODE) {}
+
  protected:
-  const char* getFragmentShaderMainFuncCode() const override {
-    return R"(
-#define PI 3.1415926525
+  const char* getFragmentShaderMainFuncCode() const override { return _mainFuncCode.c_str(); }
 
-float ideal_sinc(float x) {
-  x = x + 1e-14;
-  return sin(x) / x;
-}
+ private:
+  std::string _mainFuncCode;
 
-float calc_lanczos4_weight(float x) {
-  float x_abs = abs(x);
+  inline static const char* MAIN_FUNC_CODE = R"(
+uniform int u_passAxis; // Axis on the screen the texture x changes on. 0 for x and 1 for y.
+uniform float u_passNumPixels; // Pixels on the screen along u_passAxis, which are the columns of the intermediate texture
+uniform int u_passRowBegin; // Texel row of the texture in the first row of the intermediate texture
 
-  if (x_abs < 1e-14) {
-    return 1.0;
-  } else if (x_abs <= 4.0) {
-    float y = PI * x_abs;
-    return ideal_sinc(y) * ideal_sinc(y / 4.0);
+void main() {
+  ivec2 fragCoord = ivec2(gl_FragCoord.xy);
+
+  // The texture x seen by the pixel of the column. The other axis does not change it.
+  vec2 screenCoord = vec2(0.5);
+  screenCoord[u_passAxis] = (float(fragCoord.x) + 0.5) / u_passNumPixels;
+
+  float u = toTextureCoord(screenCoord).x;
+  float v = (float(u_passRowBegin + fragCoord.y) + 0.5) / u_textureSize.y;
+
+  float center = u * u_textureSize.x - 0.5;
+  int first = int(floor(center)) - KERNEL_RADIUS + 1;
+  int last = int(u_textureSize.x) - 1;
+
+  vec4 color = vec4(0.0);
+  float weightSum = 0.0;
+  for (int i = 0; i < 2 * KERNEL_RADIUS; ++i) {
+    int x = first + i;
+    float weight = kernel_weight(center - float(x));
+    color += fetchTexel(vec2((float(clamp(x, 0, last)) + 0.5) / u_textureSize.x, v)) * weight;
+    weightSum += weight;
   }
 
-  return 0.0;
+  // NOTE: Not clamped until the second pass
+  out_color = color / weightSum;
 }
+  )";
+};
+
+// The second pass filters the columns of the intermediate texture along the texture y onto the screen
+class SeparableVerticalPassShader : public ImageShaderBase {
+ public:
+  explicit SeparableVerticalPassShader(int radius)
+      : _mainFuncCode(getKernelCode(radius) + MAIN_FUNC_CODE) {}
+
+ protected:
+  const char* getFragmentShaderMainFuncCode() const override { return _mainFuncCode.c_str(); }
+
+ private:
+  std::string _mainFuncCode;
+
+  inline static const char* MAIN_FUNC_CODE = R"(
+uniform sampler2D u_intermediate; // Texel rows filtered by the first pass
+uniform int u_passAxis;
+uniform float u_passNumPixels;
+uniform int u_passRowBegin;
+uniform int u_passNumRows; // Rows of the intermediate texture
 
 void main() {
   out_color = vec4(u_backgroundColor, 1.0);
 
   if (f_uv.x >= u_rectTopLeft.x && f_uv.x <= u_rectBottomRight.x &&
       f_uv.y >= u_rectTopLeft.y && f_uv.y <= u_rectBottomRight.y) {
-    vec2 uv = (f_uv - u_rectTopLeft) / (u_rectBottomRight - u_rectTopLeft); // Ranged in [0, 1]
-    
-    float strideX = 1.0 / float(u_textureSize.x);
-    float strideY = 1.0 / float(u_textureSize.y);
+    vec2 uv = toTextureCoord(f_uv); // Ranged in [0, 1]
+
+    int column = int(f_uv[u_passAxis] * u_passNumPixels);
+
+    float center = uv.y * u_textureSize.y - 0.5;
+    int first = int(floor(center)) - KERNEL_RADIUS + 1;
+    int last = int(u_textureSize.y) - 1;
+
+    vec4 color = vec4(0.0);
+    float weightSum = 0.0;
+    for (int i = 0; i < 2 * KERNEL_RADIUS; ++i) {
+      int y = first + i;
+      int row = clamp(clamp(y, 0, last) - u_passRowBegin, 0, u_passNumRows - 1);
+      float weight = kernel_weight(center - float(y));
+      color += texelFetch(u_intermediate, ivec2(column, row), 0) * weight;
+      weightSum += weight;
+    }
 
-    // Calc the pixel index of nearest Left-top pixel
-    int pixelIdxX = int((uv.x - strideX / 2.0) / strideX);
-    int pixelIdxY = int((uv.y - strideY / 2.0) / strideY);
-
-    // Calc the pixel coordinates (8 pixels per axis)
-    float pixelX3 = float(pixelIdxX) * strideX + strideX / 2.0;
-    float pixelX2 = pixelX3 - strideX;
-    float pixelX1 = pixelX2 - strideX;
-    float pixelX0 = pixelX1 - strideX;
-    float pixelX4 = pixelX3 + strideX;
-    float pixelX5 = pixelX4 + strideX;
-    float pixelX6 = pixelX5 + strideX;
-    float pixelX7 = pixelX6 + strideX;
-    float pixelY3 = float(pixelIdxY) * strideY + strideY / 2.0;
-    float pixelY2 = pixelY3 - strideY;
-    float pixelY1 = pixelY2 - strideY;
-    float pixelY0 = pixelY1 - strideY;
-    float pixelY4 = pixelY3 + strideY;
-    float pixelY5 = pixelY4 + strideY;
-    float pixelY6 = pixelY5 + strideY;
-    float pixelY7 = pixelY6 + strideY;
-
-    // Calc distance
-    float distX0 = uv.x - pixelX0;
-    float distX1 = uv.x - pixelX1;
-    float distX2 = uv.x - pixelX2;
-    float distX3 = uv.x - pixelX3;
-    float distX4 = pixelX4 - uv.x;
-    float distX5 = pixelX5 - uv.x;
-    float distX6 = pixelX6 - uv.x;
-    float distX7 = pixelX7 - uv.x;
-
-    float distY0 = uv.y - pixelY0;
-    float distY1 = uv.y - pixelY1;
-    float distY2 = uv.y - pixelY2;
-    float distY3 = uv.y - pixelY3;
-    float distY4 = pixelY4 - uv.y;
-    float distY5 = pixelY5 - uv.y;
-    float distY6 = pixelY6 - uv.y;
-    float distY7 = pixelY7 - uv.y;
+    color /= weightSum;
 
-    // Calc weights
-    float weightX0 = calc_lanczos4_weight(distX0 / strideX);
-    float weightX1 = calc_lanczos4_weight(distX1 / strideX);
-    float weightX2 = calc_lanczos4_weight(distX2 / strideX);
-    float weightX3 = calc_lanczos4_weight(distX3 / strideX);
-    float weightX4 = calc_lanczos4_weight(distX4 / strideX);
-    float weightX5 = calc_lanczos4_weight(distX5 / strideX);
-    float weightX6 = calc_lanczos4_weight(distX6 / strideX);
-    float weightX7 = calc_lanczos4_weight(distX7 / strideX);
-
-    float weightY0 = calc_lanczos4_weight(distY0 / strideY);
-    float weightY1 = calc_lanczos4_weight(distY1 / strideY);
-    float weightY2 = calc_lanczos4_weight(distY2 / strideY);
-    float weightY3 = calc_lanczos4_weight(distY3 / strideY);
-    float weightY4 = calc_lanczos4_weight(distY4 / strideY);
-    float weightY5 = calc_lanczos4_weight(distY5 / strideY);
-    float weightY6 = calc_lanczos4_weight(distY6 / strideY);
-    float weightY7 = calc_lanczos4_weight(distY7 / strideY);
-
-    // Calc valid pixel coordinates
-    float x0 = max(0.0, min(1.0, pixelX0));
-    float x1 = max(0.0, min(1.0, pixelX1));
-    float x2 = max(0.0, min(1.0, pixelX2));
-    float x3 = max(0.0, min(1.0, pixelX3));
-    float x4 = max(0.0, min(1.0, pixelX4));
-    float x5 = max(0.0, min(1.0, pixelX5));
-    float x6 = max(0.0, min(1.0, pixelX6));
-    float x7 = max(0.0, min(1.0, pixelX7));
-
-    float y0 = max(0.0, min(1.0, pixelY0));
-    float y1 = max(0.0, min(1.0, pixelY1));
-    float y2 = max(0.0, min(1.0, pixelY2));
-    float y3 = max(0.0, min(1.0, pixelY3));
-    float y4 = max(0.0, min(1.0, pixelY4));
-    float y5 = max(0.0, min(1.0, pixelY5));
-    float y6 = max(0.0, min(1.0, pixelY6));
-    float y7 = max(0.0, min(1.0, pixelY7));
-
-    // Calc color * weightX, ridiculously long
-    vec4 tmpColor0 = texture(u_texture, vec2(x0, y0)) * weightX0 + texture(u_texture, vec2(x1, y0)) * weightX1 + texture(u_texture, vec2(x2, y0)) * weightX2 + texture(u_texture, vec2(x3, y0)) * weightX3 + texture(u_texture, vec2(x4, y0)) * weightX4 + texture(u_texture, vec2(x5, y0)) * weightX5 + texture(u_texture, vec2(x6, y0)) * weightX6 + texture(u_texture, vec2(x7, y0)) * weightX7;
-    vec4 tmpColor1 = texture(u_texture, vec2(x0, y1)) * weightX0 + texture(u_texture, vec2(x1, y1)) * weightX1 + texture(u_texture, vec2(x2, y1)) * weightX2 + texture(u_texture, vec2(x3, y1)) * weightX3 + texture(u_texture, vec2(x4, y1)) * weightX4 + texture(u_texture, vec2(x5, y1)) * weightX5 + texture(u_texture, vec2(x6, y1)) * weightX6 + texture(u_texture, vec2(x7, y1)) * weightX7;
-    vec4 tmpColor2 = texture(u_texture, vec2(x0, y2)) * weightX0 + texture(u_texture, vec2(x1, y2)) * weightX1 + texture(u_texture, vec2(x2, y2)) * weightX2 + texture(u_texture, vec2(x3, y2)) * weightX3 + texture(u_texture, vec2(x4, y2)) * weightX4 + texture(u_texture, vec2(x5, y2)) * weightX5 + texture(u_texture, vec2(x6, y2)) * weightX6 + texture(u_texture, vec2(x7, y2)) * weightX7;
-    vec4 tmpColor3 = texture(u_texture, vec2(x0, y3)) * weightX0 + texture(u_texture, vec2(x1, y3)) * weightX1 + texture(u_texture, vec2(x2, y3)) * weightX2 + texture(u_texture, vec2(x3, y3)) * weightX3 + texture(u_texture, vec2(x4, y3)) * weightX4 + texture(u_texture, vec2(x5, y3)) * weightX5 + texture(u_texture, vec2(x6, y3)) * weightX6 + texture(u_texture, vec2(x7, y3)) * weightX7;
-    vec4 tmpColor4 = texture(u_texture, vec2(x0, y4)) * weightX0 + texture(u_texture, vec2(x1, y4)) * weightX1 + texture(u_texture, vec2(x2, y4)) * weightX2 + texture(u_texture, vec2(x3, y4)) * weightX3 + texture(u_texture, vec2(x4, y4)) * weightX4 + texture(u_texture, vec2(x5, y4)) * weightX5 + texture(u_texture, vec2(x6, y4)) * weightX6 + texture(u_texture, vec2(x7, y4)) * weightX7;
-    vec4 tmpColor5 = texture(u_texture, vec2(x0, y5)) * weightX0 + texture(u_texture, vec2(x1, y5)) * weightX1 + texture(u_texture, vec2(x2, y5)) * weightX2 + texture(u_texture, vec2(x3, y5)) * weightX3 + texture(u_texture, vec2(x4, y5)) * weightX4 + texture(u_texture, vec2(x5, y5)) * weightX5 + texture(u_texture, vec2(x6, y5)) * weightX6 + texture(u_texture, vec2(x7, y5)) * weightX7;
-    vec4 tmpColor6 = texture(u_texture, vec2(x0, y6)) * weightX0 + texture(u_texture, vec2(x1, y6)) * weightX1 + texture(u_texture, vec2(x2, y6)) * weightX2 + texture(u_texture, vec2(x3, y6)) * weightX3 + texture(u_texture, vec2(x4, y6)) * weightX4 + texture(u_texture, vec2(x5, y6)) * weightX5 + texture(u_texture, vec2(x6, y6)) * weightX6 + texture(u_texture, vec2(x7, y6)) * weightX7;
-    vec4 tmpColor7 = texture(u_texture, vec2(x0, y7)) * weightX0 + texture(u_texture, vec2(x1, y7)) * weightX1 + texture(u_texture, vec2(x2, y7)) * weightX2 + texture(u_texture, vec2(x3, y7)) * weightX3 + texture(u_texture, vec2(x4, y7)) * weightX4 + texture(u_texture, vec2(x5, y7)) * weightX5 + texture(u_texture, vec2(x6, y7)) * weightX6 + texture(u_texture, vec2(x7, y7)) * weightX7;
-
-    // Calc weightY * color
-    out_color = tmpColor0 * weightY0 +
-                tmpColor1 * weightY1 +
-                tmpColor2 * weightY2 +
-                tmpColor3 * weightY3 +
-                tmpColor4 * weightY4 +
-                tmpColor5 * weightY5 +
-                tmpColor6 * weightY6 +
-                tmpColor7 * weightY7;
-
-    // Clamp the color values to [0, 1]
-    out_color.r = clamp(out_color.r, 0.0, 1.0);
-    out_color.g = clamp(out_color.g, 0.0, 1.0);
-    out_color.b = clamp(out_color.b, 0.0, 1.0);
-    out_color.a = 1.0;
+    out_color = vec4(clamp(color.rgb, 0.0, 1.0), 1.0);
   }
 }
   )";
-  }
 };
 
 // ###########################################################################################################################################
@@ -434,13 +420,21 @@ void main() {
 inline static const std::vector<std::string> IMAGE_SHADER_TYPE_NAMES = {"Nearest",
                                                                         "Bilinear",
                                                                         "Bicubic",
-                                                                        "Lanczos4"};
+                                                                        "Lanczos4",
+                                                                        "Lanczos2",
+                                                                        "Lanczos3",
+                                                                        "Mitchell",
+                                                                        "Gaussian"};
 
 enum class ImageShaderType {
   NEAREST,
   BILINEAR,
-  BICUBIC,
-  LANCZOS4
+  BICUBIC,  // Catmull-Rom, which is the cubic convolution with a = -0.5
+  LANCZOS4,
+  LANCZOS2,
+  LANCZOS3,
+  MITCHELL,  // Mitchell-Netravali with B = C = 1/3
+  GAUSSIAN
 };
 
 inline static std::string imageShaderTypeToString(ImageShaderType type) {
@@ -455,6 +449,60 @@ inline static ImageShaderType stringToImageShaderType(const std::string& type) {
   throw std::invalid_argument("Invalid image shader type: " + type);
 }
 
+// ###########################################################################################################################################
+// Resampling kernels
+// ###########################################################################################################################################
+
+// Kernel of the filters drawn with the weights looked up in a texture
+struct ResamplingKernel {
+  int radius;                            // Texels read on each side, which makes 2 * radius taps per axis. At most Common::TILE_FILTER_MARGIN.
+  std::function<double(double)> weight;  // Weight of the texel at the distance x in [0, radius] texels
+};
+
+// Mitchell-Netravali family of the cubic filters
+inline static double cubicKernelWeight(double x, double b, double c) {
+  if (x < 1.0) {
+    return ((12.0 - 9.0 * b - 6.0 * c) * x * x * x + (-18.0 + 12.0 * b + 6.0 * c) * x * x + (6.0 - 2.0 * b)) / 6.0;
+  } else if (x < 2.0) {
+    return ((-b - 6.0 * c) * x * x * x + (6.0 * b + 30.0 * c) * x * x + (-12.0 * b - 48.0 * c) * x + (8.0 * b + 24.0 * c)) / 6.0;
+  }
+  return 0.0;
+}
+
+inline static double lanczosKernelWeight(double x, int a) {
+  if (x < 1e-8) {
+    return 1.0;
+  } else if (x < a) {
+    const double y = std::numbers::pi * x;
+    return a * std::sin(y) * std::sin(y / a) / (y * y);
+  }
+  return 0.0;
+}
+
+// True if the filter is drawn with a resampling kernel, in two passes of 1D kernels
+inline static bool isSeparableShaderType(ImageShaderType type) {
+  return type != ImageShaderType::NEAREST && type != ImageShaderType::BILINEAR;
+}
+
+inline static ResamplingKernel getResamplingKernel(ImageShaderType type) {
+  switch (type) {
+    case ImageShaderType::BICUBIC:
+      return {2, [](double x) { return cubicKernelWeight(x, 0.0, 0.5); }};
+    case ImageShaderType::MITCHELL:
+      return {2, [](double x) { return cubicKernelWeight(x, 1.0 / 3.0, 1.0 / 3.0); }};
+    case ImageShaderType::LANCZOS2:
+      return {2, [](double x) { return lanczosKernelWeight(x, 2); }};
+    case ImageShaderType::LANCZOS3:
+      return {3, [](double x) { return lanczosKernelWeight(x, 3); }};
+    case ImageShaderType::LANCZOS4:
+      return {4, [](double x) { return lanczosKernelWeight(x, 4); }};
+    case ImageShaderType::GAUSSIAN:
+      return {2, [](double x) { return std::exp(-x * x / (2.0 * 0.5 * 0.5)); }};  // sigma = 0.5 texels
+    default:
+      throw std::invalid_argument("Image shader type has no resampling kernel");
+  }
+}
+
 inline static std::pair<QString, QString> getShaderCode(ImageShaderType type) {
   std::shared_ptr<ImageShaderBase> shader;
 
@@ -465,14 +513,23 @@ inline static std::pair<QString, QString> getShaderCode(ImageShaderType type) {
     case ImageShaderType::BILINEAR:
       shader = std::make_shared<BilinearImageShader>();
       break;
-    case ImageShaderType::BICUBIC:
-      shader = std::make_shared<BicubicImageShader>();
-      break;
-    case ImageShaderType::LANCZOS4:
-      shader = std::make_shared<Lanczos4ImageShader>();
-      break;
     default:
-      throw std::invalid_argument("Invalid image shader type");
+      shader = std::make_shared<KernelImageShader>(getResamplingKernel(type).radius);
+      break;
+  }
+
+  return {shader->getVertexShaderCode(), shader->getFragmentShaderCode()};
+}
+
+// Code of the first (0) or the second (1) pass of the separable filter
+inline static std::pair<QString, QString> getSeparablePassShaderCode(ImageShaderType type, int pass) {
+  const int radius = getResamplingKernel(type).radius;
+
+  std::shared_ptr<ImageShaderBase> shader;
+  if (pass == 0) {
+    shader = std::make_shared<SeparableHorizontalPassShader>(radius);
+  } else {
+    shader = std::make_shared<SeparableVerticalPassShader>(radius);
   }
 
   return {shader->getVertexShaderCode(), shader->getFragmentShaderCode()};
@@ -485,11 +542,18 @@ inline static std::pair<QString, QString> getShaderCode(ImageShaderType type) {
 class ImageShader {
  private:
   std::map<ImageShaderType, std::shared_ptr<QOpenGLShaderProgram>> _shaderPrograms;
+  std::map<ImageShaderType, std::array<std::shared_ptr<QOpenGLShaderProgram>, 2>> _separablePassPrograms;
+  std::map<ImageShaderType, std::shared_ptr<QOpenGLTexture>> _kernelLuts;
+
+  static std::shared_ptr<QOpenGLShaderProgram> buildShaderProgram(const QString& vertexShaderCode, const QString& fragmentShaderCode);
+  static std::shared_ptr<QOpenGLTexture> buildKernelLut(const ResamplingKernel& kernel);
 
  public:
   ImageShader();
   ~ImageShader();
 
   std::shared_ptr<QOpenGLShaderProgram> getShaderProgram(ImageShaderType type) const;
+  std::shared_ptr<QOpenGLShaderProgram> getSeparablePassProgram(ImageShaderType type, int pass) const;  // The first (0) or the second (1) pass
+  std::shared_ptr<QOpenGLTexture> getKernelLut(ImageShaderType type) const;                            // Weights of the kernel of the filter, or nullptr
   std::map<ImageShaderType, std::shared_ptr<QOpenGLShaderProgram>> getShaderPrograms() const { return _shaderPrograms; }
 };
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <image.h>
+
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLTexture>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <thread>
+
+// ###########################################################################################################################################
+// TextureCache
+// ###########################################################################################################################################
+
+// Texture of an image uploaded by the cache. The texture is not reused while referred to.
+struct CachedTexture {
+  GLuint id = 0;
+  cv::Size size;
+  QOpenGLTexture::TextureFormat textureFormat = QOpenGLTexture::NoFormat;
+  size_t sizeInBytes = 0;
+};
+
+using CachedTexture_t = std::shared_ptr<const CachedTexture>;
+
+// Textures of the prefetched images uploaded ahead by a thread with its own OpenGL context shared with the view,
+// so that switching to a prefetched image only binds its texture.
+// The textures are bounded by Common::TEXTURE_CACHE_CAPACITY_BYTES, and the least recently used ones are evicted.
+// An evicted texture is reused for the next image of the same size and format instead of being reallocated.
+// NOTE: prefetch() may be called from any thread. The other methods are called from the GUI thread.
+class TextureCache {
+ public:
+  TextureCache();
+  ~TextureCache();
+
+  // Start the upload thread sharing the textures with the context. Nothing is uploaded if the platform cannot use OpenGL from the threads.
+  void start(QOpenGLContext* shareContext, int maxTextureSize);
+
+  // Queue the upload of the full image. The images already uploaded and the ones too large for the cache are ignored.
+  void prefetch(const ImageData& imageData, QOpenGLTexture::TextureFormat textureFormat, QOpenGLTexture::PixelFormat pixelFormat, QOpenGLTexture::PixelType pixelType);
+
+  // The texture of exactly this decode of the image if uploaded, which is marked as the most recently used
+  CachedTexture_t acquire(const ImageData& imageData);
+
+ private:
+  struct Entry {
+    fs::path path;
+    uint64_t generation;  // Identifies the decode the texture was uploaded from. The pixels of a reloaded image may reuse the address of the previous ones.
+    std::shared_ptr<CachedTexture> texture;
+  };
+
+  struct PendingUpload {
+    ImageData imageData;
+    QOpenGLTexture::TextureFormat textureFormat;
+    QOpenGLTexture::PixelFormat pixelFormat;
+    QOpenGLTexture::PixelType pixelType;
+  };
+
+  std::unique_ptr<QOffscreenSurface> _surface;
+  QOpenGLContext* _shareContext;
+  int _maxTextureSize;
+
+  std::mutex _mutex;
+  std::condition_variable _condition;
+  std::deque<PendingUpload> _pendingUploads;  // The latest comes last
+  std::list<Entry> _entries;                  // The most recently used entry comes first
+  size_t _sizeInBytes;
+  bool _isRunning;
+  std::thread _thread;
+
+  void run();
+  void upload(QOpenGLExtraFunctions* functions, const PendingUpload& pendingUpload);
+  std::shared_ptr<CachedTexture> takeTexture(QOpenGLExtraFunctions* functions, const cv::Size& size, QOpenGLTexture::TextureFormat textureFormat, size_t sizeInBytes);
+  bool contains(const ImageData& imageData) const;
+
+  static size_t getTextureSizeInBytes(const cv::Mat& image);
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLTexture>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// ###########################################################################################################################################
+// TextureUploader
+// ###########################################################################################################################################
+
+// Streams an image into a texture in bands of rows through a ring of pixel buffer objects, so that the GUI thread never waits for the whole upload.
+// Each band is copied into a mapped buffer, and glTexSubImage2D() reads it from the buffer while the GPU is free to.
+// A fence per buffer tells when the GPU has consumed it, and a buffer still being read is left for the next frame instead of waiting.
+// The rows are copied with their stride as is, and GL_UNPACK_ROW_LENGTH skips the padding. The mip levels follow the image in the same way.
+// NOTE: All the methods except the constructor must be called with the OpenGL context current.
+class TextureUploader {
+ public:
+  TextureUploader();
+  ~TextureUploader();
+
+  // Start uploading the image and its mip levels 1 onward, if any, to the storage of the texture allocated for its size and format.
+  // The previous upload is abandoned. The images are kept referred to until the upload is finished.
+  void start(QOpenGLTexture* texture, const cv::Mat& image, const std::vector<cv::Mat>& mipLevels, QOpenGLTexture::PixelFormat pixelFormat, QOpenGLTexture::PixelType pixelType);
+  void cancel();
+
+  // Issue the bands the free buffers take within Common::TEXTURE_UPLOAD_BUDGET_MS.
+  // Returns true once all the bands are issued. The commands issued later see the whole image.
+  bool update();
+  bool isUploading() const;
+
+  void destroy();  // Release the buffers
+
+ private:
+  struct Buffer {
+    GLuint id = 0;
+    GLsync fence = nullptr;  // Set while the GPU may still read the buffer
+  };
+
+  QOpenGLTexture* _texture;
+  std::vector<cv::Mat> _levels;  // The image followed by its mip levels
+  int _level;                    // Level being uploaded
+  QOpenGLTexture::PixelFormat _pixelFormat;
+  QOpenGLTexture::PixelType _pixelType;
+
+  std::vector<Buffer> _buffers;
+  size_t _bufferSize;
+  int _nextBuffer;
+  int _nextRow;
+  int _bandRows;
+
+  void allocateBuffers(QOpenGLExtraFunctions* functions, size_t bufferSize);
+  void uploadBand(QOpenGLExtraFunctions* functions, Buffer& buffer);
+  void startLevel(int level);
+};
@@ -0,0 +1,371 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// ###########################################################################################################################################
+// CancellationToken
+// ###########################################################################################################################################
+
+class CancellationToken {
+ public:
+  CancellationToken();
+  ~CancellationToken();
+
+  void cancel();
+  bool isCancelled() const;
+
+ private:
+  std::atomic<bool> _isCancelled;
+};
+
+using CancellationToken_t = std::shared_ptr<CancellationToken>;
+
+// ###########################################################################################################################################
+// Task
+// ###########################################################################################################################################
+
+// Move-only callable. Callables that fit in the internal buffer are stored without heap allocation.
+class Task {
+ public:
+  static inline constexpr size_t BUFFER_SIZE = 64;
+
+  Task() noexcept : _buffer(), _ops(nullptr) {}
+
+  template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>>>
+  Task(F&& func) : _buffer(), _ops(nullptr) {
+    using Callable = std::decay_t<F>;
+
+    if constexpr (isStoredInBuffer<Callable>()) {
+      new (_buffer) Callable(std::forward<F>(func));
+      _ops = &BUFFER_OPS<Callable>;
+    } else {
+      new (_buffer) Callable*(new Callable(std::forward<F>(func)));
+      _ops = &HEAP_OPS<Callable>;
+    }
+  }
+
+  Task(Task&& other) noexcept : _buffer(), _ops(other._ops) {
+    if (_ops != nullptr) {
+      _ops->move(_buffer, other._buffer);
+      other.reset();
+    }
+  }
+
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      reset();
+
+      if (other._ops != nullptr) {
+        _ops = other._ops;
+        _ops->move(_buffer, other._buffer);
+        other.reset();
+      }
+    }
+    return *this;
+  }
+
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+
+  ~Task() { reset(); }
+
+  void operator()() { _ops->invoke(_buffer); }
+  explicit operator bool() const { return _ops != nullptr; }
+
+ private:
+  struct Ops {
+    void (*invoke)(void* buffer);
+    void (*move)(void* dst, void* src);  // Move-construct into dst. src is destroyed afterwards by destroy().
+    void (*destroy)(void* buffer);
+  };
+
+  template <typename Callable>
+  static constexpr bool isStoredInBuffer() {
+    return sizeof(Callable) <= BUFFER_SIZE &&
+           alignof(Callable) <= alignof(std::max_align_t) &&
+           std::is_nothrow_move_constructible_v<Callable>;
+  }
+
+  // clang-format off
+  template <typename Callable>
+  inline static constexpr Ops BUFFER_OPS = {
+      [](void* buffer) { (*static_cast<Callable*>(buffer))(); },
+      [](void* dst, void* src) { new (dst) Callable(std::move(*static_cast<Callable*>(src))); },
+      [](void* buffer) { static_cast<Callable*>(buffer)->~Callable(); },
+  };
+
+  template <typename Callable>
+  inline static constexpr Ops HEAP_OPS = {
+      [](void* buffer) { (**static_cast<Callable**>(buffer))(); },
+      [](void* dst, void* src) { new (dst) Callable*(*static_cast<Callable**>(src)); *static_cast<Callable**>(src) = nullptr; },
+      [](void* buffer) { delete *static_cast<Callable**>(buffer); },
+  };
+  // clang-format on
+
+  alignas(std::max_align_t) unsigned char _buffer[BUFFER_SIZE];
+  const Ops* _ops;
+
+  void reset() {
+    if (_ops != nullptr) {
+      _ops->destroy(_buffer);
+      _ops = nullptr;
+    }
+  }
+};
+
+// ###########################################################################################################################################
+// WorkStealingDeque
+// ###########################################################################################################################################
+
+// Fixed-capacity Chase-Lev deque. The owner thread pushes and pops at the bottom, and the other threads steal from the top without locks.
+// https://www.di.ens.fr/~zappa/readings/ppopp13.pdf
+class WorkStealingDeque {
+ public:
+  static inline constexpr int64_t CAPACITY = 1024;  // Must be a power of two
+
+  WorkStealingDeque();
+  ~WorkStealingDeque();
+
+  bool push(Task&& task);  // Owner only. Returns false if the deque is full.
+  bool pop(Task& task);    // Owner only
+  bool steal(Task& task);  // Any thread
+
+ private:
+  struct Slot {
+    Task task;
+    std::atomic<bool> isOccupied{false};  // True until the task is moved out, so that the owner does not overwrite it
+  };
+
+  alignas(64) std::atomic<int64_t> _top;
+  alignas(64) std::atomic<int64_t> _bottom;
+  std::unique_ptr<Slot[]> _slots;
+};
+
+// ###########################################################################################################################################
+// ThreadPool
+// ###########################################################################################################################################
+
+class ThreadPool {
+  // https://contentsviewer.work/Master/software/cpp/how-to-implement-a-thread-pool/article
+
+ public:
+  // Tasks of this priority and above go to the queue shared by all the workers, which they check before their own queues.
+  // The other tasks are spread over the injection queues of the workers, so that the submissions do not contend for a single lock.
+  static inline constexpr int URGENT_PRIORITY = std::numeric_limits<int>::max() - 1;
+
+  ThreadPool(int numThreads);
+  ~ThreadPool();
+
+  // Run the queued tasks and join the workers. Afterwards, only the tasks still running may queue more, and the others throw.
+  // Called by the destructor. Call it earlier if the running tasks use objects that are destroyed before the last owner of the pool.
+  // NOTE: Must be called from outside the pool, since a worker cannot join itself.
+  void shutdown();
+  bool isRunning() const;
+
+  // Tasks with a higher priority run first. Tasks of the same priority in the same queue run in the order of submission.
+  // A queued task is dropped without running once its token is cancelled.
+  template <typename F>
+  auto submit(F&& func, int priority = 0, CancellationToken_t token = nullptr) -> std::future<std::invoke_result_t<F>>;
+
+  // Same as submit() without a future. No heap allocation is made if the callable fits in Task::BUFFER_SIZE.
+  template <typename F>
+  void post(F&& func, int priority = 0, CancellationToken_t token = nullptr);
+
+  // Push a subtask to the deque of the calling worker, which idle workers steal from.
+  // Falls back to post() if called from outside the pool.
+  template <typename F>
+  void spawn(F&& func, int priority = 0);
+
+  // Run func(chunkBegin, chunkEnd) over [begin, end) split into chunks of grainSize across the workers.
+  // The calling thread also runs the chunks, and returns when all of them are done.
+  // The helpers are queued at the priority, so that the other workers join only once the tasks of higher priorities are taken.
+  template <typename F>
+  void parallelFor(int begin, int end, int grainSize, F&& func, int priority = 0);
+
+  // Change the priority of the queued tasks associated with the token. Returns false if none is queued.
+  bool setPriority(const CancellationToken_t& token, int priority);
+
+  // Change the number of tasks running at the same time. Threads beyond it stay idle.
+  void setNumThreads(int numThreads);
+  int getNumThreads() const;
+  int getMaxNumThreads() const;
+
+  bool isWorkerThread() const;
+  int getWorkerIndex() const;  // Index of the calling worker, or -1 if called from outside the pool
+
+  // Priority of the task running on the calling thread, or 0 outside the pools and in the subtasks from spawn()
+  static int getCurrentPriority();
+
+ private:
+  struct QueuedTask {
+    Task task;
+    CancellationToken_t token;
+  };
+
+  // The heap is ordered on the keys only, so that reordering it does not move the tasks
+  struct TaskKey {
+    int priority = 0;
+    uint64_t sequence = 0;
+    size_t slot = 0;  // Index of the task in TaskQueue::slots
+  };
+
+  struct TaskCompare {
+    // Returns true if a runs later than b
+    bool operator()(const TaskKey& a, const TaskKey& b) const {
+      return a.priority != b.priority ? a.priority < b.priority : a.sequence > b.sequence;
+    }
+  };
+
+  // Priority queue under its own lock
+  struct alignas(64) TaskQueue {
+    static inline constexpr int64_t EMPTY = std::numeric_limits<int64_t>::min();
+
+    std::mutex mutex;
+    std::vector<TaskKey> keys;    // Binary heap ordered by TaskCompare
+    std::deque<QueuedTask> slots;  // Never moved when it grows
+    std::vector<size_t> freeSlots;
+    std::atomic<int64_t> topPriority{EMPTY};  // Priority of the next task, read without the lock to choose the queue to pop from
+  };
+
+  struct ParallelForState {
+    std::atomic<int> nextChunk{0};
+    std::atomic<int> numDoneChunks{0};
+    std::atomic<bool> hasException{false};
+    std::exception_ptr exception;  // The first exception thrown by func
+  };
+
+  std::vector<std::thread> _workers;
+  std::vector<std::unique_ptr<WorkStealingDeque>> _localTasks;  // One per worker
+
+  TaskQueue _sharedTasks;                                  // Tasks of URGENT_PRIORITY and above
+  std::vector<std::unique_ptr<TaskQueue>> _injectedTasks;  // One per worker. The other tasks submitted with post() and submit().
+  std::atomic<uint64_t> _nextSequence;
+  std::atomic<uint32_t> _nextInjectedQueue;  // Round robin of the submissions from outside the pool
+
+  mutable std::mutex _taskMutex;  // Guards the sleeping and parked workers
+  std::atomic<bool> _isRunning;
+  std::condition_variable _condition;      // Active workers wait for tasks
+  std::condition_variable _parkCondition;  // Surplus workers wait for setNumThreads()
+
+  std::atomic<int> _maxNumActiveWorkers;
+  std::atomic<int64_t> _numPendingTasks;  // Tasks in all the queues and all the deques
+  std::atomic<int> _numSleepingWorkers;
+
+  inline static thread_local ThreadPool* _currentPool = nullptr;
+  inline static thread_local int _currentWorkerIndex = -1;
+  inline static thread_local int _currentPriority = 0;
+
+  void pushTask(Task&& task, int priority, CancellationToken_t token);
+  bool tryPushTask(Task&& task, int priority, CancellationToken_t token);  // Returns false once shut down
+  void pushLocalTask(Task&& task);
+  bool popTask(int workerIndex, Task& task, int& priority);
+  bool popInjectedTask(int workerIndex, Task& task, int& priority);
+  void pushQueuedTask(TaskQueue& queue, QueuedTask&& task, int priority, uint64_t sequence);
+  bool popQueuedTask(TaskQueue& queue, Task& task, int& priority);
+  bool stealTask(int workerIndex, Task& task);
+  void notifyWorker();
+  void worker(int workerIndex);
+};
+
+using ThreadPool_t = std::shared_ptr<ThreadPool>;
+
+// ###########################################################################################################################################
+// ThreadPool (template implementation)
+// ###########################################################################################################################################
+
+template <typename F>
+auto ThreadPool::submit(F&& func, int priority, CancellationToken_t token) -> std::future<std::invoke_result_t<F>> {
+  using R = std::invoke_result_t<F>;
+
+  // NOTE: packaged_task is move-only, which Task can hold as is
+  std::packaged_task<R()> task(std::forward<F>(func));
+  auto future = task.get_future();
+
+  pushTask(Task(std::move(task)), priority, std::move(token));
+
+  return future;
+}
+
+template <typename F>
+void ThreadPool::post(F&& func, int priority, CancellationToken_t token) {
+  pushTask(Task(std::forward<F>(func)), priority, std::move(token));
+}
+
+template <typename F>
+void ThreadPool::spawn(F&& func, int priority) {
+  if (isWorkerThread()) {
+    pushLocalTask(Task(std::forward<F>(func)));
+  } else {
+    post(std::forward<F>(func), priority);
+  }
+}
+
+template <typename F>
+void ThreadPool::parallelFor(int begin, int end, int grainSize, F&& func, int priority) {
+  if (begin >= end) {
+    return;
+  }
+
+  grainSize = std::max(grainSize, 1);
+  const int numChunks = (end - begin + grainSize - 1) / grainSize;
+
+  // The state is shared with the helpers, since a helper may start after this function returns.
+  // Such a helper finds no chunk left and never touches func.
+  const auto state = std::make_shared<ParallelForState>();
+  const auto* funcPtr = &func;
+
+  const auto runChunks = [state, funcPtr, begin, end, grainSize, numChunks]() {
+    for (int chunk = state->nextChunk.fetch_add(1); chunk < numChunks; chunk = state->nextChunk.fetch_add(1)) {
+      const int chunkBegin = begin + chunk * grainSize;
+      const int chunkEnd = std::min(chunkBegin + grainSize, end);
+
+      try {
+        (*funcPtr)(chunkBegin, chunkEnd);
+      } catch (...) {
+        if (!state->hasException.exchange(true)) {
+          state->exception = std::current_exception();
+        }
+      }
+
+      // NOTE: A chunk counts as done even if it throws, so that the caller does not return while a helper is still using func
+      if (state->numDoneChunks.fetch_add(1) + 1 == numChunks) {
+        state->numDoneChunks.notify_all();
+      }
+    }
+  };
+
+  // Helpers for the other workers. The calling thread takes one share of the work.
+  // NOTE: The helpers are queued with post() rather than to the deque of the worker, which is stolen from only after the queues are empty.
+  const int numHelpers = std::min(numChunks, getNumThreads() + (isWorkerThread() ? 0 : 1)) - 1;
+  for (int i = 0; i < numHelpers; ++i) {
+    if (!tryPushTask(Task(runChunks), priority, nullptr)) {
+      break;  // Shut down. The calling thread runs the chunks by itself.
+    }
+  }
+
+  runChunks();
+
+  // Wait for the chunks taken by the helpers
+  for (int numDone = state->numDoneChunks.load(); numDone < numChunks; numDone = state->numDoneChunks.load()) {
+    state->numDoneChunks.wait(numDone);
+  }
+
+  if (state->exception) {
+    std::rethrow_exception(state->exception);
+  }
+}
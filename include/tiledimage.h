@@ -0,0 +1,132 @@
+#pragma once
+
+#include <fileutil.h>
+#include <threadpool.h>
+
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+#if defined(RVIEW_USE_LIBTIFF)
+#include <tiffio.h>
+#endif
+
+// ###########################################################################################################################################
+// TiledImage
+// ###########################################################################################################################################
+
+// Image read by region at multiple resolutions, for the images too large to decode or to upload at once.
+// The level 0 is the full resolution, and the following levels are coarser down to a single tile.
+class TiledImage : public std::enable_shared_from_this<TiledImage> {
+ public:
+  TiledImage(const ThreadPool_t& threadPool);
+  virtual ~TiledImage();
+
+  virtual int getNumLevels() const = 0;
+  virtual cv::Size getLevelSize(int level) const = 0;
+
+  // Read the region at the level. The depth and the channels are the same as the image.
+  // NOTE: This method is thread-safe.
+  virtual cv::Mat readRegion(int level, const cv::Rect& region) = 0;
+
+  // Read the region on the thread pool, or right away without the thread pool. A queued read is dropped once the token is cancelled.
+  std::future<cv::Mat> readRegionAsync(int level, const cv::Rect& region, const CancellationToken_t& token);
+
+ protected:
+  // Same as the requested image in AsyncImageLoader, since the tiles of the image on the screen are waited for
+  inline static const int PRIORITY_TILE = ThreadPool::URGENT_PRIORITY;
+
+  ThreadPool_t _threadPool;
+
+  static int countLevels(const cv::Size& size);                    // Number of the levels halving the size down to a single tile
+  static cv::Size getHalvedSize(const cv::Size& size, int count);  // Size halved the number of times, rounded up
+};
+
+using TiledImage_t = std::shared_ptr<TiledImage>;
+
+// ###########################################################################################################################################
+// MemoryTiledImage
+// ###########################################################################################################################################
+
+// Image in memory. Each level halves the previous one, and is built when first read.
+class MemoryTiledImage : public TiledImage {
+ public:
+  MemoryTiledImage(const cv::Mat& image, const ThreadPool_t& threadPool);  // The pixels are shared with the image, not copied
+  ~MemoryTiledImage();
+
+  int getNumLevels() const override;
+  cv::Size getLevelSize(int level) const override;
+  cv::Mat readRegion(int level, const cv::Rect& region) override;
+
+ private:
+  std::mutex _levelMutex;
+  std::vector<cv::Mat> _levels;  // The level 0 is the image itself
+  int _numLevels;
+};
+
+#if defined(RVIEW_USE_LIBTIFF)
+
+// ###########################################################################################################################################
+// TiffTiledImage
+// ###########################################################################################################################################
+
+// Tiled TIFF and BigTIFF read tile by tile with libtiff.
+// The pyramid is made of the reduced-resolution images following the full one, or of its SubIFDs as in OME-TIFF.
+// The levels coarser than the ones in the file are downscaled in memory from the coarsest one.
+class TiffTiledImage : public TiledImage {
+ public:
+  ~TiffTiledImage();
+
+  // Returns nullptr if the file is not a tiled TIFF with a pyramid this class can read
+  static std::shared_ptr<TiffTiledImage> open(const fs::path& filePath, const ThreadPool_t& threadPool);
+
+  int getNumLevels() const override;
+  cv::Size getLevelSize(int level) const override;
+  cv::Mat readRegion(int level, const cv::Rect& region) override;
+
+  int getType() const;         // OpenCV type of the pixels
+  bool isRGB() const;          // True if the channels are in RGB(A) order, or false for grayscale
+  int getOrientation() const;  // EXIF orientation (1-8) from the TIFF tag
+
+ private:
+  struct Level {
+    tdir_t directory;     // Index of the IFD in the main chain
+    toff_t subIfdOffset;  // Offset of the SubIFD, or 0 if the level is in the main chain
+    cv::Size size;        // Size of the image in pixels
+    cv::Size tileSize;    // Size of the TIFF tiles in pixels
+    bool isJpegYCbCr;     // Converted to RGB by libtiff when read
+  };
+
+  struct Handle {
+    TIFF* tiff = nullptr;
+    int level = -1;  // Level the current directory of the handle belongs to
+  };
+
+  TiffTiledImage(const fs::path& filePath, const ThreadPool_t& threadPool);
+
+  fs::path _filePath;
+  std::vector<Level> _fileLevels;
+  int _type;
+  bool _isRGB;
+  int _orientation;
+
+  // Handles not in use. Each thread reading a region takes its own, so that the tiles are decoded in parallel.
+  std::mutex _handleMutex;
+  std::vector<Handle> _freeHandles;
+
+  std::mutex _coarseMutex;
+  std::shared_ptr<MemoryTiledImage> _coarseLevels;  // Built from the coarsest level in the file when first read
+
+  void readTileRows(int level, const cv::Rect& rect, int tileRowBegin, int tileRowEnd, cv::Mat& result);  // Rows of the tiles in [begin, end)
+  Handle acquireHandle();
+  void releaseHandle(Handle handle);
+  bool setLevel(Handle& handle, int level) const;
+  MemoryTiledImage& getCoarseLevels();
+
+  static TIFF* openTiff(const fs::path& filePath);
+};
+
+#endif
@@ -0,0 +1,100 @@
+#pragma once
+
+#define GLM_FORCE_SWIZZLE
+#define GLM_FORCE_RADIANS
+#define GLM_ENABLE_EXPERIMENTAL
+
+#include <tiledimage.h>
+
+#include <QOpenGLFunctions>
+#include <QOpenGLTexture>
+#include <cstdint>
+#include <future>
+#include <glm/glm.hpp>
+#include <list>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <unordered_map>
+#include <vector>
+
+// ###########################################################################################################################################
+// TiledTexture
+// ###########################################################################################################################################
+
+// Virtual texture for the images too large to upload as a single texture.
+// The image is split into tiles across its pyramid, and only the tiles visible at the current zoom level are uploaded to an atlas texture.
+// The atlas is bounded by Common::TILE_CACHE_CAPACITY_BYTES, and the least recently used tiles are evicted.
+// The tile table maps each tile of the current level to its slot in the atlas, so that the shaders fetch any texel across the tile borders.
+// A tile still being read is drawn from a resident tile of a coarser level meanwhile.
+// NOTE: All the methods except the constructor must be called with the OpenGL context current.
+class TiledTexture {
+ public:
+  TiledTexture();
+  ~TiledTexture();
+
+  void setImage(const TiledImage_t& image,
+                QOpenGLTexture::TextureFormat textureFormat,
+                QOpenGLTexture::PixelFormat pixelFormat,
+                QOpenGLTexture::PixelType pixelType,
+                int maxTextureSize);
+  void clear();  // Release the image and the GPU memory
+  bool empty() const;
+
+  // Request the tiles covering the region at the level for the texel density, upload the ones read so far, and return the level.
+  // The region is given in the texture coordinates in [0, 1], and the density in texels of the full image per screen pixel.
+  int update(const glm::vec2& regionMin, const glm::vec2& regionMax, float texelsPerPixel);
+  bool hasPendingTiles() const;  // True if update() has to be called again to upload the tiles being read
+
+  glm::ivec2 getLevelSize(int level) const;
+
+  void bind(int atlasUnit, int tableUnit);
+  void release(int atlasUnit, int tableUnit);
+
+  // Images whose longer side exceeds this are drawn in tiles
+  static int getMaxSingleTextureSize(int maxTextureSize);
+
+ private:
+  struct ResidentTile {
+    glm::ivec2 slot;                   // Position of the tile in the atlas in tiles
+    std::list<uint64_t>::iterator it;  // Position in _lruTiles
+  };
+
+  struct PendingTile {
+    std::future<cv::Mat> future;
+    CancellationToken_t token;
+  };
+
+  TiledImage_t _image;
+  int _numLevels;
+
+  QOpenGLTexture::TextureFormat _textureFormat;
+  QOpenGLTexture::PixelFormat _pixelFormat;
+  QOpenGLTexture::PixelType _pixelType;
+
+  std::unique_ptr<QOpenGLTexture> _atlas;
+  glm::ivec2 _atlasSizeInTiles;
+  std::vector<glm::ivec2> _freeSlots;
+
+  std::list<uint64_t> _lruTiles;  // The most recently used tile comes first
+  std::unordered_map<uint64_t, ResidentTile> _residentTiles;
+  std::unordered_map<uint64_t, PendingTile> _pendingTiles;
+
+  std::unique_ptr<QOpenGLTexture> _table;
+  std::vector<float> _tableData;  // Slot and scale of the texel coordinates of each tile of the current level. The slot is -1 if nothing is resident.
+  int _tableLevel;
+  glm::ivec4 _tableTileRange;  // Visible tiles the table was built for, as (min, max)
+  bool _isTableDirty;
+
+  int selectLevel(float texelsPerPixel) const;
+  void allocateAtlas(int maxTextureSize);
+  void uploadTile(uint64_t key, const cv::Mat& tileImage);
+  void cancelPendingTiles();
+  void updateTable(int level, const glm::ivec2& tileMin, const glm::ivec2& tileMax);
+
+  static uint64_t getTileKey(int level, const glm::ivec2& tile);
+  static int getTileLevel(uint64_t key);
+  static glm::ivec2 getTile(uint64_t key);
+  static int getBytesPerTexel(QOpenGLTexture::PixelFormat pixelFormat, QOpenGLTexture::PixelType pixelType);
+};
+
+using TiledTexture_t = std::shared_ptr<TiledTexture>;
@@ -1,5 +1,9 @@
 #include <fileutil.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+
 #if defined(_WIN32)
 std::string FileUtil::wstringToString(const std::wstring& wstr) {
   std::string str(wstr.begin(), wstr.end());
@@ -129,3 +133,141 @@ bool FileUtil::moveToTrash(const fs::path& path) {
 
   return returnCode == 0;
 }
+
+std::optional<FileStamp> FileStamp::read(const fs::path& filePath) {
+  std::error_code errorCode;
+  FileStamp stamp;
+
+  stamp.size = fs::file_size(filePath, errorCode);
+  if (errorCode) {
+    return std::nullopt;
+  }
+
+  stamp.lastWriteTime = fs::last_write_time(filePath, errorCode);
+  if (errorCode) {
+    return std::nullopt;
+  }
+
+  return stamp;
+}
+
+MappedFile::MappedFile(const fs::path& filePath)
+    : _filePath(filePath),
+      _mappedView(nullptr),
+      _size(0),
+      _stamp(FileStamp::read(filePath)),
+      _buffer() {
+
+#if defined(_WIN32)
+  const HANDLE fileHandle = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (fileHandle == INVALID_HANDLE_VALUE) {
+    throw std::runtime_error("Failed to open the file.");
+  }
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(fileHandle, &fileSize)) {
+    CloseHandle(fileHandle);
+    throw std::runtime_error("Failed to get the file size.");
+  }
+  _size = static_cast<size_t>(fileSize.QuadPart);
+
+  if (_size > 0) {
+    const HANDLE mappingHandle = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle != nullptr) {
+      _mappedView = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+      CloseHandle(mappingHandle);  // The view keeps the mapping alive
+    }
+  }
+
+  if (_mappedView == nullptr && _size > 0) {
+    // Fall back to reading the whole file
+    _buffer.resize(_size);
+
+    size_t numReadBytes = 0;
+    while (numReadBytes < _size) {
+      DWORD numBytes = 0;
+      const DWORD numRequestedBytes = static_cast<DWORD>(std::min<size_t>(_size - numReadBytes, 1u << 30));
+      if (!ReadFile(fileHandle, _buffer.data() + numReadBytes, numRequestedBytes, &numBytes, nullptr) || numBytes == 0) {
+        CloseHandle(fileHandle);
+        throw std::runtime_error("Failed to read the file.");
+      }
+      numReadBytes += numBytes;
+    }
+  }
+
+  CloseHandle(fileHandle);
+#else
+  const int fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open the file.");
+  }
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 || !S_ISREG(fileStat.st_mode)) {
+    close(fd);
+    throw std::runtime_error("File is not a regular file.");
+  }
+  _size = static_cast<size_t>(fileStat.st_size);
+
+  if (_size > 0) {
+    void* mapping = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      _mappedView = mapping;
+
+      // The decoders read most of the file from the head. Let the kernel read ahead of them.
+      posix_madvise(_mappedView, _size, POSIX_MADV_SEQUENTIAL);
+      posix_madvise(_mappedView, _size, POSIX_MADV_WILLNEED);
+    }
+  }
+
+  if (_mappedView == nullptr && _size > 0) {
+    // Fall back to reading the whole file, e.g. on file systems without mmap support
+    _buffer.resize(_size);
+
+    size_t numReadBytes = 0;
+    while (numReadBytes < _size) {
+      const ssize_t numBytes = read(fd, _buffer.data() + numReadBytes, _size - numReadBytes);
+      if (numBytes < 0 && errno == EINTR) {
+        continue;
+      }
+      if (numBytes <= 0) {
+        close(fd);
+        throw std::runtime_error("Failed to read the file.");
+      }
+      numReadBytes += static_cast<size_t>(numBytes);
+    }
+  }
+
+  // NOTE: The mapping stays valid after closing the file descriptor
+  close(fd);
+#endif
+}
+
+MappedFile::~MappedFile() {
+  if (_mappedView == nullptr) {
+    return;
+  }
+
+#if defined(_WIN32)
+  UnmapViewOfFile(_mappedView);
+#else
+  munmap(_mappedView, _size);
+#endif
+}
+
+const fs::path& MappedFile::getPath() const {
+  return _filePath;
+}
+
+const uint8_t* MappedFile::getData() const {
+  return _mappedView != nullptr ? static_cast<const uint8_t*>(_mappedView) : _buffer.data();
+}
+
+size_t MappedFile::getSize() const {
+  return _size;
+}
+
+const std::optional<FileStamp>& MappedFile::getStamp() const {
+  return _stamp;
+}
+
@@ -1,11 +1,23 @@
+#include <common.h>
 #include <glwidget.h>
 #include <shaders.h>
 
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 GLWidget::GLWidget(QWidget *parent)
     : QOpenGLWidget(parent),
+      _imagePath(),
       _textureSize(100, 100),
+      _imageSize(100, 100),
+      _textureFormat(QOpenGLTexture::RGBA32F),
+      _orientation(1),
+      _viewTransform(1.0f),
+      _valueScale(1.0f),
+      _valueOffset(0.0f),
+      _numChannels(4),
+      _swapRedBlue(false),
       _rectTopLeft(0.0f, 0.0f),
       _rectBottomRight(1.0f, 1.0f),
       _backgroundColor(0.1f, 0.1f, 0.1f),
@@ -16,6 +28,15 @@ GLWidget::GLWidget(QWidget *parent)
       _vertexBuffer(QOpenGLBuffer::VertexBuffer),
       _indexBuffer(QOpenGLBuffer::IndexBuffer),
       _texture(nullptr),
+      _backTexture(nullptr),
+      _textureUploader(std::make_unique<TextureUploader>()),
+      _uploadingImageData(),
+      _textureCache(std::make_unique<TextureCache>()),
+      _cachedTexture(nullptr),
+      _tiledTexture(std::make_shared<TiledTexture>()),
+      _isTiled(false),
+      _maxTextureSize(Common::TILED_RENDERING_MIN_SIZE),
+      _intermediateFramebuffer(nullptr),
       _glFunctions(nullptr),
       _isDragging(false) {
 }
@@ -35,6 +56,20 @@ GLWidget::~GLWidget() {
 
   delete _texture;
 
+  if (_backTexture != nullptr) {
+    _backTexture->destroy();
+    delete _backTexture;
+  }
+
+  _textureUploader.reset();
+  _tiledTexture.reset();
+  _intermediateFramebuffer.reset();
+  _imageShader.reset();
+
+  // NOTE: The cache releases its textures in its own context
+  _cachedTexture.reset();
+  _textureCache.reset();
+
   doneCurrent();
 }
 
@@ -48,6 +83,7 @@ void GLWidget::initializeGL() {
   }
 
   _glFunctions->initializeOpenGLFunctions();
+  _glFunctions->glGetIntegerv(GL_MAX_TEXTURE_SIZE, &_maxTextureSize);
 
   // -----------------------------------------------------------------------------
   // Build the shader program
@@ -121,16 +157,21 @@ void GLWidget::initializeGL() {
   _texture = new QOpenGLTexture(QOpenGLTexture::Target2D);
   _texture->create();
   _texture->bind();
-  _texture->setFormat(QOpenGLTexture::RGBA32F);
+  _texture->setFormat(_textureFormat);
   _texture->setSize(_textureSize.x, _textureSize.y);
   _texture->setMinificationFilter(QOpenGLTexture::Filter::NearestMipMapNearest);
   _texture->setMagnificationFilter(QOpenGLTexture::Filter::Nearest);
   _texture->setAutoMipMapGenerationEnabled(true);
   _texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+  _texture->setMipLevels(_texture->maximumMipLevels());
   _texture->allocateStorage(QOpenGLTexture::RGBA, QOpenGLTexture::Float32);
   _texture->generateMipMaps();
   _texture->release();
 
+  _backTexture = new QOpenGLTexture(QOpenGLTexture::Target2D);
+
+  _textureCache->start(context(), TiledTexture::getMaxSingleTextureSize(_maxTextureSize));
+
   // -----------------------------------------------------------------------------
   // Initialize
   _oldWindowSize = glm::ivec2(width(), height());
@@ -140,6 +181,9 @@ void GLWidget::resizeGL(int w, int h) {
   const qreal retinaScale = devicePixelRatio();
   _glFunctions->glViewport(0, 0, w * retinaScale, h * retinaScale);
 
+  // Re-created at the new size when drawn
+  _intermediateFramebuffer.reset();
+
   resetRectPosition();
 }
 
@@ -152,37 +196,193 @@ void GLWidget::paintGL() {
 
   _glFunctions->glDisable(GL_DEPTH_TEST);
 
-  const auto &program = _imageShader->getShaderProgram(_shaderType);
+  // Issue the next bands of the image being streamed
+  updateUpload();
+
+  const glm::vec2 rectSize = _rectBottomRight - _rectTopLeft;
+
+  // Texels of the full image per pixel on the screen
+  const glm::vec2 rectSizeInPixels = rectSize * glm::vec2(width(), height()) * static_cast<float>(retinaScale);
+  const glm::vec2 texelsPerPixel = glm::vec2(getDisplaySize(_textureSize)) / rectSizeInPixels;
+
+  // The part of the texture inside the window
+  const glm::mat3 uvTransform = getUVTransform();
+  const glm::vec2 visibleMin = glm::clamp((glm::vec2(0.0f) - _rectTopLeft) / rectSize, 0.0f, 1.0f);
+  const glm::vec2 visibleMax = glm::clamp((glm::vec2(1.0f) - _rectTopLeft) / rectSize, 0.0f, 1.0f);
+  const glm::vec2 cornerA = (uvTransform * glm::vec3(visibleMin, 1.0f)).xy();
+  const glm::vec2 cornerB = (uvTransform * glm::vec3(visibleMax, 1.0f)).xy();
+  const glm::vec2 visibleUVMin = glm::min(cornerA, cornerB);
+  const glm::vec2 visibleUVMax = glm::max(cornerA, cornerB);
+
+  // Read the level matching the zoom. The visible tiles of the level are made resident if tiled.
+  glm::ivec2 textureSize = _textureSize;
+  int textureLod = 0;
+  if (_isTiled) {
+    const int level = _tiledTexture->update(visibleUVMin, visibleUVMax, std::max(texelsPerPixel.x, texelsPerPixel.y));
+    textureSize = _tiledTexture->getLevelSize(level);
+
+    if (_tiledTexture->hasPendingTiles()) {
+      // Paint again to upload the tiles being read
+      QTimer::singleShot(Common::TILE_POLL_INTERVAL_MS, this, [this]() { update(); });
+    }
+  } else {
+    // The filters read the pre-filtered mip level instead of skipping the texels of the full image
+    textureLod = selectMipLevel(_textureSize, std::max(texelsPerPixel.x, texelsPerPixel.y));
+    textureSize = glm::max(_textureSize >> textureLod, glm::ivec2(1));
+  }
 
   {
-    program->bind();
-
-    {
-      // Activate the texture
+    // Activate the texture
+    if (_isTiled) {
+      _tiledTexture->bind(0, 1);
+    } else if (_cachedTexture != nullptr) {
+      _glFunctions->glBindTexture(GL_TEXTURE_2D, _cachedTexture->id);
+    } else {
       _texture->bind();
+    }
 
-      // clang-format off
-      program->setUniformValue(ImageShaderBase::UNIFORM_NAME_TEXTURE           , 0);
-      program->setUniformValue(ImageShaderBase::UNIFORM_NAME_PIXEL_SIZE        , 1.0f / width(), 1.0f / height());
-      program->setUniformValue(ImageShaderBase::UNIFORM_NAME_RECT_TOP_LEFT     , _rectTopLeft.x, _rectTopLeft.y);
-      program->setUniformValue(ImageShaderBase::UNIFORM_NAME_RECT_BOTTOM_RIGHT , _rectBottomRight.x, _rectBottomRight.y);
-      program->setUniformValue(ImageShaderBase::UNIFORM_NAME_BACKGROUND_COLOR  , _backgroundColor.r, _backgroundColor.g, _backgroundColor.b);
-      program->setUniformValue(ImageShaderBase::UNIFORM_NAME_TEXTURE_SIZE      , _textureSize.x, _textureSize.y);
-      // clang-format on
+    // Weights of the kernel of the filter
+    const auto &kernelLut = _imageShader->getKernelLut(_shaderType);
+    if (kernelLut != nullptr) {
+      kernelLut->bind(3, QOpenGLTexture::ResetTextureUnit);
+    }
+
+    // The separable filters are drawn in two passes of 1D kernels, which read 2N texels per pixel instead of N^2
+    if (!isSeparableShaderType(_shaderType) || !drawSeparablePasses(textureSize, textureLod, visibleUVMin.y, visibleUVMax.y)) {
+      const auto &program = _imageShader->getShaderProgram(_shaderType);
+
+      program->bind();
+      setImageUniforms(*program, textureSize, textureLod);
 
       _vao.bind();
       _glFunctions->glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
       _vao.release();
 
-      _texture->release();
+      program->release();
     }
 
-    program->release();
+    if (kernelLut != nullptr) {
+      kernelLut->release(3, QOpenGLTexture::ResetTextureUnit);
+    }
+
+    if (_isTiled) {
+      _tiledTexture->release(0, 1);
+    } else if (_cachedTexture != nullptr) {
+      _glFunctions->glBindTexture(GL_TEXTURE_2D, 0);
+    } else {
+      _texture->release();
+    }
   }
 
   _glFunctions->glEnable(GL_DEPTH_TEST);
 }
 
+void GLWidget::setImageUniforms(QOpenGLShaderProgram &program, const glm::ivec2 &textureSize, int textureLod) {
+  // clang-format off
+  program.setUniformValue(ImageShaderBase::UNIFORM_NAME_TEXTURE           , 0);
+  program.setUniformValue(ImageShaderBase::UNIFORM_NAME_PIXEL_SIZE        , 1.0f / width(), 1.0f / height());
+  program.setUniformValue(ImageShaderBase::UNIFORM_NAME_RECT_TOP_LEFT     , _rectTopLeft.x, _rectTopLeft.y);
+  program.setUniformValue(ImageShaderBase::UNIFORM_NAME_RECT_BOTTOM_RIGHT , _rectBottomRight.x, _rectBottomRight.y);
+  program.setUniformValue(ImageShaderBase::UNIFORM_NAME_BACKGROUND_COLOR  , _backgroundColor.r, _backgroundColor.g, _backgroundColor.b);
+  program.setUniformValue(ImageShaderBase::UNIFORM_NAME_TEXTURE_SIZE      , textureSize.x, textureSize.y);
+  program.setUniformValue(ImageShaderBase::UNIFORM_NAME_TEXTURE_LOD       , static_cast<float>(textureLod));
+  program.setUniformValue(ImageShaderBase::UNIFORM_NAME_VALUE_SCALE       , _valueScale);
+  program.setUniformValue(ImageShaderBase::UNIFORM_NAME_VALUE_OFFSET      , _valueOffset);
+  program.setUniformValue(ImageShaderBase::UNIFORM_NAME_NUM_CHANNELS      , _numChannels);
+  program.setUniformValue(ImageShaderBase::UNIFORM_NAME_SWAP_RED_BLUE     , _swapRedBlue);
+  program.setUniformValue(ImageShaderBase::UNIFORM_NAME_UV_TRANSFORM      , QMatrix3x3(glm::value_ptr(glm::transpose(getUVTransform()))));  // Row-major
+  program.setUniformValue(ImageShaderBase::UNIFORM_NAME_IS_TILED          , _isTiled);
+  program.setUniformValue(ImageShaderBase::UNIFORM_NAME_TILE_TABLE        , 1);
+  program.setUniformValue(ImageShaderBase::UNIFORM_NAME_TILE_SIZE         , Common::TILE_SIZE);
+  program.setUniformValue(ImageShaderBase::UNIFORM_NAME_KERNEL_LUT        , 3);
+  // clang-format on
+}
+
+bool GLWidget::drawSeparablePasses(const glm::ivec2 &textureSize, int textureLod, float visibleVMin, float visibleVMax) {
+  // NOTE: Called with the texture bound
+  const qreal retinaScale = devicePixelRatio();
+  const glm::ivec2 viewportSize = glm::ivec2(glm::vec2(width(), height()) * static_cast<float>(retinaScale));
+
+  // The columns of the intermediate texture are the pixels along the screen axis the texture x changes on
+  const int passAxis = getUVTransform()[0][0] == 0.0f ? 1 : 0;
+  const int numColumns = viewportSize[passAxis];
+
+  // The rows are the visible texel rows and the ones around them the kernel reads
+  const int rowBegin = std::clamp(static_cast<int>(std::floor(visibleVMin * textureSize.y)) - Common::TILE_FILTER_MARGIN, 0, textureSize.y - 1);
+  const int rowEnd = std::clamp(static_cast<int>(std::ceil(visibleVMax * textureSize.y)) + Common::TILE_FILTER_MARGIN, rowBegin + 1, textureSize.y);
+  const int numRows = rowEnd - rowBegin;
+
+  if (numColumns <= 0 || numColumns > _maxTextureSize || numRows > _maxTextureSize) {
+    return false;  // Drawn in a single pass instead
+  }
+
+  if (_intermediateFramebuffer == nullptr || _intermediateFramebuffer->width() < numColumns || _intermediateFramebuffer->height() < numRows) {
+    // Grown to the largest size drawn so far, so that panning and zooming do not re-create it
+    const int framebufferWidth = _intermediateFramebuffer == nullptr ? numColumns : std::max(numColumns, _intermediateFramebuffer->width());
+    const int framebufferHeight = _intermediateFramebuffer == nullptr ? numRows : std::max(numRows, _intermediateFramebuffer->height());
+
+    // NOTE: Floating point to keep the negative lobes of the kernels until the second pass
+    _intermediateFramebuffer = std::make_unique<QOpenGLFramebufferObject>(framebufferWidth, framebufferHeight, QOpenGLFramebufferObject::NoAttachment, GL_TEXTURE_2D, GL_RGBA16F);
+  }
+
+  // -----------------------------------------------------------------------------
+  // Filter the texel rows into the intermediate texture
+  const auto &horizontalProgram = _imageShader->getSeparablePassProgram(_shaderType, 0);
+
+  _intermediateFramebuffer->bind();
+  _glFunctions->glViewport(0, 0, numColumns, numRows);
+
+  horizontalProgram->bind();
+  setImageUniforms(*horizontalProgram, textureSize, textureLod);
+
+  // clang-format off
+  horizontalProgram->setUniformValue(ImageShaderBase::UNIFORM_NAME_PASS_AXIS       , passAxis);
+  horizontalProgram->setUniformValue(ImageShaderBase::UNIFORM_NAME_PASS_NUM_PIXELS , static_cast<float>(numColumns));
+  horizontalProgram->setUniformValue(ImageShaderBase::UNIFORM_NAME_PASS_ROW_BEGIN  , rowBegin);
+  // clang-format on
+
+  _vao.bind();
+  _glFunctions->glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+  _vao.release();
+
+  horizontalProgram->release();
+
+  // Back to the framebuffer of this widget
+  _glFunctions->glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+  _glFunctions->glViewport(0, 0, viewportSize.x, viewportSize.y);
+
+  // -----------------------------------------------------------------------------
+  // Filter the columns of the intermediate texture onto the screen
+  const auto &verticalProgram = _imageShader->getSeparablePassProgram(_shaderType, 1);
+
+  _glFunctions->glActiveTexture(GL_TEXTURE2);
+  _glFunctions->glBindTexture(GL_TEXTURE_2D, _intermediateFramebuffer->texture());
+  _glFunctions->glActiveTexture(GL_TEXTURE0);
+
+  verticalProgram->bind();
+  setImageUniforms(*verticalProgram, textureSize, textureLod);
+
+  // clang-format off
+  verticalProgram->setUniformValue(ImageShaderBase::UNIFORM_NAME_INTERMEDIATE    , 2);
+  verticalProgram->setUniformValue(ImageShaderBase::UNIFORM_NAME_PASS_AXIS       , passAxis);
+  verticalProgram->setUniformValue(ImageShaderBase::UNIFORM_NAME_PASS_NUM_PIXELS , static_cast<float>(numColumns));
+  verticalProgram->setUniformValue(ImageShaderBase::UNIFORM_NAME_PASS_ROW_BEGIN  , rowBegin);
+  verticalProgram->setUniformValue(ImageShaderBase::UNIFORM_NAME_PASS_NUM_ROWS   , numRows);
+  // clang-format on
+
+  _vao.bind();
+  _glFunctions->glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+  _vao.release();
+
+  verticalProgram->release();
+
+  _glFunctions->glActiveTexture(GL_TEXTURE2);
+  _glFunctions->glBindTexture(GL_TEXTURE_2D, 0);
+  _glFunctions->glActiveTexture(GL_TEXTURE0);
+
+  return true;
+}
+
 void GLWidget::mousePressEvent(QMouseEvent *event) {
   if (event == nullptr) {
     return;
@@ -288,40 +488,100 @@ void GLWidget::wheelEvent(QWheelEvent *event) {
   event->accept();
 }
 
-void GLWidget::updateTexture(const cv::Mat &image) {
-  if (image.empty()) {
+void GLWidget::updateTexture(const ImageData &imageData) {
+  if (imageData.empty()) {
     return;
   }
 
+  const cv::Mat &image = imageData.image;
+  const QOpenGLTexture::TextureFormat textureFormat = getTextureFormat(image.depth(), image.channels());
+  const QOpenGLTexture::PixelFormat pixelFormat = getPixelFormat(image.channels());
+  const QOpenGLTexture::PixelType pixelType = getPixelType(image.depth());
+
   {
     makeCurrent();
 
-    // Resize the texture if necessary
-    if (_textureSize.x != image.cols || _textureSize.y != image.rows) {
-      _textureSize.x = image.cols;
-      _textureSize.y = image.rows;
+    // The image being streamed is superseded
+    _textureUploader->cancel();
+    _uploadingImageData = ImageData();
+
+    // The image read by region from the file, or the decoded image too large for a single texture
+    TiledImage_t tiledImage = imageData.tiledImage;
+    if (tiledImage == nullptr && std::max(image.cols, image.rows) > TiledTexture::getMaxSingleTextureSize(_maxTextureSize)) {
+      tiledImage = std::make_shared<MemoryTiledImage>(image, nullptr);
+    }
+
+    const bool isTiled = tiledImage != nullptr;
+    const cv::Size imageSize = isTiled ? tiledImage->getLevelSize(0) : image.size();
+
+    if (!isTiled) {
+      // The texture of the image uploaded ahead only needs to be bound
+      CachedTexture_t cachedTexture = _textureCache->acquire(imageData);
+      if (cachedTexture != nullptr) {
+        _tiledTexture->clear();
+        _cachedTexture = std::move(cachedTexture);
+        setImageProperties(imageData, imageSize, textureFormat, false);
+
+        doneCurrent();
+        update();
+        return;
+      }
+    }
+
+    if (!isTiled && image.total() * image.elemSize() >= Common::TEXTURE_STREAMING_MIN_BYTES) {
+      // Stream the image in bands over the frames, and keep drawing the current image meanwhile, such as the preview of the same file
+      allocateTexture(_backTexture, image.size(), textureFormat, pixelFormat, pixelType);
+      _textureUploader->start(_backTexture, image, hasMipLevels(imageData, _backTexture) ? imageData.mipLevels : std::vector<cv::Mat>(), pixelFormat, pixelType);
+      _uploadingImageData = imageData;
 
+      doneCurrent();
+      update();
+      return;
+    }
+
+    _cachedTexture.reset();
+
+    if (isTiled) {
+      // NOTE: Only the visible tiles are uploaded when painted
+      _tiledTexture->setImage(tiledImage, textureFormat, pixelFormat, pixelType, _maxTextureSize);
+
+      // Release the memory of the previous image
       _texture->destroy();
       _texture->create();
+    } else {
+      _tiledTexture->clear();
+    }
+
+    // Re-create the texture if the size or the format is changed
+    // NOTE: The texture is compared rather than the properties, which are also of the cached textures
+    if (!isTiled && (!_texture->isStorageAllocated() || _texture->width() != image.cols || _texture->height() != image.rows || _texture->format() != textureFormat)) {
+      allocateTexture(_texture, image.size(), textureFormat, pixelFormat, pixelType);
+    }
+
+    if (!isTiled) {
+      // Upload the texture data
+      // NOTE: The rows of 1 or 3 channel images are not necessarily aligned to 4 bytes
+      QOpenGLPixelTransferOptions transferOptions;
+      transferOptions.setAlignment(1);
+      transferOptions.setRowLength(static_cast<int>(image.step[0] / image.elemSize()));
 
       _texture->bind();
-      _texture->setFormat(QOpenGLTexture::RGBA32F);
-      _texture->setSize(_textureSize.x, _textureSize.y);
-      _texture->setMinificationFilter(QOpenGLTexture::Filter::NearestMipMapNearest);
-      _texture->setMagnificationFilter(QOpenGLTexture::Filter::Nearest);
-      _texture->setAutoMipMapGenerationEnabled(true);
-      _texture->setWrapMode(QOpenGLTexture::ClampToEdge);
-      _texture->allocateStorage(QOpenGLTexture::RGBA, QOpenGLTexture::Float32);
-      _texture->generateMipMaps();
+      _texture->setData(pixelFormat, pixelType, image.data, &transferOptions);
+
+      if (hasMipLevels(imageData, _texture)) {
+        for (int level = 1; level < _texture->mipLevels(); ++level) {
+          const cv::Mat &mipLevel = imageData.mipLevels[level - 1];
+          transferOptions.setRowLength(static_cast<int>(mipLevel.step[0] / mipLevel.elemSize()));
+          _texture->setData(level, pixelFormat, pixelType, mipLevel.data, &transferOptions);
+        }
+      } else {
+        _texture->generateMipMaps();
+      }
+
       _texture->release();
     }
 
-    resetRectPosition();
-
-    // Upload the texture data
-    _texture->bind();
-    _texture->setData(QOpenGLTexture::RGBA, QOpenGLTexture::Float32, image.data);
-    _texture->release();
+    setImageProperties(imageData, imageSize, textureFormat, isTiled);
 
     doneCurrent();
   }
@@ -330,6 +590,79 @@ void GLWidget::updateTexture(const cv::Mat &image) {
   update();
 }
 
+void GLWidget::prefetchTexture(const ImageData &imageData) {
+  if (imageData.empty() || imageData.isPreview || imageData.tiledImage != nullptr) {
+    return;
+  }
+
+  const cv::Mat &image = imageData.image;
+  _textureCache->prefetch(imageData, getTextureFormat(image.depth(), image.channels()), getPixelFormat(image.channels()), getPixelType(image.depth()));
+}
+
+void GLWidget::setImageProperties(const ImageData &imageData, const cv::Size &imageSize, QOpenGLTexture::TextureFormat textureFormat, bool isTiled) {
+  const cv::Mat &image = imageData.image;
+
+  _textureSize = glm::ivec2(imageSize.width, imageSize.height);
+  _textureFormat = textureFormat;
+  _isTiled = isTiled;
+
+  // The preview is laid out at the size of the full image, so that the rect does not change when the full image replaces it.
+  // NOTE: The aspect of an embedded preview may differ from the full image, e.g. a 4:3 thumbnail of a 3:2 photo.
+  const cv::Size layoutSize = imageData.isPreview && !imageData.fullSize.empty() ? imageData.fullSize : imageSize;
+  _imageSize = glm::ivec2(layoutSize.width, layoutSize.height);
+
+  // NOTE: The preview from the store is already upright, while the full image of the same file is not
+  _orientation = imageData.orientation;
+
+  // Keep the zoom, the pan, the rotation and the flip while the preview is replaced with the full image of the same file
+  if (imageData.path != _imagePath) {
+    _imagePath = imageData.path;
+    _viewTransform = glm::mat3(1.0f);
+    resetRectPosition();
+  }
+
+  // Normalize the texel values to [0, 1] in the shader.
+  // The texture of 8U/16U is sampled as normalized values in [0, 1], so the value range is also scaled.
+  const double normalizedMax = image.depth() == CV_8U ? 255.0 : (image.depth() == CV_16U ? 65535.0 : 1.0);
+  const double valueRange = imageData.maxValue > imageData.minValue ? imageData.maxValue - imageData.minValue : 1.0;
+  _valueScale = static_cast<float>(normalizedMax / valueRange);
+  _valueOffset = static_cast<float>(-imageData.minValue / valueRange);
+
+  _numChannels = image.channels();
+  _swapRedBlue = image.channels() >= 3 && imageData.channelOrder == ChannelOrder::BGR;
+}
+
+void GLWidget::updateUpload() {
+  // NOTE: Called with the OpenGL context current
+  if (!_textureUploader->isUploading()) {
+    return;
+  }
+
+  if (!_textureUploader->update()) {
+    // Paint again to issue the rest of the bands
+    QTimer::singleShot(Common::TEXTURE_UPLOAD_POLL_INTERVAL_MS, this, [this]() { update(); });
+    return;
+  }
+
+  // All the bands are issued. The mipmaps and the draws are ordered after them on the GPU.
+  std::swap(_texture, _backTexture);
+
+  if (!hasMipLevels(_uploadingImageData, _texture)) {
+    _texture->bind();
+    _texture->generateMipMaps();
+    _texture->release();
+  }
+
+  // Release the memory of the previous image
+  _backTexture->destroy();
+  _tiledTexture->clear();
+  _cachedTexture.reset();
+
+  const ImageData imageData = std::move(_uploadingImageData);
+  _uploadingImageData = ImageData();
+  setImageProperties(imageData, imageData.image.size(), getTextureFormat(imageData.image.depth(), imageData.image.channels()), false);
+}
+
 void GLWidget::setShaderType(ImageShaderType type) {
   _shaderType = type;
 
@@ -337,17 +670,43 @@ void GLWidget::setShaderType(ImageShaderType type) {
   update();
 }
 
+void GLWidget::rotateView(bool isClockwise) {
+  // Maps the rect coordinates after the rotation to the ones before it
+  // clang-format off
+  const glm::mat3 rotation = isClockwise ? glm::mat3( 0.0f, 1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f)   // (1 - v, u)
+                                         : glm::mat3( 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f);  // (v, 1 - u)
+  // clang-format on
+
+  _viewTransform = _viewTransform * rotation;
+
+  // Fit the rotated image in the window
+  resetRectPosition();
+  update();
+}
+
+void GLWidget::flipView(bool isHorizontal) {
+  // clang-format off
+  const glm::mat3 flip = isHorizontal ? glm::mat3(-1.0f, 0.0f, 0.0f, 0.0f,  1.0f, 0.0f, 1.0f, 0.0f, 1.0f)   // (1 - u, v)
+                                      : glm::mat3( 1.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f);  // (u, 1 - v)
+  // clang-format on
+
+  _viewTransform = _viewTransform * flip;
+
+  update();
+}
+
 void GLWidget::resetRectPosition() {
   const glm::ivec2 windowSize(width(), height());
+  const glm::ivec2 displaySize = getDisplaySize(_imageSize);
 
-  const float textureAspect = static_cast<float>(_textureSize.x) / static_cast<float>(_textureSize.y);
+  const float textureAspect = static_cast<float>(displaySize.x) / static_cast<float>(displaySize.y);
   const float windowAspect = static_cast<float>(windowSize.x) / static_cast<float>(windowSize.y);
 
   if (textureAspect > windowAspect) {
     // Texture is wider than window
-    const float scale = static_cast<float>(windowSize.x) / static_cast<float>(_textureSize.x);
-    const float width = scale * _textureSize.x;
-    const float height = scale * _textureSize.y;
+    const float scale = static_cast<float>(windowSize.x) / static_cast<float>(displaySize.x);
+    const float width = scale * displaySize.x;
+    const float height = scale * displaySize.y;
 
     _rectTopLeft.x = (windowSize.x - width) / 2.0f / windowSize.x;
     _rectTopLeft.y = (windowSize.y - height) / 2.0f / windowSize.y;
@@ -355,9 +714,9 @@ void GLWidget::resetRectPosition() {
     _rectBottomRight.y = _rectTopLeft.y + height / windowSize.y;
   } else {
     // Texture is taller than window
-    const float scale = static_cast<float>(windowSize.y) / static_cast<float>(_textureSize.y);
-    const float width = scale * _textureSize.x;
-    const float height = scale * _textureSize.y;
+    const float scale = static_cast<float>(windowSize.y) / static_cast<float>(displaySize.y);
+    const float width = scale * displaySize.x;
+    const float height = scale * displaySize.y;
 
     _rectTopLeft.x = (windowSize.x - width) / 2.0f / windowSize.x;
     _rectTopLeft.y = (windowSize.y - height) / 2.0f / windowSize.y;
@@ -365,3 +724,101 @@ void GLWidget::resetRectPosition() {
     _rectBottomRight.y = _rectTopLeft.y + height / windowSize.y;
   }
 }
+
+glm::mat3 GLWidget::getUVTransform() const {
+  return getOrientationTransform(_orientation) * _viewTransform;
+}
+
+glm::ivec2 GLWidget::getDisplaySize(const glm::ivec2 &size) const {
+  // The x axis of the rect runs along the y axis of the texture if rotated by 90 degrees
+  const bool isTransposed = getUVTransform()[0][0] == 0.0f;
+  return isTransposed ? glm::ivec2(size.y, size.x) : size;
+}
+
+void GLWidget::allocateTexture(QOpenGLTexture *texture, const cv::Size &size, QOpenGLTexture::TextureFormat textureFormat, QOpenGLTexture::PixelFormat pixelFormat, QOpenGLTexture::PixelType pixelType) {
+  texture->destroy();
+  texture->create();
+
+  texture->bind();
+  texture->setFormat(textureFormat);
+  texture->setSize(size.width, size.height);
+  texture->setMinificationFilter(QOpenGLTexture::Filter::NearestMipMapNearest);
+  texture->setMagnificationFilter(QOpenGLTexture::Filter::Nearest);
+  texture->setAutoMipMapGenerationEnabled(false);  // NOTE: The mip levels are uploaded or generated after the image
+  texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+  texture->setMipLevels(texture->maximumMipLevels());
+  texture->allocateStorage(pixelFormat, pixelType);
+  texture->release();
+}
+
+bool GLWidget::hasMipLevels(const ImageData &imageData, const QOpenGLTexture *texture) {
+  return !imageData.mipLevels.empty() && static_cast<int>(imageData.mipLevels.size()) == texture->mipLevels() - 1;
+}
+
+int GLWidget::selectMipLevel(const glm::ivec2 &size, float texelsPerPixel) {
+  // The finest level with at most one texel per screen pixel, as the levels of the tiled images
+  const int fullSize = std::max(size.x, size.y);
+  const int numLevels = static_cast<int>(std::log2(std::max(fullSize, 1))) + 1;
+
+  int level = 0;
+  while (level + 1 < numLevels && static_cast<float>(fullSize) / std::max(fullSize >> level, 1) < texelsPerPixel * 0.999f) {
+    ++level;
+  }
+  return level;
+}
+
+glm::mat3 GLWidget::getOrientationTransform(int orientation) {
+  // Maps the rect coordinates (the origin at the bottom left) to the texture coordinates (the first row of the image at 0).
+  // The columns of the matrix are (a, d, 0), (b, e, 0) and (c, f, 1) for (a * u + b * v + c, d * u + e * v + f).
+  // clang-format off
+  switch (orientation) {
+    case 2:  return glm::mat3(-1.0f,  0.0f, 0.0f,  0.0f, -1.0f, 0.0f, 1.0f, 1.0f, 1.0f);  // (1 - u, 1 - v)
+    case 3:  return glm::mat3(-1.0f,  0.0f, 0.0f,  0.0f,  1.0f, 0.0f, 1.0f, 0.0f, 1.0f);  // (1 - u, v)
+    case 4:  return glm::mat3( 1.0f,  0.0f, 0.0f,  0.0f,  1.0f, 0.0f, 0.0f, 0.0f, 1.0f);  // (u, v)
+    case 5:  return glm::mat3( 0.0f,  1.0f, 0.0f, -1.0f,  0.0f, 0.0f, 1.0f, 0.0f, 1.0f);  // (1 - v, u)
+    case 6:  return glm::mat3( 0.0f, -1.0f, 0.0f, -1.0f,  0.0f, 0.0f, 1.0f, 1.0f, 1.0f);  // (1 - v, 1 - u)
+    case 7:  return glm::mat3( 0.0f, -1.0f, 0.0f,  1.0f,  0.0f, 0.0f, 0.0f, 1.0f, 1.0f);  // (v, 1 - u)
+    case 8:  return glm::mat3( 0.0f,  1.0f, 0.0f,  1.0f,  0.0f, 0.0f, 0.0f, 0.0f, 1.0f);  // (v, u)
+    default: return glm::mat3( 1.0f,  0.0f, 0.0f,  0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f);  // (u, 1 - v)
+  }
+  // clang-format on
+}
+
+QOpenGLTexture::TextureFormat GLWidget::getTextureFormat(int depth, int channels) {
+  switch (depth) {
+    case CV_8U:
+      return channels == 1 ? QOpenGLTexture::R8_UNorm : (channels == 3 ? QOpenGLTexture::RGB8_UNorm : QOpenGLTexture::RGBA8_UNorm);
+    case CV_16U:
+      return channels == 1 ? QOpenGLTexture::R16_UNorm : (channels == 3 ? QOpenGLTexture::RGB16_UNorm : QOpenGLTexture::RGBA16_UNorm);
+    case CV_32F:
+      return channels == 1 ? QOpenGLTexture::R32F : (channels == 3 ? QOpenGLTexture::RGB32F : QOpenGLTexture::RGBA32F);
+    default:
+      throw std::invalid_argument("Unsupported image depth");
+  }
+}
+
+QOpenGLTexture::PixelFormat GLWidget::getPixelFormat(int channels) {
+  switch (channels) {
+    case 1:
+      return QOpenGLTexture::Red;
+    case 3:
+      return QOpenGLTexture::RGB;
+    case 4:
+      return QOpenGLTexture::RGBA;
+    default:
+      throw std::invalid_argument("Unsupported number of channels");
+  }
+}
+
+QOpenGLTexture::PixelType GLWidget::getPixelType(int depth) {
+  switch (depth) {
+    case CV_8U:
+      return QOpenGLTexture::UInt8;
+    case CV_16U:
+      return QOpenGLTexture::UInt16;
+    case CV_32F:
+      return QOpenGLTexture::Float32;
+    default:
+      throw std::invalid_argument("Unsupported image depth");
+  }
+}
@@ -1,44 +1,1283 @@
+#include <common.h>
 #include <image.h>
 
-#include <fstream>
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
 
-cv::Mat ImagingUtil::correctOrientation(const cv::Mat& img, const fs::path& filePath) {
-  std::ifstream ifs(FileUtil::pathToString(filePath), std::ifstream::binary);
+void ImagingUtil::transformPixels(cv::Mat& img, int orientation, double& minValue, double& maxValue, const ThreadPool_t& threadPool) {
+  // EXIF orientation: 1 as it is, 2 mirrored horizontally, 3 rotated by 180 degrees, 4 mirrored vertically, 5 transposed,
+  // 6 rotated by 90 degrees clockwise, 7 transversed and 8 rotated by 90 degrees counterclockwise
+  if (orientation < 1 || orientation > 8) {
+    orientation = 1;  // Unspecified or undefined
+  }
+
+  if (img.depth() != CV_8U && img.depth() != CV_8S && img.depth() != CV_16U && img.depth() != CV_16S &&
+      img.depth() != CV_32S && img.depth() != CV_32F && img.depth() != CV_64F) {
+    img.convertTo(img, CV_32F);  // NOTE: No scalar type for float16 on the CPU
+  }
+
+  const int depth = img.depth();
+  const bool isUploadableDepth = depth == CV_8U || depth == CV_16U || depth == CV_32F;
+
+  if (isUploadableDepth && orientation == 1) {
+    // Nothing to move. Only scan the value range without copying the image.
+    forEachRowChunk(img, 1, threadPool, [&](int rowBegin, int rowEnd, double& chunkMin, double& chunkMax) {
+      switch (depth) {
+        case CV_8U:
+          computeValueRange<uint8_t>(img, rowBegin, rowEnd, chunkMin, chunkMax);
+          break;
+        case CV_16U:
+          computeValueRange<uint16_t>(img, rowBegin, rowEnd, chunkMin, chunkMax);
+          break;
+        default:
+          computeValueRange<float>(img, rowBegin, rowEnd, chunkMin, chunkMax);
+          break;
+      }
+    },
+                    minValue, maxValue);
+    return;
+  }
+
+  if (img.channels() != 1 && img.channels() != 3 && img.channels() != 4) {
+    throw std::runtime_error("Unsupported number of channels.");
+  }
+
+  const bool isTransposed = orientation >= 5;
+  cv::Mat dst(isTransposed ? img.cols : img.rows, isTransposed ? img.rows : img.cols, CV_MAKETYPE(isUploadableDepth ? depth : CV_32F, img.channels()));
+
+  // The chunks of the transposing orientations are aligned to the tiles, so that no tile is shared by two chunks
+  const int rowAlignment = isTransposed ? Common::PIXEL_TRANSPOSE_TILE_SIZE : 1;
+
+  forEachRowChunk(img, rowAlignment, threadPool, [&](int rowBegin, int rowEnd, double& chunkMin, double& chunkMax) {
+    switch (depth) {
+      case CV_8U:
+        transformPixelsImpl<uint8_t, uint8_t>(img, dst, orientation, rowBegin, rowEnd, chunkMin, chunkMax);
+        break;
+      case CV_8S:
+        transformPixelsImpl<int8_t, float>(img, dst, orientation, rowBegin, rowEnd, chunkMin, chunkMax);
+        break;
+      case CV_16U:
+        transformPixelsImpl<uint16_t, uint16_t>(img, dst, orientation, rowBegin, rowEnd, chunkMin, chunkMax);
+        break;
+      case CV_16S:
+        transformPixelsImpl<int16_t, float>(img, dst, orientation, rowBegin, rowEnd, chunkMin, chunkMax);
+        break;
+      case CV_32S:
+        transformPixelsImpl<int32_t, float>(img, dst, orientation, rowBegin, rowEnd, chunkMin, chunkMax);
+        break;
+      case CV_32F:
+        transformPixelsImpl<float, float>(img, dst, orientation, rowBegin, rowEnd, chunkMin, chunkMax);
+        break;
+      default:
+        transformPixelsImpl<double, float>(img, dst, orientation, rowBegin, rowEnd, chunkMin, chunkMax);
+        break;
+    }
+  },
+                  minValue, maxValue);
+
+  img = dst;
+}
+
+template <typename F>
+void ImagingUtil::forEachRowChunk(const cv::Mat& img, int rowAlignment, const ThreadPool_t& threadPool, F&& func, double& minValue, double& maxValue) {
+  // Rows of about Common::PARALLEL_CHUNK_VALUES values in each chunk
+  const int64_t rowValues = std::max(static_cast<int64_t>(img.cols) * img.channels(), static_cast<int64_t>(1));
+  const int64_t chunkRows = std::max(static_cast<int64_t>(Common::PARALLEL_CHUNK_VALUES) / rowValues, static_cast<int64_t>(1));
+  const int grainSize = static_cast<int>((chunkRows + rowAlignment - 1) / rowAlignment * rowAlignment);
+
+  minValue = std::numeric_limits<double>::infinity();
+  maxValue = -std::numeric_limits<double>::infinity();
+
+  if (threadPool == nullptr || img.rows <= grainSize) {
+    func(0, img.rows, minValue, maxValue);
+  } else {
+    // Each chunk has its own range, merged after all the chunks are done
+    const int numChunks = (img.rows + grainSize - 1) / grainSize;
+    std::vector<double> chunkMinValues(numChunks, std::numeric_limits<double>::infinity());
+    std::vector<double> chunkMaxValues(numChunks, -std::numeric_limits<double>::infinity());
+
+    threadPool->parallelFor(0, img.rows, grainSize, [&](int rowBegin, int rowEnd) {
+      const int chunk = rowBegin / grainSize;
+      func(rowBegin, rowEnd, chunkMinValues[chunk], chunkMaxValues[chunk]);
+    },
+                            ThreadPool::getCurrentPriority());
+
+    for (int chunk = 0; chunk < numChunks; ++chunk) {
+      minValue = std::min(minValue, chunkMinValues[chunk]);
+      maxValue = std::max(maxValue, chunkMaxValues[chunk]);
+    }
+  }
+
+  if (minValue > maxValue) {
+    minValue = 0.0;  // All NaN
+    maxValue = 0.0;
+  }
+}
+
+template <typename SrcT, typename DstT>
+void ImagingUtil::transformPixelsImpl(const cv::Mat& src, cv::Mat& dst, int orientation, int rowBegin, int rowEnd, double& minValue, double& maxValue) {
+  switch (src.channels()) {
+    case 1:
+      transformPixelsKernel<SrcT, DstT, 1>(src, dst, orientation, rowBegin, rowEnd, minValue, maxValue);
+      break;
+    case 3:
+      transformPixelsKernel<SrcT, DstT, 3>(src, dst, orientation, rowBegin, rowEnd, minValue, maxValue);
+      break;
+    case 4:
+      transformPixelsKernel<SrcT, DstT, 4>(src, dst, orientation, rowBegin, rowEnd, minValue, maxValue);
+      break;
+    default:
+      throw std::runtime_error("Unsupported number of channels.");
+  }
+}
+
+template <typename SrcT, typename DstT, int CN>
+void ImagingUtil::transformPixelsKernel(const cv::Mat& src, cv::Mat& dst, int orientation, int rowBegin, int rowEnd, double& minValue, double& maxValue) {
+  const int width = src.cols;
+  const int height = src.rows;
+  const ptrdiff_t dstRowStep = static_cast<ptrdiff_t>(dst.step[0] / sizeof(DstT));
+
+  // The destination of the source pixel (0, 0), and the steps in the destination along the x and y axes of the source
+  int originX = 0;
+  int originY = 0;
+  ptrdiff_t stepX = CN;
+  ptrdiff_t stepY = dstRowStep;
+
+  switch (orientation) {
+    case 2:
+      originX = width - 1;
+      stepX = -CN;
+      break;
+    case 3:
+      originX = width - 1;
+      originY = height - 1;
+      stepX = -CN;
+      stepY = -dstRowStep;
+      break;
+    case 4:
+      originY = height - 1;
+      stepY = -dstRowStep;
+      break;
+    case 5:
+      stepX = dstRowStep;
+      stepY = CN;
+      break;
+    case 6:
+      originX = height - 1;
+      stepX = dstRowStep;
+      stepY = -CN;
+      break;
+    case 7:
+      originX = height - 1;
+      originY = width - 1;
+      stepX = -dstRowStep;
+      stepY = -CN;
+      break;
+    case 8:
+      originY = width - 1;
+      stepX = -dstRowStep;
+      stepY = CN;
+      break;
+    default:
+      break;
+  }
+
+  DstT* origin = dst.ptr<DstT>(originY) + static_cast<ptrdiff_t>(originX) * CN;
+
+  // A row of the source is written to a row of the destination unless the image is rotated by 90 degrees.
+  // Otherwise, it is written to a column, and the source is processed in tiles so that the destination rows stay in the cache.
+  const bool isRowToRow = stepX == CN || stepX == -CN;
+  const int tileWidth = isRowToRow ? width : Common::PIXEL_TRANSPOSE_TILE_SIZE;
+  const int tileHeight = isRowToRow ? height : Common::PIXEL_TRANSPOSE_TILE_SIZE;
+
+  DstT minV = std::numeric_limits<DstT>::max();
+  DstT maxV = std::numeric_limits<DstT>::lowest();
+
+  for (int tileY = rowBegin; tileY < rowEnd; tileY += tileHeight) {
+    const int tileYEnd = std::min(tileY + tileHeight, rowEnd);
+
+    for (int tileX = 0; tileX < width; tileX += tileWidth) {
+      const int tileXEnd = std::min(tileX + tileWidth, width);
+
+      for (int y = tileY; y < tileYEnd; ++y) {
+        const SrcT* s = src.ptr<SrcT>(y) + static_cast<ptrdiff_t>(tileX) * CN;
+        DstT* d = origin + y * stepY + tileX * stepX;
+
+        if (stepX == CN) {
+          // Both are contiguous. The compiler vectorizes this loop.
+          const int numValues = (tileXEnd - tileX) * CN;
+          for (int i = 0; i < numValues; ++i) {
+            const DstT value = static_cast<DstT>(s[i]);
+            d[i] = value;
+            minV = value < minV ? value : minV;  // NOTE: NaN is ignored
+            maxV = value > maxV ? value : maxV;
+          }
+        } else {
+          for (int x = tileX; x < tileXEnd; ++x, s += CN, d += stepX) {
+            for (int c = 0; c < CN; ++c) {
+              const DstT value = static_cast<DstT>(s[c]);
+              d[c] = value;
+              minV = value < minV ? value : minV;
+              maxV = value > maxV ? value : maxV;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  if (minV <= maxV) {
+    minValue = static_cast<double>(minV);
+    maxValue = static_cast<double>(maxV);
+  }
+}
+
+template <typename T>
+void ImagingUtil::computeValueRange(const cv::Mat& img, int rowBegin, int rowEnd, double& minValue, double& maxValue) {
+  const size_t numValues = static_cast<size_t>(img.cols) * img.channels();
+
+  T minV = std::numeric_limits<T>::max();
+  T maxV = std::numeric_limits<T>::lowest();
+
+  for (int y = rowBegin; y < rowEnd; ++y) {
+    const T* row = img.ptr<T>(y);
+
+    // The compiler vectorizes this loop
+    for (size_t i = 0; i < numValues; ++i) {
+      minV = row[i] < minV ? row[i] : minV;  // NOTE: NaN is ignored
+      maxV = row[i] > maxV ? row[i] : maxV;
+    }
+  }
+
+  if (minV <= maxV) {
+    minValue = static_cast<double>(minV);
+    maxValue = static_cast<double>(maxV);
+  }
+}
+
+std::vector<cv::Mat> ImagingUtil::buildMipLevels(const cv::Mat& img) {
+  std::vector<cv::Mat> mipLevels;
+  if (img.empty()) {
+    return mipLevels;
+  }
+
+  // NOTE: OpenCV averages the 2x2 blocks with SIMD, split across the workers of the pool by the parallel backend
+  cv::Mat previous = img;
+  while (previous.cols > 1 || previous.rows > 1) {
+    cv::Mat next;
+    cv::resize(previous, next, cv::Size(std::max(previous.cols / 2, 1), std::max(previous.rows / 2, 1)), 0.0, 0.0, cv::INTER_AREA);
+    mipLevels.push_back(next);
+    previous = next;
+  }
+
+  return mipLevels;
+}
+
+cv::Mat ImagingUtil::decodeImage(const MappedFile& file, int flags) {
+  const uint8_t* data = file.getData();
+  const size_t size = file.getSize();
+
+  // NOTE: OpenCV decodes OpenEXR only from a file, and cv::imdecode() would write the content to a temporary file.
+  //       A buffer beyond the int range of cv::Mat does not fit in cv::imdecode() either.
+  const bool isExr = size >= 4 && data[0] == 0x76 && data[1] == 0x2F && data[2] == 0x31 && data[3] == 0x01;
+  if (isExr || size > static_cast<size_t>(std::numeric_limits<int>::max())) {
+    return cv::imread(FileUtil::pathToString(file.getPath()), flags);
+  }
+
+  if (size == 0) {
+    return cv::Mat();
+  }
+
+  // Wrap the content without copying
+  const cv::Mat buffer(1, static_cast<int>(size), CV_8UC1, const_cast<uint8_t*>(data));
+  return cv::imdecode(buffer, flags);
+}
+
+bool ImagingUtil::mapRawImage(const MappedFile_t& file, ImageData& imageData) {
+  const uint8_t* data = file->getData();
+  const size_t size = file->getSize();
+
+  if (size < 8) {
+    return false;
+  }
+
+  // Identify the format by the magic bytes
+  if (data[0] == 'P' && (data[1] == '5' || data[1] == '6')) {
+    return mapNetpbm(file, imageData);
+  }
+  if (data[0] == 'P' && (data[1] == 'F' || data[1] == 'f')) {
+    return mapPfm(file, imageData);
+  }
+  if (data[0] == 'B' && data[1] == 'M') {
+    return mapBmp(file, imageData);
+  }
+  if ((data[0] == 'I' && data[1] == 'I' && data[2] == 42 && data[3] == 0) ||
+      (data[0] == 'M' && data[1] == 'M' && data[2] == 0 && data[3] == 42)) {
+    return mapTiff(file, imageData);
+  }
+  if (std::memcmp(data, "\x93NUMPY", 6) == 0) {
+    return mapNpy(file, imageData);
+  }
+
+  return false;
+}
+
+int ImagingUtil::readOrientation(const MappedFile& file) {
+  // Parse the EXIF and XMP metadata of JPEG files
+  const auto length = static_cast<unsigned>(std::min<size_t>(file.getSize(), std::numeric_limits<unsigned>::max()));
+  TinyEXIF::EXIFInfo imageEXIF(file.getData(), length);
+  if (imageEXIF.Fields) {
+    return imageEXIF.Orientation;
+  }
+
+  // TinyEXIF parses only JPEG files. TIFF files have the orientation in IFD0.
+  EmbeddedPreviewInfo info;
+  if (const auto tiffOffset = findTiffHeader(file); tiffOffset && *tiffOffset == 0 && parseTiffStructure(file, 0, info)) {
+    return info.orientation;
+  }
+
+  return 1;
+}
 
-  if (!ifs) {
-    std::cerr << "Error opening file: " << FileUtil::pathToString(filePath) << std::endl;
-    return img;  // Return the original image if the file cannot be opened
+std::optional<ImageInfo> ImagingUtil::probeJpeg(const MappedFile& file) {
+  const uint8_t* data = file.getData();
+  const size_t size = file.getSize();
+
+  // SOI marker
+  if (size < 2 || data[0] != 0xFF || data[1] != 0xD8) {
+    return std::nullopt;
+  }
+
+  size_t pos = 2;
+
+  for (;;) {
+    if (pos >= size || data[pos] != 0xFF) {
+      return std::nullopt;  // Broken segment
+    }
+
+    // Skip the fill bytes
+    while (pos < size && data[pos] == 0xFF) {
+      ++pos;
+    }
+    if (pos >= size) {
+      return std::nullopt;
+    }
+
+    const uint8_t marker = data[pos++];
+
+    if (marker == 0xD9 || marker == 0xDA) {
+      return std::nullopt;  // No SOF before EOI or SOS
+    }
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+      continue;  // Markers without a segment
+    }
+
+    if (pos + 2 > size) {
+      return std::nullopt;
+    }
+    const size_t length = (data[pos] << 8) | data[pos + 1];
+    if (length < 2) {
+      return std::nullopt;
+    }
+
+    // SOF0-SOF15 except DHT (0xC4), JPG (0xC8) and DAC (0xCC)
+    if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+      // Sample precision (1 byte), height (2 bytes), width (2 bytes) and number of components (1 byte) after the length
+      if (pos + 8 > size) {
+        return std::nullopt;
+      }
+
+      ImageInfo info;
+      info.size = cv::Size((data[pos + 5] << 8) | data[pos + 6], (data[pos + 3] << 8) | data[pos + 4]);
+      info.channels = data[pos + 7] == 1 ? 1 : 3;  // Decoded to BGR except grayscale
+      info.depth = CV_8U;
+      info.orientation = readOrientation(file);
+      return info;
+    }
+
+    pos += length;
+  }
+}
+
+std::optional<ImageInfo> ImagingUtil::probePng(const MappedFile& file) {
+  const uint8_t* data = file.getData();
+
+  // The signature followed by the IHDR chunk
+  static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  if (file.getSize() < 33 || std::memcmp(data, signature, 8) != 0 || std::memcmp(data + 12, "IHDR", 4) != 0) {
+    return std::nullopt;
   }
 
-  // parse image EXIF and XMP metadata
-  TinyEXIF::EXIFInfo imageEXIF(ifs);
-  if (!imageEXIF.Fields) {
-    std::cerr << "No EXIF data found in file: " << FileUtil::pathToString(filePath) << std::endl;
-    return img;  // Return the original image if no EXIF data is found
+  const auto width = readTiffInteger(file, 16, 4, false);
+  const auto height = readTiffInteger(file, 20, 4, false);
+  if (!width || !height || *width == 0 || *height == 0 ||
+      *width > static_cast<uint32_t>(std::numeric_limits<int>::max()) || *height > static_cast<uint32_t>(std::numeric_limits<int>::max())) {
+    return std::nullopt;
+  }
+
+  const uint8_t bitDepth = data[24];
+  const uint8_t colorType = data[25];
+
+  // Gray (0), RGB (2), palette (3), gray with alpha (4) and RGBA (6). OpenCV decodes the gray with alpha to BGRA.
+  // NOTE: A palette with transparency in the tRNS chunk is decoded to BGRA, which is not known from the header.
+  ImageInfo info;
+  info.size = cv::Size(static_cast<int>(*width), static_cast<int>(*height));
+  info.channels = colorType == 0 ? 1 : ((colorType == 4 || colorType == 6) ? 4 : 3);
+  info.depth = bitDepth == 16 ? CV_16U : CV_8U;
+  info.orientation = 1;
+  return info;
+}
+
+std::optional<ImageInfo> ImagingUtil::probeTiff(const MappedFile& file) {
+  TiffImageHeader header;
+  if (!parseTiffImageHeader(file, header)) {
+    return std::nullopt;
   }
 
-  // Get the orientation from EXIF data
-  // uint16_t Orientation;               // Image orientation, start of data corresponds to
-  //                                     // 0: unspecified in EXIF data
-  //                                     // 1: upper left of image
-  //                                     // 3: lower right of image
-  //                                     // 6: upper right of image
-  //                                     // 8: lower left of image
-  //                                     // 9: undefined
+  // The depths that cannot be uploaded as they are turn into float32 after decoding
+  int depth = getTiffDepth(header);
+  if (depth < 0) {
+    depth = header.bitsPerSample > 8 ? CV_16U : CV_8U;
+  } else if (depth != CV_8U && depth != CV_16U) {
+    depth = CV_32F;
+  }
+
+  ImageInfo info;
+  info.size = cv::Size(static_cast<int>(header.width), static_cast<int>(header.height));
+  info.channels = header.samplesPerPixel == 1 ? 1 : (header.samplesPerPixel == 3 ? 3 : 4);
+  info.depth = depth;
+  info.orientation = header.orientation >= 1 && header.orientation <= 8 ? static_cast<int>(header.orientation) : 1;
+  return info;
+}
+
+std::optional<ImageInfo> ImagingUtil::probeExr(const MappedFile& file) {
+  const uint8_t* data = file.getData();
+  const size_t size = file.getSize();
+
+  // The magic number and the version, followed by the attributes of the header, each of which is
+  // the name and the type as null-terminated strings, the size (4 bytes) and the value. An empty name ends the header.
+  if (size < 8 || data[0] != 0x76 || data[1] != 0x2F || data[2] != 0x31 || data[3] != 0x01) {
+    return std::nullopt;
+  }
+
+  const auto readString = [&](size_t& pos) -> std::optional<std::string_view> {
+    const size_t start = pos;
+    while (pos < size && data[pos] != 0) {
+      if (pos - start >= 255) {
+        return std::nullopt;
+      }
+      ++pos;
+    }
+    if (pos >= size) {
+      return std::nullopt;
+    }
+    return std::string_view(reinterpret_cast<const char*>(data + start), pos++ - start);
+  };
+
+  std::optional<cv::Size> imageSize;
+  bool hasColor = false;
+  bool hasAlpha = false;
+
+  size_t pos = 8;
+  for (;;) {
+    const auto name = readString(pos);
+    if (!name) {
+      return std::nullopt;
+    }
+    if (name->empty()) {
+      break;  // End of the header
+    }
+
+    const auto type = readString(pos);
+    const auto attributeSize = readTiffInteger(file, pos, 4, true);
+    if (!type || !attributeSize || pos + 4 + *attributeSize > size) {
+      return std::nullopt;
+    }
+    pos += 4;
+
+    if (*name == "dataWindow" && *type == "box2i" && *attributeSize == 16) {
+      // xMin, yMin, xMax and yMax
+      const auto xMin = static_cast<int32_t>(*readTiffInteger(file, pos, 4, true));
+      const auto yMin = static_cast<int32_t>(*readTiffInteger(file, pos + 4, 4, true));
+      const auto xMax = static_cast<int32_t>(*readTiffInteger(file, pos + 8, 4, true));
+      const auto yMax = static_cast<int32_t>(*readTiffInteger(file, pos + 12, 4, true));
+      const int64_t width = static_cast<int64_t>(xMax) - xMin + 1;
+      const int64_t height = static_cast<int64_t>(yMax) - yMin + 1;
+      if (width <= 0 || height <= 0 || width > std::numeric_limits<int>::max() || height > std::numeric_limits<int>::max()) {
+        return std::nullopt;
+      }
+      imageSize = cv::Size(static_cast<int>(width), static_cast<int>(height));
+    } else if (*name == "channels" && *type == "chlist") {
+      // The name of each channel followed by its pixel type, linearity, sampling and reserved bytes (16 bytes)
+      size_t channelPos = pos;
+      while (channelPos < pos + *attributeSize) {
+        const auto channelName = readString(channelPos);
+        if (!channelName || channelName->empty()) {
+          break;
+        }
+        hasColor = hasColor || *channelName == "R" || *channelName == "G" || *channelName == "B";
+        hasAlpha = hasAlpha || *channelName == "A";
+        channelPos += 16;
+      }
+    }
+
+    pos += *attributeSize;
+  }
+
+  if (!imageSize) {
+    return std::nullopt;
+  }
+
+  // OpenCV decodes the half and float channels to float32 in BGR(A), or gray for the luminance only
+  ImageInfo info;
+  info.size = *imageSize;
+  info.channels = hasColor ? (hasAlpha ? 4 : 3) : 1;
+  info.depth = CV_32F;
+  info.orientation = 1;
+  return info;
+}
+
+bool ImagingUtil::readEmbeddedPreview(const MappedFile& file, ImageData& preview) {
+  const auto tiffOffset = findTiffHeader(file);
+  if (!tiffOffset) {
+    return false;
+  }
 
-  if (imageEXIF.Orientation == 3) {
-    cv::Mat rotatedImg;
-    cv::rotate(img, rotatedImg, cv::ROTATE_180);
-    return rotatedImg;
-  } else if (imageEXIF.Orientation == 6) {
-    cv::Mat rotatedImg;
-    cv::rotate(img, rotatedImg, cv::ROTATE_90_CLOCKWISE);
-    return rotatedImg;
-  } else if (imageEXIF.Orientation == 8) {
-    cv::Mat rotatedImg;
-    cv::rotate(img, rotatedImg, cv::ROTATE_90_COUNTERCLOCKWISE);
-    return rotatedImg;
+  EmbeddedPreviewInfo info;
+  if (!parseTiffStructure(file, *tiffOffset, info) || info.length == 0) {
+    return false;
   }
 
-  return img;  // Return the original image if no rotation is needed
-}
\ No newline at end of file
+  if (info.offset > file.getSize() || info.length > file.getSize() - info.offset) {
+    return false;  // Truncated file
+  }
+
+  // Decode only the bytes of the preview, without copying them
+  const cv::Mat buffer(1, static_cast<int>(info.length), CV_8UC1, const_cast<uint8_t*>(file.getData() + info.offset));
+
+  cv::Mat image;
+  try {
+    // NOTE: The preview has no EXIF of its own. The orientation of the main image applies.
+    image = cv::imdecode(buffer, cv::IMREAD_COLOR | cv::IMREAD_IGNORE_ORIENTATION);
+  } catch (const cv::Exception&) {
+    return false;
+  }
+
+  if (image.empty()) {
+    return false;
+  }
+
+  preview = ImageData(image, file.getPath());
+  preview.orientation = info.orientation;
+  preview.channelOrder = ChannelOrder::BGR;
+  preview.minValue = 0.0;
+  preview.maxValue = 255.0;
+  preview.isPreview = true;
+
+  return true;
+}
+
+std::optional<size_t> ImagingUtil::findTiffHeader(const MappedFile& file) {
+  const uint8_t* data = file.getData();
+  const size_t size = file.getSize();
+
+  if (size < 4) {
+    return std::nullopt;
+  }
+
+  // A TIFF file starts with the TIFF header
+  if ((data[0] == 'I' && data[1] == 'I' && data[2] == 42 && data[3] == 0) ||
+      (data[0] == 'M' && data[1] == 'M' && data[2] == 0 && data[3] == 42)) {
+    return 0;
+  }
+
+  // A JPEG file has the TIFF header in the APP1 segment after "Exif\0\0"
+  if (data[0] != 0xFF || data[1] != 0xD8) {
+    return std::nullopt;
+  }
+
+  size_t pos = 2;
+
+  for (;;) {
+    if (pos >= size || data[pos] != 0xFF) {
+      return std::nullopt;
+    }
+
+    while (pos < size && data[pos] == 0xFF) {
+      ++pos;
+    }
+    if (pos >= size) {
+      return std::nullopt;
+    }
+
+    const uint8_t marker = data[pos++];
+
+    if (marker == 0xD9 || marker == 0xDA) {
+      return std::nullopt;  // No EXIF before EOI or SOS
+    }
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+      continue;  // Markers without a segment
+    }
+
+    if (pos + 2 > size) {
+      return std::nullopt;
+    }
+    const size_t length = (data[pos] << 8) | data[pos + 1];
+    if (length < 2) {
+      return std::nullopt;
+    }
+
+    const size_t segmentOffset = pos + 2;
+
+    if (marker == 0xE1 && length >= 8 && segmentOffset + 6 <= size && std::memcmp(data + segmentOffset, "Exif\0\0", 6) == 0) {
+      return segmentOffset + 6;
+    }
+
+    // There may be other APP1 segments such as XMP
+    pos += length;
+  }
+}
+
+bool ImagingUtil::parseTiffStructure(const MappedFile& file, size_t tiffOffset, EmbeddedPreviewInfo& info) {
+  // https://www.cipa.jp/std/documents/e/DC-008-2012_E.pdf
+  const uint8_t* data = file.getData();
+
+  if (tiffOffset + 2 > file.getSize() || data[tiffOffset] != data[tiffOffset + 1] || (data[tiffOffset] != 'I' && data[tiffOffset] != 'M')) {
+    return false;
+  }
+  const bool isLittleEndian = data[tiffOffset] == 'I';
+
+  if (readTiffInteger(file, tiffOffset + 2, 2, isLittleEndian) != 42u) {
+    return false;
+  }
+
+  struct Ifd {
+    std::optional<uint32_t> orientation;
+    std::optional<uint32_t> subfileType;
+    std::optional<uint32_t> compression;
+    std::optional<uint32_t> jpegOffset;
+    std::optional<uint32_t> jpegLength;
+    std::optional<uint32_t> stripOffset;
+    std::optional<uint32_t> stripByteCount;
+    std::vector<uint32_t> subIfdOffsets;
+    uint32_t nextIfdOffset = 0;
+  };
+
+  const auto parseIfd = [&](uint32_t ifdOffset) -> std::optional<Ifd> {
+    const auto numEntries = readTiffInteger(file, tiffOffset + ifdOffset, 2, isLittleEndian);
+    if (!numEntries || *numEntries > 4096) {
+      return std::nullopt;
+    }
+
+    Ifd ifd;
+
+    for (uint32_t i = 0; i < *numEntries; ++i) {
+      // Tag (2 bytes), type (2 bytes), count (4 bytes) and the value or the offset to it (4 bytes)
+      const size_t entryOffset = tiffOffset + ifdOffset + 2 + 12 * i;
+      const auto tag = readTiffInteger(file, entryOffset, 2, isLittleEndian);
+      const auto type = readTiffInteger(file, entryOffset + 2, 2, isLittleEndian);
+      const auto count = readTiffInteger(file, entryOffset + 4, 4, isLittleEndian);
+      if (!tag || !type || !count) {
+        return std::nullopt;
+      }
+
+      // SHORT or LONG (and IFD for the SubIFDs)
+      const int valueSize = *type == 3 ? 2 : ((*type == 4 || *type == 13) ? 4 : 0);
+      if (valueSize == 0 || *count == 0) {
+        continue;
+      }
+
+      // Only the first value is needed except for the SubIFDs
+      const auto value = readTiffInteger(file, entryOffset + 8, valueSize, isLittleEndian);
+
+      switch (*tag) {
+        case 0x00FE:  // NewSubfileType
+          ifd.subfileType = value;
+          break;
+        case 0x0103:  // Compression
+          ifd.compression = value;
+          break;
+        case 0x0111:  // StripOffsets
+          if (*count == 1) {
+            ifd.stripOffset = value;
+          }
+          break;
+        case 0x0112:  // Orientation
+          ifd.orientation = value;
+          break;
+        case 0x0117:  // StripByteCounts
+          if (*count == 1) {
+            ifd.stripByteCount = value;
+          }
+          break;
+        case 0x014A:  // SubIFDs
+          if (valueSize == 4) {
+            const uint32_t numSubIfds = std::min<uint32_t>(*count, 16);
+            const size_t arrayOffset = *count == 1 ? entryOffset + 8 : tiffOffset + readTiffInteger(file, entryOffset + 8, 4, isLittleEndian).value_or(0);
+            for (uint32_t j = 0; j < numSubIfds; ++j) {
+              if (const auto subIfdOffset = readTiffInteger(file, arrayOffset + 4 * j, 4, isLittleEndian)) {
+                ifd.subIfdOffsets.push_back(*subIfdOffset);
+              }
+            }
+          }
+          break;
+        case 0x0201:  // JPEGInterchangeFormat
+          ifd.jpegOffset = value;
+          break;
+        case 0x0202:  // JPEGInterchangeFormatLength
+          ifd.jpegLength = value;
+          break;
+        default:
+          break;
+      }
+    }
+
+    ifd.nextIfdOffset = readTiffInteger(file, tiffOffset + ifdOffset + 2 + 12 * *numEntries, 4, isLittleEndian).value_or(0);
+    return ifd;
+  };
+
+  // Take the largest preview that is still small enough to decode in no time
+  const auto addCandidate = [&](std::optional<uint32_t> offset, std::optional<uint32_t> length) {
+    if (offset && length && *length > info.length && *length <= Common::EMBEDDED_PREVIEW_MAX_BYTES) {
+      info.offset = tiffOffset + *offset;
+      info.length = *length;
+    }
+  };
+
+  const auto ifd0 = readTiffInteger(file, tiffOffset + 4, 4, isLittleEndian);
+  if (!ifd0) {
+    return false;
+  }
+
+  const auto mainIfd = parseIfd(*ifd0);
+  if (!mainIfd) {
+    return false;
+  }
+
+  info.orientation = static_cast<int>(mainIfd->orientation.value_or(1));
+
+  // Reduced-resolution images in the SubIFDs of TIFF and raw files
+  for (const uint32_t subIfdOffset : mainIfd->subIfdOffsets) {
+    if (const auto subIfd = parseIfd(subIfdOffset); subIfd && subIfd->subfileType.value_or(0) == 1) {
+      addCandidate(subIfd->jpegOffset, subIfd->jpegLength);
+      if (subIfd->compression == 7u || subIfd->compression == 6u) {
+        addCandidate(subIfd->stripOffset, subIfd->stripByteCount);
+      }
+    }
+  }
+
+  // Thumbnail in IFD1
+  if (mainIfd->nextIfdOffset != 0) {
+    if (const auto thumbnailIfd = parseIfd(mainIfd->nextIfdOffset)) {
+      addCandidate(thumbnailIfd->jpegOffset, thumbnailIfd->jpegLength);
+    }
+  }
+
+  return true;
+}
+
+std::optional<uint32_t> ImagingUtil::readTiffInteger(const MappedFile& file, size_t offset, int numBytes, bool isLittleEndian) {
+  if (offset > file.getSize() || static_cast<size_t>(numBytes) > file.getSize() - offset) {
+    return std::nullopt;
+  }
+
+  const uint8_t* bytes = file.getData() + offset;
+
+  uint32_t value = 0;
+  for (int i = 0; i < numBytes; ++i) {
+    const int shift = isLittleEndian ? 8 * i : 8 * (numBytes - 1 - i);
+    value |= static_cast<uint32_t>(bytes[i]) << shift;
+  }
+  return value;
+}
+
+bool ImagingUtil::mapNetpbm(const MappedFile_t& file, ImageData& imageData) {
+  // "P5" (gray) or "P6" (RGB), the width, the height and the maximum value in ASCII, then a single whitespace before the binary pixels
+  const bool isRGB = file->getData()[1] == '6';
+
+  size_t pos = 2;
+  int values[3] = {};
+  for (int& value : values) {
+    const auto token = readHeaderToken(*file, pos);
+    if (!token || std::from_chars(token->data(), token->data() + token->size(), value).ec != std::errc() || value <= 0) {
+      return false;
+    }
+  }
+
+  const auto [width, height, maxValue] = values;
+  if (maxValue > 65535) {
+    return false;
+  }
+
+  // NOTE: The samples of more than 8 bits are big-endian
+  const int channels = isRGB ? 3 : 1;
+  const int depth = maxValue < 256 ? CV_8U : CV_16U;
+  const size_t step = static_cast<size_t>(width) * channels * CV_ELEM_SIZE1(depth);
+  if (!wrapPixels(file, pos + 1, height, width, CV_MAKETYPE(depth, channels), step, false, imageData)) {
+    return false;
+  }
+
+  imageData.channelOrder = ChannelOrder::RGB;
+  imageData.orientation = 1;
+  return true;
+}
+
+bool ImagingUtil::mapPfm(const MappedFile_t& file, ImageData& imageData) {
+  // "PF" (RGB) or "Pf" (gray), the width, the height and the scale in ASCII, then a single whitespace before the float32 pixels.
+  // The sign of the scale tells the byte order, negative for little-endian.
+  const bool isRGB = file->getData()[1] == 'F';
+
+  size_t pos = 2;
+  int size[2] = {};
+  for (int& value : size) {
+    const auto token = readHeaderToken(*file, pos);
+    if (!token || std::from_chars(token->data(), token->data() + token->size(), value).ec != std::errc() || value <= 0) {
+      return false;
+    }
+  }
+
+  const auto scaleToken = readHeaderToken(*file, pos);
+  if (!scaleToken) {
+    return false;
+  }
+
+  const double scale = std::strtod(scaleToken->c_str(), nullptr);
+  if (scale == 0.0 || !std::isfinite(scale)) {
+    return false;
+  }
+
+  const auto [width, height] = size;
+  const int channels = isRGB ? 3 : 1;
+  const size_t step = static_cast<size_t>(width) * channels * sizeof(float);
+  if (!wrapPixels(file, pos + 1, height, width, CV_MAKETYPE(CV_32F, channels), step, scale < 0.0, imageData)) {
+    return false;
+  }
+
+  imageData.channelOrder = ChannelOrder::RGB;
+  imageData.orientation = 4;  // The rows are stored bottom to top
+  return true;
+}
+
+bool ImagingUtil::mapBmp(const MappedFile_t& file, ImageData& imageData) {
+  // BITMAPFILEHEADER (14 bytes) followed by BITMAPINFOHEADER or a later version. All the fields are little-endian.
+  const auto pixelOffset = readTiffInteger(*file, 10, 4, true);
+  const auto headerSize = readTiffInteger(*file, 14, 4, true);
+  const auto width = readTiffInteger(*file, 18, 4, true);
+  const auto height = readTiffInteger(*file, 22, 4, true);
+  const auto bitCount = readTiffInteger(*file, 28, 2, true);
+  const auto compression = readTiffInteger(*file, 30, 4, true);
+  const auto numColors = readTiffInteger(*file, 46, 4, true);
+  if (!pixelOffset || !headerSize || !width || !height || !bitCount || !compression || !numColors) {
+    return false;
+  }
+
+  // Only BI_RGB. The 32-bit pixels are left to the decoder, since the fourth byte is not necessarily an alpha.
+  if (*headerSize < 40 || *compression != 0 || (*bitCount != 8 && *bitCount != 24)) {
+    return false;
+  }
+
+  const int64_t signedWidth = static_cast<int32_t>(*width);
+  const int64_t signedHeight = static_cast<int32_t>(*height);  // Negative for the rows stored top to bottom
+  if (signedWidth <= 0 || signedHeight == 0 || std::abs(signedHeight) > std::numeric_limits<int>::max()) {
+    return false;
+  }
+
+  if (*bitCount == 8) {
+    // The palette has to be the identity of gray levels to refer to the indices as the pixels
+    const uint32_t paletteSize = *numColors == 0 ? 256u : *numColors;
+    if (paletteSize > 256) {
+      return false;
+    }
+
+    const size_t paletteOffset = 14 + static_cast<size_t>(*headerSize);
+    for (uint32_t i = 0; i < paletteSize; ++i) {
+      const auto entry = readTiffInteger(*file, paletteOffset + 4 * i, 3, true);  // B, G and R
+      if (!entry || *entry != i * 0x010101u) {
+        return false;
+      }
+    }
+  }
+
+  // The rows are padded to 4 bytes
+  const int channels = *bitCount / 8;
+  const size_t step = ((static_cast<size_t>(signedWidth) * *bitCount + 31) / 32) * 4;
+  if (!wrapPixels(file, *pixelOffset, static_cast<int>(std::abs(signedHeight)), static_cast<int>(signedWidth), CV_MAKETYPE(CV_8U, channels), step, true, imageData)) {
+    return false;
+  }
+
+  imageData.channelOrder = ChannelOrder::BGR;
+  imageData.orientation = signedHeight > 0 ? 4 : 1;
+  return true;
+}
+
+bool ImagingUtil::mapTiff(const MappedFile_t& file, ImageData& imageData) {
+  // Classic TIFF with the uncompressed, chunky pixels in strips following each other. The strips of tiled or compressed files are left to the decoder.
+  TiffImageHeader header;
+  if (!parseTiffImageHeader(*file, header)) {
+    return false;
+  }
+
+  if (header.isTiled || header.compression != 1 || header.rowsPerStrip == 0 || (header.planarConfig != 1 && header.samplesPerPixel != 1) || header.stripOffsetsCount == 0) {
+    return false;
+  }
+
+  // Gray with BlackIsZero, or RGB(A)
+  const bool isGray = header.photometric == 1 && header.samplesPerPixel == 1;
+  const bool isRGB = header.photometric == 2 && (header.samplesPerPixel == 3 || header.samplesPerPixel == 4);
+  const int depth = getTiffDepth(header);
+  if ((!isGray && !isRGB) || depth < 0) {
+    return false;
+  }
+
+  // The strips have to follow each other without gaps to be referred to as a single image
+  const uint32_t rowsPerStrip = std::min(header.rowsPerStrip, header.height);
+  const size_t step = static_cast<size_t>(header.width) * header.samplesPerPixel * (header.bitsPerSample / 8);
+  const uint64_t stripSize = static_cast<uint64_t>(rowsPerStrip) * step;
+  const uint32_t numStrips = static_cast<uint32_t>((static_cast<uint64_t>(header.height) + rowsPerStrip - 1) / rowsPerStrip);
+
+  const auto firstOffset = readTiffValue(*file, header.stripOffsetsEntry, header.stripOffsetsType, header.stripOffsetsCount, 0, header.isLittleEndian);
+  if (!firstOffset || header.stripOffsetsCount != numStrips) {
+    return false;
+  }
+
+  for (uint32_t i = 1; i < numStrips; ++i) {
+    const auto offset = readTiffValue(*file, header.stripOffsetsEntry, header.stripOffsetsType, header.stripOffsetsCount, i, header.isLittleEndian);
+    if (!offset || *offset != *firstOffset + stripSize * i) {
+      return false;
+    }
+  }
+
+  const int type = CV_MAKETYPE(depth, header.samplesPerPixel);
+  if (!wrapPixels(file, *firstOffset, static_cast<int>(header.height), static_cast<int>(header.width), type, step, header.isLittleEndian, imageData)) {
+    return false;
+  }
+
+  imageData.channelOrder = ChannelOrder::RGB;
+  imageData.orientation = header.orientation >= 1 && header.orientation <= 8 ? static_cast<int>(header.orientation) : 1;
+  return true;
+}
+
+bool ImagingUtil::mapNpy(const MappedFile_t& file, ImageData& imageData) {
+  // The magic string, the version, the length of the header and the header as a Python dict literal, such as
+  // {'descr': '<f4', 'fortran_order': False, 'shape': (1080, 1920, 3), }
+  const uint8_t* data = file->getData();
+  const int majorVersion = data[6];
+
+  const auto headerLength = readTiffInteger(*file, 8, majorVersion == 1 ? 2 : 4, true);
+  const size_t headerOffset = majorVersion == 1 ? 10 : 12;
+  if (!headerLength || headerOffset + *headerLength > file->getSize()) {
+    return false;
+  }
+
+  const std::string_view header(reinterpret_cast<const char*>(data + headerOffset), *headerLength);
+
+  // Value following the key and the colon
+  const auto findValue = [&header](std::string_view key) -> std::string_view {
+    const size_t keyPos = header.find(key);
+    const size_t colonPos = keyPos == std::string_view::npos ? keyPos : header.find(':', keyPos + key.size());
+    const size_t valuePos = colonPos == std::string_view::npos ? colonPos : header.find_first_not_of(' ', colonPos + 1);
+    return valuePos == std::string_view::npos ? std::string_view() : header.substr(valuePos);
+  };
+
+  // The descriptor is the byte order ('<', '>', '|' or '='), the kind and the size in bytes, such as '<f4'
+  const std::string_view descrValue = findValue("'descr'");
+  if (descrValue.size() < 5 || descrValue[0] != '\'') {
+    return false;
+  }
+
+  const std::string_view descr = descrValue.substr(1, descrValue.find('\'', 1) - 1);
+  int valueSize = 0;
+  if (descr.size() < 3 || std::from_chars(descr.data() + 2, descr.data() + descr.size(), valueSize).ec != std::errc()) {
+    return false;
+  }
+
+  const char byteOrder = descr[0];
+  const char kind = descr[1];
+
+  int depth = -1;
+  if (kind == 'u' || kind == 'b') {
+    depth = valueSize == 1 ? CV_8U : (valueSize == 2 && kind == 'u' ? CV_16U : -1);
+  } else if (kind == 'i') {
+    depth = valueSize == 1 ? CV_8S : (valueSize == 2 ? CV_16S : (valueSize == 4 ? CV_32S : -1));
+  } else if (kind == 'f') {
+    depth = valueSize == 2 ? CV_16F : (valueSize == 4 ? CV_32F : (valueSize == 8 ? CV_64F : -1));
+  }
+
+  if (depth < 0 || (byteOrder != '<' && byteOrder != '>' && byteOrder != '|' && byteOrder != '=')) {
+    return false;
+  }
+
+  const bool isLittleEndian = byteOrder == '>' ? false : (byteOrder == '=' ? std::endian::native == std::endian::little : true);
+  const bool isFortranOrder = findValue("'fortran_order'").starts_with("True");
+
+  // (height, width) or (height, width, channels)
+  const std::string_view shapeValue = findValue("'shape'");
+  if (shapeValue.empty() || shapeValue[0] != '(') {
+    return false;
+  }
+
+  std::vector<int64_t> shape;
+  size_t pos = 1;
+  while (pos < shapeValue.size() && shapeValue[pos] != ')') {
+    if (shapeValue[pos] == ',' || shapeValue[pos] == ' ' || shapeValue[pos] == 'L') {
+      ++pos;
+      continue;
+    }
+
+    int64_t dim = 0;
+    const auto result = std::from_chars(shapeValue.data() + pos, shapeValue.data() + shapeValue.size(), dim);
+    if (result.ec != std::errc() || dim <= 0 || dim > std::numeric_limits<int>::max()) {
+      return false;
+    }
+
+    shape.push_back(dim);
+    pos = result.ptr - shapeValue.data();
+  }
+
+  const int channels = shape.size() == 3 ? static_cast<int>(shape[2]) : 1;
+  if ((shape.size() != 2 && shape.size() != 3) || (channels != 1 && channels != 3 && channels != 4)) {
+    return false;
+  }
+
+  // NOTE: A 2D array in the column-major order is the transpose in the row-major order, and is drawn transposed back
+  if (isFortranOrder && channels != 1) {
+    return false;
+  }
+
+  const int rows = static_cast<int>(isFortranOrder ? shape[1] : shape[0]);
+  const int cols = static_cast<int>(isFortranOrder ? shape[0] : shape[1]);
+  const size_t step = static_cast<size_t>(cols) * channels * valueSize;
+  if (!wrapPixels(file, headerOffset + *headerLength, rows, cols, CV_MAKETYPE(depth, channels), step, isLittleEndian, imageData)) {
+    return false;
+  }
+
+  imageData.channelOrder = ChannelOrder::RGB;
+  imageData.orientation = isFortranOrder ? 5 : 1;
+  return true;
+}
+
+bool ImagingUtil::wrapPixels(const MappedFile_t& file, size_t offset, int rows, int cols, int type, size_t step, bool isLittleEndian, ImageData& imageData) {
+  const size_t valueSize = CV_ELEM_SIZE1(type);
+  const size_t pixelSize = CV_ELEM_SIZE(type);
+  if (rows <= 0 || cols <= 0 || static_cast<size_t>(cols) > std::numeric_limits<size_t>::max() / pixelSize) {
+    return false;
+  }
+
+  const size_t rowSize = static_cast<size_t>(cols) * pixelSize;
+  if (step < rowSize || step % valueSize != 0) {
+    return false;
+  }
+
+  // NOTE: Compared without multiplying, since the sizes in a crafted header can wrap around
+  const size_t size = file->getSize();
+  if (offset > size || rowSize > size - offset || static_cast<size_t>(rows) - 1 > (size - offset - rowSize) / step) {
+    return false;  // Truncated file
+  }
+
+  cv::Mat pixels(rows, cols, type, const_cast<uint8_t*>(file->getData() + offset), step);
+
+  const bool isSwapped = valueSize > 1 && isLittleEndian != (std::endian::native == std::endian::little);
+  const bool isAligned = reinterpret_cast<uintptr_t>(pixels.data) % valueSize == 0 && step % CV_ELEM_SIZE(type) == 0;
+
+  imageData = ImageData();
+  imageData.path = file->getPath();
+
+  if (isSwapped) {
+    cv::Mat swapped(rows, cols, type);
+    switch (valueSize) {
+      case 2:
+        swapBytes<2>(pixels, swapped);
+        break;
+      case 4:
+        swapBytes<4>(pixels, swapped);
+        break;
+      default:
+        swapBytes<8>(pixels, swapped);
+        break;
+    }
+    imageData.image = swapped;
+  } else if (!isAligned) {
+    // NOTE: The values are read in place on the CPU, and the texture is uploaded with the row length in pixels
+    imageData.image = pixels.clone();
+  } else {
+    // No copy. The image refers to the mapped file, which is kept alive along with the image.
+    imageData.image = pixels;
+    imageData.mappedFile = file;
+  }
+
+  return true;
+}
+
+template <int N>
+void ImagingUtil::swapBytes(const cv::Mat& src, cv::Mat& dst) {
+  const size_t numValues = static_cast<size_t>(src.cols) * src.channels();
+
+  for (int y = 0; y < src.rows; ++y) {
+    const uint8_t* srcRow = src.ptr<uint8_t>(y);
+    uint8_t* dstRow = dst.ptr<uint8_t>(y);
+
+    for (size_t i = 0; i < numValues; ++i) {
+      for (int j = 0; j < N; ++j) {
+        dstRow[i * N + j] = srcRow[i * N + (N - 1 - j)];
+      }
+    }
+  }
+}
+
+std::optional<std::string> ImagingUtil::readHeaderToken(const MappedFile& file, size_t& pos) {
+  const uint8_t* data = file.getData();
+  const size_t size = file.getSize();
+
+  // Skip the whitespaces, and the comments up to the end of the line
+  while (pos < size && (std::isspace(data[pos]) || data[pos] == '#')) {
+    if (data[pos] == '#') {
+      while (pos < size && data[pos] != '\n' && data[pos] != '\r') {
+        ++pos;
+      }
+    } else {
+      ++pos;
+    }
+  }
+
+  const size_t start = pos;
+  while (pos < size && !std::isspace(data[pos])) {
+    if (pos - start >= 32) {
+      return std::nullopt;  // Not a header
+    }
+    ++pos;
+  }
+
+  // The token has to be followed by a whitespace
+  if (pos == start || pos >= size) {
+    return std::nullopt;
+  }
+
+  return std::string(reinterpret_cast<const char*>(data + start), pos - start);
+}
+
+bool ImagingUtil::parseTiffImageHeader(const MappedFile& file, TiffImageHeader& header) {
+  // Classic TIFF. IFD0 is the main image.
+  const uint8_t* data = file.getData();
+  if (file.getSize() < 8 || !((data[0] == 'I' && data[1] == 'I') || (data[0] == 'M' && data[1] == 'M'))) {
+    return false;
+  }
+
+  header = TiffImageHeader();
+  header.isLittleEndian = data[0] == 'I';
+
+  if (readTiffInteger(file, 2, 2, header.isLittleEndian) != 42u) {
+    return false;
+  }
+
+  const auto ifdOffset = readTiffInteger(file, 4, 4, header.isLittleEndian);
+  const auto numEntries = ifdOffset ? readTiffInteger(file, *ifdOffset, 2, header.isLittleEndian) : std::nullopt;
+  if (!numEntries || *numEntries > 4096) {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < *numEntries; ++i) {
+    const size_t entryOffset = *ifdOffset + 2 + 12 * static_cast<size_t>(i);
+    const auto tag = readTiffInteger(file, entryOffset, 2, header.isLittleEndian);
+    const auto type = readTiffInteger(file, entryOffset + 2, 2, header.isLittleEndian);
+    const auto count = readTiffInteger(file, entryOffset + 4, 4, header.isLittleEndian);
+    if (!tag || !type || !count) {
+      return false;
+    }
+
+    // All the samples are assumed to have the same bits and format as the first one
+    const uint32_t value = readTiffValue(file, entryOffset, *type, *count, 0, header.isLittleEndian).value_or(0);
+
+    switch (*tag) {
+      case 0x0100:  // ImageWidth
+        header.width = value;
+        break;
+      case 0x0101:  // ImageLength
+        header.height = value;
+        break;
+      case 0x0102:  // BitsPerSample
+        header.bitsPerSample = value;
+        break;
+      case 0x0103:  // Compression
+        header.compression = value;
+        break;
+      case 0x0106:  // PhotometricInterpretation
+        header.photometric = value;
+        break;
+      case 0x0111:  // StripOffsets
+        header.stripOffsetsEntry = entryOffset;
+        header.stripOffsetsType = *type;
+        header.stripOffsetsCount = *count;
+        break;
+      case 0x0112:  // Orientation
+        header.orientation = value;
+        break;
+      case 0x0115:  // SamplesPerPixel
+        header.samplesPerPixel = value;
+        break;
+      case 0x0116:  // RowsPerStrip
+        header.rowsPerStrip = value;
+        break;
+      case 0x011C:  // PlanarConfiguration
+        header.planarConfig = value;
+        break;
+      case 0x0142:  // TileWidth
+        header.isTiled = true;
+        break;
+      case 0x0153:  // SampleFormat
+        header.sampleFormat = value;
+        break;
+      default:
+        break;
+    }
+  }
+
+  return header.width > 0 && header.height > 0 &&
+         header.width <= static_cast<uint32_t>(std::numeric_limits<int>::max()) && header.height <= static_cast<uint32_t>(std::numeric_limits<int>::max());
+}
+
+int ImagingUtil::getTiffDepth(const TiffImageHeader& header) {
+  // Unsigned integer, signed integer or floating point
+  switch (header.sampleFormat) {
+    case 1:
+      return header.bitsPerSample == 8 ? CV_8U : (header.bitsPerSample == 16 ? CV_16U : -1);
+    case 2:
+      return header.bitsPerSample == 8 ? CV_8S : (header.bitsPerSample == 16 ? CV_16S : (header.bitsPerSample == 32 ? CV_32S : -1));
+    case 3:
+      return header.bitsPerSample == 32 ? CV_32F : (header.bitsPerSample == 64 ? CV_64F : -1);
+    default:
+      return -1;
+  }
+}
+
+std::optional<uint32_t> ImagingUtil::readTiffValue(const MappedFile& file, size_t entryOffset, uint32_t type, uint32_t count, uint32_t index, bool isLittleEndian) {
+  // BYTE, SHORT or LONG
+  const int valueSize = type == 1 ? 1 : (type == 3 ? 2 : (type == 4 ? 4 : 0));
+  if (valueSize == 0 || index >= count) {
+    return std::nullopt;
+  }
+
+  // Either in the entry itself, or at the offset in it
+  if (static_cast<uint64_t>(count) * valueSize <= 4) {
+    return readTiffInteger(file, entryOffset + 8 + static_cast<size_t>(index) * valueSize, valueSize, isLittleEndian);
+  }
+
+  const auto arrayOffset = readTiffInteger(file, entryOffset + 8, 4, isLittleEndian);
+  return arrayOffset ? readTiffInteger(file, *arrayOffset + static_cast<size_t>(index) * valueSize, valueSize, isLittleEndian) : std::nullopt;
+}
+
+size_t ImageData::getSizeInBytes() const {
+  size_t sizeInBytes = image.total() * image.elemSize();
+  for (const auto& mipLevel : mipLevels) {
+    sizeInBytes += mipLevel.total() * mipLevel.elemSize();
+  }
+  return sizeInBytes;
+}
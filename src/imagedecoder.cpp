@@ -0,0 +1,315 @@
+#include <imagedecoder.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+// ###########################################################################################################################################
+// ImageDecoder
+// ###########################################################################################################################################
+
+ImageDecoder::~ImageDecoder() = default;
+
+std::optional<ImageInfo> ImageDecoder::probe(const MappedFile& /*file*/) const {
+  return std::nullopt;
+}
+
+bool ImageDecoder::decodeReduced(const MappedFile& /*file*/, int /*reduction*/, ImageData& /*imageData*/) const {
+  return false;
+}
+
+bool ImageDecoder::readEmbeddedPreview(const MappedFile& /*file*/, ImageData& /*preview*/) const {
+  return false;
+}
+
+bool ImageDecoder::openTiledImage(const fs::path& /*filePath*/, const ThreadPool_t& /*threadPool*/, ImageData& /*imageData*/) const {
+  return false;
+}
+
+// ###########################################################################################################################################
+// OpenCVImageDecoder
+// ###########################################################################################################################################
+
+std::string OpenCVImageDecoder::getName() const {
+  return "OpenCV";
+}
+
+std::vector<std::string> OpenCVImageDecoder::getExtensions() const {
+  return {".png", ".jpg", ".jpeg", ".bmp", ".tiff", ".tif", ".exr", ".pgm", ".ppm", ".pfm"};
+}
+
+DecoderCapabilities OpenCVImageDecoder::getCapabilities() const {
+  return DecoderCapabilities();
+}
+
+bool OpenCVImageDecoder::canDecode(const MappedFile& /*file*/) const {
+  return true;  // OpenCV finds the format by itself
+}
+
+bool OpenCVImageDecoder::decode(const MappedFile_t& file, ImageData& imageData) const {
+  const cv::Mat image = ImagingUtil::decodeImage(*file, cv::IMREAD_UNCHANGED);
+  if (image.empty()) {
+    return false;
+  }
+
+  imageData = ImageData(image, file->getPath());
+  imageData.channelOrder = ChannelOrder::BGR;
+  imageData.orientation = ImagingUtil::readOrientation(*file);
+  return true;
+}
+
+// ###########################################################################################################################################
+// JpegImageDecoder
+// ###########################################################################################################################################
+
+std::string JpegImageDecoder::getName() const {
+  return "JPEG";
+}
+
+std::vector<std::string> JpegImageDecoder::getExtensions() const {
+  return {".jpg", ".jpeg"};
+}
+
+DecoderCapabilities JpegImageDecoder::getCapabilities() const {
+  DecoderCapabilities capabilities;
+  capabilities.reducedScale = true;
+  capabilities.headerProbe = true;
+  capabilities.embeddedPreview = true;
+  return capabilities;
+}
+
+bool JpegImageDecoder::canDecode(const MappedFile& file) const {
+  return file.getSize() >= 3 && file.getData()[0] == 0xFF && file.getData()[1] == 0xD8 && file.getData()[2] == 0xFF;
+}
+
+std::optional<ImageInfo> JpegImageDecoder::probe(const MappedFile& file) const {
+  return ImagingUtil::probeJpeg(file);
+}
+
+bool JpegImageDecoder::decodeReduced(const MappedFile& file, int reduction, ImageData& imageData) const {
+  // Scaled down by the DCT while decoding
+  int flags;
+  switch (reduction) {
+    case 2:
+      flags = cv::IMREAD_REDUCED_COLOR_2;
+      break;
+    case 4:
+      flags = cv::IMREAD_REDUCED_COLOR_4;
+      break;
+    case 8:
+      flags = cv::IMREAD_REDUCED_COLOR_8;
+      break;
+    default:
+      return false;
+  }
+
+  // NOTE: The orientation is applied when drawing in the same way as the full image
+  const cv::Mat image = ImagingUtil::decodeImage(file, flags | cv::IMREAD_IGNORE_ORIENTATION);
+  if (image.empty()) {
+    return false;
+  }
+
+  imageData = ImageData(image, file.getPath());
+  imageData.channelOrder = ChannelOrder::BGR;
+  imageData.orientation = ImagingUtil::readOrientation(file);
+  return true;
+}
+
+bool JpegImageDecoder::readEmbeddedPreview(const MappedFile& file, ImageData& preview) const {
+  return ImagingUtil::readEmbeddedPreview(file, preview);
+}
+
+// ###########################################################################################################################################
+// PngImageDecoder
+// ###########################################################################################################################################
+
+std::string PngImageDecoder::getName() const {
+  return "PNG";
+}
+
+std::vector<std::string> PngImageDecoder::getExtensions() const {
+  return {".png"};
+}
+
+DecoderCapabilities PngImageDecoder::getCapabilities() const {
+  DecoderCapabilities capabilities;
+  capabilities.headerProbe = true;
+  return capabilities;
+}
+
+bool PngImageDecoder::canDecode(const MappedFile& file) const {
+  return file.getSize() >= 8 && std::memcmp(file.getData(), "\x89PNG\r\n\x1A\n", 8) == 0;
+}
+
+std::optional<ImageInfo> PngImageDecoder::probe(const MappedFile& file) const {
+  return ImagingUtil::probePng(file);
+}
+
+// ###########################################################################################################################################
+// ExrImageDecoder
+// ###########################################################################################################################################
+
+std::string ExrImageDecoder::getName() const {
+  return "OpenEXR";
+}
+
+std::vector<std::string> ExrImageDecoder::getExtensions() const {
+  return {".exr"};
+}
+
+DecoderCapabilities ExrImageDecoder::getCapabilities() const {
+  DecoderCapabilities capabilities;
+  capabilities.headerProbe = true;
+  return capabilities;
+}
+
+bool ExrImageDecoder::canDecode(const MappedFile& file) const {
+  const uint8_t* data = file.getData();
+  return file.getSize() >= 4 && data[0] == 0x76 && data[1] == 0x2F && data[2] == 0x31 && data[3] == 0x01;
+}
+
+std::optional<ImageInfo> ExrImageDecoder::probe(const MappedFile& file) const {
+  return ImagingUtil::probeExr(file);
+}
+
+// ###########################################################################################################################################
+// TiffImageDecoder
+// ###########################################################################################################################################
+
+std::string TiffImageDecoder::getName() const {
+  return "TIFF";
+}
+
+std::vector<std::string> TiffImageDecoder::getExtensions() const {
+  return {".tiff", ".tif"};
+}
+
+DecoderCapabilities TiffImageDecoder::getCapabilities() const {
+  DecoderCapabilities capabilities;
+#if defined(RVIEW_USE_LIBTIFF)
+  capabilities.region = true;
+#endif
+  capabilities.headerProbe = true;
+  capabilities.embeddedPreview = true;
+  return capabilities;
+}
+
+bool TiffImageDecoder::canDecode(const MappedFile& file) const {
+  const uint8_t* data = file.getData();
+  return file.getSize() >= 4 && ((data[0] == 'I' && data[1] == 'I' && data[3] == 0) || (data[0] == 'M' && data[1] == 'M' && data[2] == 0)) &&
+         (data[2] == 42 || data[3] == 42 || data[2] == 43 || data[3] == 43);  // Classic TIFF or BigTIFF
+}
+
+std::optional<ImageInfo> TiffImageDecoder::probe(const MappedFile& file) const {
+  return ImagingUtil::probeTiff(file);  // NOTE: Classic TIFF only
+}
+
+bool TiffImageDecoder::readEmbeddedPreview(const MappedFile& file, ImageData& preview) const {
+  return ImagingUtil::readEmbeddedPreview(file, preview);
+}
+
+bool TiffImageDecoder::openTiledImage(const fs::path& filePath, const ThreadPool_t& threadPool, ImageData& imageData) const {
+#if defined(RVIEW_USE_LIBTIFF)
+  const auto tiffImage = TiffTiledImage::open(filePath, threadPool);
+  if (tiffImage == nullptr) {
+    return false;
+  }
+
+  imageData = ImageData(cv::Mat(), filePath);
+  imageData.channelOrder = tiffImage->isRGB() ? ChannelOrder::RGB : ChannelOrder::BGR;
+  imageData.orientation = tiffImage->getOrientation();
+  imageData.tiledImage = tiffImage;
+  return true;
+#else
+  return ImageDecoder::openTiledImage(filePath, threadPool, imageData);
+#endif
+}
+
+// ###########################################################################################################################################
+// RawImageDecoder
+// ###########################################################################################################################################
+
+std::string RawImageDecoder::getName() const {
+  return "Raw";
+}
+
+std::vector<std::string> RawImageDecoder::getExtensions() const {
+  return {".pgm", ".ppm", ".pfm", ".bmp", ".tiff", ".tif", ".npy"};
+}
+
+DecoderCapabilities RawImageDecoder::getCapabilities() const {
+  return DecoderCapabilities();
+}
+
+bool RawImageDecoder::canDecode(const MappedFile& file) const {
+  const uint8_t* data = file.getData();
+  if (file.getSize() < 8) {
+    return false;
+  }
+
+  // Binary PGM/PPM, PFM, BMP, classic TIFF or NumPy
+  return (data[0] == 'P' && (data[1] == '5' || data[1] == '6' || data[1] == 'F' || data[1] == 'f')) ||
+         (data[0] == 'B' && data[1] == 'M') ||
+         (data[0] == 'I' && data[1] == 'I' && data[2] == 42 && data[3] == 0) ||
+         (data[0] == 'M' && data[1] == 'M' && data[2] == 0 && data[3] == 42) ||
+         std::memcmp(data, "\x93NUMPY", 6) == 0;
+}
+
+bool RawImageDecoder::decode(const MappedFile_t& file, ImageData& imageData) const {
+  // Compressed or unusual layouts are left to the next backend
+  return ImagingUtil::mapRawImage(file, imageData);
+}
+
+// ###########################################################################################################################################
+// ImageDecoderRegistry
+// ###########################################################################################################################################
+
+void ImageDecoderRegistry::registerDecoder(const ImageDecoder_t& decoder) {
+  std::lock_guard<std::mutex> lock(getMutex());
+  getDecoders().insert(getDecoders().begin(), decoder);
+}
+
+std::vector<ImageDecoder_t> ImageDecoderRegistry::findDecoders(const MappedFile& file) {
+  std::lock_guard<std::mutex> lock(getMutex());
+
+  std::vector<ImageDecoder_t> decoders;
+  for (const auto& decoder : getDecoders()) {
+    if (decoder->canDecode(file)) {
+      decoders.push_back(decoder);
+    }
+  }
+  return decoders;
+}
+
+bool ImageDecoderRegistry::isSupportedExtension(const fs::path& filePath) {
+  std::string fileExtension = filePath.extension().string();
+  std::transform(fileExtension.begin(), fileExtension.end(), fileExtension.begin(), ::tolower);
+
+  std::lock_guard<std::mutex> lock(getMutex());
+
+  for (const auto& decoder : getDecoders()) {
+    const auto extensions = decoder->getExtensions();
+    if (std::find(extensions.begin(), extensions.end(), fileExtension) != extensions.end()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::mutex& ImageDecoderRegistry::getMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+std::vector<ImageDecoder_t>& ImageDecoderRegistry::getDecoders() {
+  // The uncompressed images are mapped before anything else. The specialized backends decode with OpenCV as well.
+  static std::vector<ImageDecoder_t> decoders = {
+      std::make_shared<RawImageDecoder>(),
+      std::make_shared<JpegImageDecoder>(),
+      std::make_shared<PngImageDecoder>(),
+      std::make_shared<TiffImageDecoder>(),
+      std::make_shared<ExrImageDecoder>(),
+      std::make_shared<OpenCVImageDecoder>(),
+  };
+  return decoders;
+}
@@ -1,146 +1,386 @@
+#include <common.h>
 #include <imageloader.h>
+#include <memoryutil.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 // ###########################################################################################################################################
-// ThreadPool
+// ImageCache
 // ###########################################################################################################################################
 
-ThreadPool::ThreadPool(int numThreads)
-    : _workers(),
-      _taskMutex(),
-      _isRunning(true),
-      _condition(),
-      _tasks() {
-  // Create and launch a number of worker threads
-  for (int i = 0; i < numThreads; ++i) {
-    _workers.emplace_back(&ThreadPool::worker, this);
-  }
+ImageCache::ImageCache(size_t capacityBytes)
+    : _entries(),
+      _entryIndex(),
+      _capacityBytes(capacityBytes),
+      _sizeInBytes(0),
+      _lastMemoryCheckTime(),
+      _memoryLimitBytes(std::numeric_limits<size_t>::max()) {
 }
 
-ThreadPool::~ThreadPool() {
-  {
-    // Lock task queue to prevent adding new task.
-    std::lock_guard<std::mutex> lock(_taskMutex);
-    _isRunning = false;
+ImageCache::~ImageCache() = default;
+
+bool ImageCache::tryGet(const fs::path& filePath, ImageData& imageData) {
+  auto it = _entryIndex.find(filePath);
+  if (it == _entryIndex.end() || eraseIfStale(filePath)) {
+    return false;
   }
 
-  _condition.notify_all();  // Notify all threads to wake up and exit
+  // Move the entry to the front
+  _entries.splice(_entries.begin(), _entries, it->second);
 
-  for (auto& worker : _workers) {
-    if (worker.joinable()) {
-      worker.join();  // Wait for all threads to finish
-    }
+  imageData = it->second->second;
+  return true;
+}
+
+bool ImageCache::contains(const fs::path& filePath) {
+  return _entryIndex.find(filePath) != _entryIndex.end() && !eraseIfStale(filePath);
+}
+
+void ImageCache::put(const fs::path& filePath, const ImageData& imageData) {
+  erase(filePath);
+
+  _entries.emplace_front(filePath, imageData);
+  _entryIndex[filePath] = _entries.begin();
+  _sizeInBytes += imageData.getSizeInBytes();
+
+  evict();
+}
+
+void ImageCache::erase(const fs::path& filePath) {
+  auto it = _entryIndex.find(filePath);
+  if (it == _entryIndex.end()) {
+    return;
   }
 
-  _workers.clear();  // Clear the vector of threads
+  _sizeInBytes -= it->second->second.getSizeInBytes();
+  _entries.erase(it->second);
+  _entryIndex.erase(it);
 }
 
-template <typename F>
-auto ThreadPool::submit(F&& func) -> std::future<std::invoke_result_t<F>> {
-  using R = std::invoke_result_t<F>;
+void ImageCache::clear() {
+  _entries.clear();
+  _entryIndex.clear();
+  _sizeInBytes = 0;
+}
 
-  auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(func));
-  auto future = task->get_future();
+void ImageCache::setCapacity(size_t capacityBytes) {
+  _capacityBytes = capacityBytes;
+  evict();
+}
 
-  pushTask([task]() {
-    (*task)();
-  });
+size_t ImageCache::getCapacity() const {
+  return _capacityBytes;
+}
 
-  return future;
+size_t ImageCache::getSizeInBytes() const {
+  return _sizeInBytes;
 }
 
-template <typename F>
-void ThreadPool::pushTask(const F& task) {
-  {
-    std::lock_guard<std::mutex> lock(_taskMutex);
+size_t ImageCache::size() const {
+  return _entries.size();
+}
+
+size_t ImageCache::getEffectiveCapacity() {
+  // Reading /proc is not free, so the memory limit is refreshed only once in a while
+  const auto now = std::chrono::steady_clock::now();
+  if (now - _lastMemoryCheckTime >= std::chrono::milliseconds(Common::IMAGE_CACHE_MEMORY_CHECK_INTERVAL_MS)) {
+    _lastMemoryCheckTime = now;
 
-    if (_isRunning) {
-      _tasks.push(std::function<void()>(task));  // Add the task to the queue
+    if (const auto availableBytes = MemoryUtil::getAvailableMemory(); availableBytes) {
+      // The cache may grow by the available memory except for the reserve
+      const size_t headroom = *availableBytes > Common::IMAGE_CACHE_MEMORY_RESERVE_BYTES ? *availableBytes - Common::IMAGE_CACHE_MEMORY_RESERVE_BYTES : 0;
+      _memoryLimitBytes = _sizeInBytes + headroom;
     } else {
-      throw std::runtime_error("ThreadPool is not running anymore.");
+      _memoryLimitBytes = std::numeric_limits<size_t>::max();
     }
   }
 
-  _condition.notify_one();  // Notify one thread to wake up and execute the task
+  return std::min(_capacityBytes, _memoryLimitBytes);
 }
 
-void ThreadPool::worker() {
-  for (;;) {
-    std::function<void()> task;
+void ImageCache::evict() {
+  const size_t capacityBytes = getEffectiveCapacity();
 
-    {
-      std::unique_lock<std::mutex> lock(_taskMutex);
-      _condition.wait(lock, [&] { return !_isRunning || !_tasks.empty(); });
+  // Evict the least recently used entries. The most recent one is always kept even if it exceeds the capacity.
+  while (_sizeInBytes > capacityBytes && _entries.size() > 1) {
+    const auto& [filePath, imageData] = _entries.back();
 
-      if (!_isRunning && _tasks.empty()) {
-        return;  // Exit if the pool is not running and there are no tasks
-      }
+#if defined(RVIEW_DEBUG_BUILD)
+    qDebug() << "Evict from cache:" << FileUtil::pathToQString(filePath);
+#endif
+
+    _sizeInBytes -= imageData.getSizeInBytes();
+    _entryIndex.erase(filePath);
+    _entries.pop_back();
+  }
+}
+
+bool ImageCache::eraseIfStale(const fs::path& filePath) {
+  auto it = _entryIndex.find(filePath);
+  if (it == _entryIndex.end() || !isStale(filePath, it->second->second)) {
+    return false;
+  }
+
+#if defined(RVIEW_DEBUG_BUILD)
+  qDebug() << "Evict the modified file from cache:" << FileUtil::pathToQString(filePath);
+#endif
+
+  erase(filePath);
+  return true;
+}
+
+bool ImageCache::isStale(const fs::path& filePath, const ImageData& imageData) {
+  return imageData.fileStamp && FileStamp::read(filePath) != imageData.fileStamp;
+}
+
+// ###########################################################################################################################################
+// NavigationTracker
+// ###########################################################################################################################################
+
+NavigationTracker::NavigationTracker()
+    : _history() {
+}
+
+NavigationTracker::~NavigationTracker() = default;
+
+void NavigationTracker::record(int index) {
+  if (!_history.empty() && _history.back().second == index) {
+    return;  // Not a step
+  }
 
-      task = std::move(_tasks.front());  // Get the next task
-      _tasks.pop();                      // Remove the task from the queue
+  const auto now = Clock::now();
+  _history.emplace_back(now, index);
+
+  removeExpired(now);
+}
+
+void NavigationTracker::reset() {
+  _history.clear();
+}
+
+int NavigationTracker::getDirection() const {
+  const auto now = Clock::now();
+  const auto expiration = std::chrono::milliseconds(Common::NAVIGATION_HISTORY_DURATION_MS);
+
+  // Sum up the directions of the recent steps
+  int direction = 0;
+  for (size_t i = 1; i < _history.size(); ++i) {
+    if (now - _history[i].first <= expiration) {
+      const int delta = _history[i].second - _history[i - 1].second;
+      direction += (delta > 0) - (delta < 0);
+    }
+  }
+
+  return (direction > 0) - (direction < 0);
+}
+
+double NavigationTracker::getStepRate() const {
+  const auto now = Clock::now();
+  const auto expiration = std::chrono::milliseconds(Common::NAVIGATION_HISTORY_DURATION_MS);
+
+  int numSteps = 0;
+  for (size_t i = 1; i < _history.size(); ++i) {
+    if (now - _history[i].first <= expiration) {
+      ++numSteps;
     }
+  }
+
+  return numSteps * 1000.0 / Common::NAVIGATION_HISTORY_DURATION_MS;
+}
 
-    task();  // Execute the task
+void NavigationTracker::removeExpired(Clock::time_point now) {
+  // Keep the last expired entry as the origin of the first recent step
+  const auto expiration = std::chrono::milliseconds(Common::NAVIGATION_HISTORY_DURATION_MS);
+  while (_history.size() > 1 && now - _history[1].first > expiration) {
+    _history.pop_front();
   }
 }
 
+#if defined(RVIEW_HAS_OPENCV_PARALLEL_BACKEND)
+
+// ###########################################################################################################################################
+// OpenCVParallelBackend
+// ###########################################################################################################################################
+
+OpenCVParallelBackend::OpenCVParallelBackend(const ThreadPool_t& threadPool)
+    : _threadPool(threadPool) {
+}
+
+void OpenCVParallelBackend::parallel_for(int tasks, FN_parallel_for_body_cb_t body_callback, void* callback_data) {
+  const auto threadPool = _threadPool.lock();
+  if (threadPool == nullptr || !threadPool->isRunning()) {
+    body_callback(0, tasks, callback_data);
+    return;
+  }
+
+  threadPool->parallelFor(0, tasks, 1, [body_callback, callback_data](int chunkBegin, int chunkEnd) {
+    body_callback(chunkBegin, chunkEnd, callback_data);
+  },
+                          ThreadPool::getCurrentPriority());
+}
+
+int OpenCVParallelBackend::getThreadNum() const {
+  // 0 for the threads outside the pool, which also run the stripes
+  const auto threadPool = _threadPool.lock();
+  return threadPool != nullptr ? threadPool->getWorkerIndex() + 1 : 0;
+}
+
+int OpenCVParallelBackend::getNumThreads() const {
+  const auto threadPool = _threadPool.lock();
+  return threadPool != nullptr ? threadPool->getMaxNumThreads() + 1 : 1;
+}
+
+int OpenCVParallelBackend::setNumThreads(int /*nThreads*/) {
+  return getNumThreads();
+}
+
+const char* OpenCVParallelBackend::getName() const {
+  return "rview";
+}
+
+#endif
+
 // ###########################################################################################################################################
 // AsyncImageLoader
 // ###########################################################################################################################################
 
-AsyncImageLoader::AsyncImageLoader(int numThreads, int numPreloadedImages)
+AsyncImageLoader::AsyncImageLoader(int numThreads, int numPreloadedImages, size_t cacheCapacityBytes)
     : _threadPool(std::make_shared<ThreadPool>(numThreads)),
+#if defined(RVIEW_HAS_OPENCV_PARALLEL_BACKEND)
+      _parallelBackend(std::make_shared<OpenCVParallelBackend>(_threadPool)),
+#endif
+      _previewStore(std::make_shared<PreviewStore>(PreviewStore::getDefaultDirectory(), Common::PREVIEW_STORE_CAPACITY_BYTES)),
+      _backgroundToken(std::make_shared<CancellationToken>()),
       _imageMutex(),
-      _futures(),
+      _loadTasks(),
       _numPreloadedImages(numPreloadedImages),
-      _imagePaths() {
+      _imagePaths(),
+      _imageCache(cacheCapacityBytes),
+      _probedImages(),
+      _probeToken(std::make_shared<CancellationToken>()),
+      _pendingRequest(),
+      _imageLoadedMutex(),
+      _imageLoadedCallback(),
+      _viewportSize(),
+      _navigationTracker(),
+      _prefetchStatistics(),
+      _numDecodeSamples(0),
+      _nextGeneration(1) {
+  _prefetchStatistics.numThreads = numThreads;
+  _prefetchStatistics.numPreloadedImages = numPreloadedImages;
+
+#if defined(RVIEW_HAS_OPENCV_PARALLEL_BACKEND)
+  cv::parallel::setParallelForBackend(_parallelBackend);
+#else
+  cv::setNumThreads(0);  // NOTE: The threads of OpenCV would compete with the workers. The workers split the large images by themselves.
+#endif
+
+  // Trim the preview store left by the previous sessions
+  _threadPool->post([previewStore = _previewStore]() { previewStore->evict(); }, PRIORITY_BACKGROUND, _backgroundToken);
 }
 
-AsyncImageLoader::~AsyncImageLoader() = default;
+AsyncImageLoader::~AsyncImageLoader() {
+#if defined(RVIEW_HAS_OPENCV_PARALLEL_BACKEND)
+  // Give cv::parallel_for_() back to the default backend of OpenCV, so that no new call reaches the pool
+  cv::parallel::setParallelForBackend(std::shared_ptr<cv::parallel::ParallelForAPI>());
+#endif
 
-void AsyncImageLoader::loadImageImpl(const fs::path& filePath, std::promise<ImageData>&& promise) {
-  try {
-    if (!fs::exists(filePath)) {
-      throw std::runtime_error("File does not exist.");
-    }
-    if (!fs::is_regular_file(filePath)) {
-      throw std::runtime_error("File is not a regular file.");
+  {
+    // Drop the pending callback so that nothing is delivered to the caller during the shutdown
+    std::lock_guard<std::mutex> lock(_imageMutex);
+    _pendingRequest = PendingRequest();
+
+    // Drop the queued tasks
+    for (auto& [path, loadTask] : _loadTasks) {
+      loadTask.token->cancel();
     }
+    _probeToken->cancel();
+    _backgroundToken->cancel();
+  }
+
+  // Join the workers here, before the members used by the running tasks are destroyed.
+  // NOTE: Releasing the pool is not enough. The tiles and the calls through the backend may still hold it,
+  //       and the last one may be released on a worker, which cannot join itself.
+  _threadPool->shutdown();
+  _threadPool.reset();
+}
+
+void AsyncImageLoader::loadImageImpl(const fs::path& filePath, std::promise<ImageData>&& promise, const CancellationToken_t& token) {
+  ImageCallback_t callback;
+  ImageData imageData;
 
-    cv::Mat image = cv::imread(FileUtil::pathToString(filePath), cv::IMREAD_UNCHANGED);
-    if (image.empty()) {
+  const auto startTime = std::chrono::steady_clock::now();
+
+  try {
+    // Read the file only once. The decoders and the EXIF parser share the content.
+    const auto file = std::make_shared<MappedFile>(filePath);
+    const auto decoders = ImageDecoderRegistry::findDecoders(*file);
+    const auto imageInfo = probeImageImpl(*file, decoders);
+
+    // The cheapest way the backends offer: by region for the images too large to decode at once, where only the overview is decoded here.
+    // Otherwise, the first backend decoding the file, such as the one referring to the mapped pixels without decoding.
+    if (!openTiledImage(decoders, filePath, imageInfo, imageData) && !decodeFullImage(decoders, file, imageData)) {
       throw std::runtime_error("Failed to load image.");
     }
 
-    // Convert the image to RGBA format
-    cv::Mat rgbaImage;
-    if (image.channels() == 1) {
-      cv::cvtColor(image, rgbaImage, cv::COLOR_GRAY2RGBA);
-    } else if (image.channels() == 3) {
-      cv::cvtColor(image, rgbaImage, cv::COLOR_BGR2RGBA);
-    } else if (image.channels() == 4) {
-      cv::cvtColor(image, rgbaImage, cv::COLOR_BGRA2RGBA);
-    } else {
-      qDebug() << "Unsupported image format";
-      return;
+    cv::Mat image = imageData.image;
+
+    if (token->isCancelled()) {
+      // The user has moved away while decoding. Skip the rest of the work.
+      throw std::runtime_error("Loading is cancelled.");
+    }
+
+    if (image.channels() != 1 && image.channels() != 3 && image.channels() != 4) {
+      throw std::runtime_error("Unsupported image format.");
     }
 
-    // Convert the image to float32 format range [0, 1]
+    // Keep the native bit depth and the decoded layout. The orientation is applied when drawing.
+    // The value range is used to normalize the image to [0, 1] in the shader.
     double minVal, maxVal;
-    cv::minMaxLoc(rgbaImage, &minVal, &maxVal);
-    rgbaImage.convertTo(rgbaImage, CV_32F, 1.0 / (maxVal - minVal), -minVal / (maxVal - minVal));
+    ImagingUtil::transformPixels(image, 1, minVal, maxVal, _threadPool);  // Split across the idle workers, at the priority of this task
+
+    if (image.channels() != 4) {
+      // An image without alpha is regarded as opaque, and the opaque alpha takes part in the value range
+      const double opaqueValue = image.depth() == CV_8U ? 255.0 : (image.depth() == CV_16U ? 65535.0 : 1.0);
+      maxVal = std::max(maxVal, opaqueValue);
+    }
 
-    // Correct the orientation using EXIF data
-    rgbaImage = ImagingUtil::correctOrientation(rgbaImage, filePath);
+    if (image.data == imageData.image.data && imageData.mappedFile != nullptr) {
+      // NOTE: The view, the tiles and the uploads use the pixels long after they are handed out. A truncated file would fault them then,
+      //       and on Windows the mapped view keeps the file from being rewritten or moved to the trash. The mapping only saves the decode.
+      image = image.clone();
+    }
+
+    imageData.mappedFile.reset();  // The pixels are decoded or copied. The mapping is no longer referred to.
+    imageData.fileStamp = file->getStamp();
+    imageData.generation = _nextGeneration.fetch_add(1);
 
-    // Flip the image vertically
-    cv::flip(rgbaImage, rgbaImage, 0);
+    imageData.image = image;
+    imageData.minValue = minVal;
+    imageData.maxValue = maxVal;
 
-    ImageData imageData(rgbaImage.clone(), filePath);  // Clone the image to avoid dangling reference
+    // The pyramid the view samples when minified, averaged here rather than by OpenGL while uploading.
+    // NOTE: The images drawn in tiles have the levels of their own.
+    if (imageData.tiledImage == nullptr && std::max(image.cols, image.rows) <= Common::TILED_RENDERING_MIN_SIZE) {
+      imageData.mipLevels = ImagingUtil::buildMipLevels(image);
+    }
+
+    const std::chrono::duration<double> decodeTime = std::chrono::steady_clock::now() - startTime;
 
     {
       std::lock_guard<std::mutex> lock(_imageMutex);  // Lock the mutex to protect shared data
-      _imageCache[filePath] = imageData;              // Cache the loaded image
-      promise.set_value(imageData);                   // Set the value in the promise
+      recordDecode(decodeTime.count(), imageData.getSizeInBytes());
+      _imageCache.put(filePath, imageData);  // Cache the loaded image
+      promise.set_value(imageData);          // Set the value in the promise
+
+      // NOTE: A superseded decode leaves the request to the task that replaced it
+      if (finishLoadTask(filePath, token, true) && _pendingRequest.path == filePath) {
+        // Someone is waiting for this image
+        callback = std::move(_pendingRequest.callback);
+        _pendingRequest = PendingRequest();
+      }
     }
 
 #if defined(RVIEW_DEBUG_BUILD)
@@ -149,7 +389,270 @@ void AsyncImageLoader::loadImageImpl(const fs::path& filePath, std::promise<Imag
   } catch (...) {
     std::exception_ptr ep = std::current_exception();
     promise.set_exception(ep);
+
+    {
+      // Notify the waiting request of the failure with an empty image.
+      // NOTE: A cancelled decode that has been replaced by a new one for the same file does nothing.
+      std::lock_guard<std::mutex> lock(_imageMutex);
+
+      if (finishLoadTask(filePath, token, false) && _pendingRequest.path == filePath) {
+        callback = std::move(_pendingRequest.callback);
+        _pendingRequest = PendingRequest();
+      }
+    }
+
+    imageData = ImageData();
+  }
+
+  // Deliver the result outside the lock. The callback is invoked on this worker thread.
+  if (callback) {
+    callback(imageData);
+  } else if (!imageData.empty()) {
+    std::lock_guard<std::mutex> lock(_imageLoadedMutex);
+    if (_imageLoadedCallback) {
+      _imageLoadedCallback(imageData);
+    }
+  }
+
+  // Keep a preview for the next sessions. Downscaled by the background task, which shares the pixels with the cache until it runs.
+  if (!imageData.empty() && _previewStore->isAvailable() && !_previewStore->contains(filePath, PreviewStore::Level::Screen)) {
+    try {
+      _threadPool->post([previewStore = _previewStore, filePath, imageData]() {
+        previewStore->store(filePath, PreviewStore::createPreview(imageData));
+      },
+                        PRIORITY_BACKGROUND, _backgroundToken);
+    } catch (const std::exception& e) {
+      // The preview is optional. The pool may also be shutting down.
+      qInfo() << "Failed to create the preview: " << e.what();
+    }
+  }
+}
+
+void AsyncImageLoader::loadPreviewImpl(const fs::path& filePath) {
+  {
+    std::lock_guard<std::mutex> lock(_imageMutex);
+    if (_pendingRequest.path != filePath) {
+      return;  // The full image is already delivered, or the user has moved on
+    }
+  }
+
+  ImageData preview;
+
+  // The stored preview is the fastest, and good enough as it is
+  if (_previewStore->load(filePath, PreviewStore::Level::Screen, preview)) {
+    deliverPreview(preview);
+    return;
+  }
+
+  // Only the thumbnail is stored for the images shown from their embedded preview. Show it until the refinements below.
+  const bool hasThumbnail = _previewStore->load(filePath, PreviewStore::Level::Thumbnail, preview);
+  if (hasThumbnail) {
+    deliverPreview(preview);
+  }
+
+  MappedFile_t file;
+  try {
+    file = std::make_shared<MappedFile>(filePath);
+  } catch (const std::exception&) {
+    return;  // The full load reports the error
+  }
+
+  const auto decoders = ImageDecoderRegistry::findDecoders(*file);
+  const auto imageInfo = probeImageImpl(*file, decoders);  // Cached by deliverPreview() for the layout of the previews
+
+  // The embedded preview of camera images is tiny. Show it first, and refine it with the reduced decode below.
+  for (const auto& decoder : decoders) {
+    if (!decoder->getCapabilities().embeddedPreview || !decoder->readEmbeddedPreview(*file, preview)) {
+      continue;
+    }
+
+    deliverPreview(preview);
+
+    if (!hasThumbnail) {
+      _threadPool->post([previewStore = _previewStore, filePath, preview]() {
+        previewStore->storeThumbnail(filePath, preview);
+      },
+                        PRIORITY_BACKGROUND, _backgroundToken);
+    }
+    break;
+  }
+
+  // Decode the image at reduced resolution if the format allows it cheaply
+  if (decodeReducedImage(decoders, imageInfo, *file, preview)) {
+    deliverPreview(preview);
+  }
+}
+
+void AsyncImageLoader::deliverPreview(const ImageData& preview) {
+  ImageCallback_t callback;
+  ImageData sizedPreview = preview;
+
+  {
+    std::lock_guard<std::mutex> lock(_imageMutex);
+
+    if (_pendingRequest.path == preview.path) {
+      // NOTE: The request stays pending, so that the full image is also delivered
+      callback = _pendingRequest.callback;
+    }
+
+    // The view lays out the preview at the size of the full image from the header.
+    // The size is swapped if the orientation of the preview is baked into its pixels while the full image is transposed when drawn, or vice versa.
+    if (const auto it = _probedImages.find(preview.path); it != _probedImages.end() && it->second.info) {
+      const ImageInfo& info = *it->second.info;
+      const bool isTransposed = (info.orientation >= 5) != (preview.orientation >= 5);
+      sizedPreview.fullSize = isTransposed ? cv::Size(info.size.height, info.size.width) : info.size;
+    }
+  }
+
+  if (callback) {
+    callback(sizedPreview);
+  }
+}
+
+bool AsyncImageLoader::decodeReducedImage(const std::vector<ImageDecoder_t>& decoders, const std::optional<ImageInfo>& imageInfo, const MappedFile& file, ImageData& imageData) const {
+  cv::Size viewportSize;
+  {
+    std::lock_guard<std::mutex> lock(_imageMutex);
+    viewportSize = _viewportSize;
+  }
+
+  // The size has to be known to choose the reduction
+  if (viewportSize.empty() || !imageInfo || imageInfo->size.empty()) {
+    return false;
+  }
+
+  // Only the backends decoding at reduced resolution cheaply, such as JPEG by scaling the DCT
+  const auto it = std::find_if(decoders.begin(), decoders.end(), [](const ImageDecoder_t& decoder) { return decoder->getCapabilities().reducedScale; });
+  if (it == decoders.end()) {
+    return false;
+  }
+
+  const ImageDecoder_t& decoder = *it;
+
+  // Scale to fit the image as displayed in the viewport. The orientation from the header transposes it or not.
+  const bool isTransposed = imageInfo->orientation >= 5 && imageInfo->orientation <= 8;
+  const cv::Size displaySize = isTransposed ? cv::Size(imageInfo->size.height, imageInfo->size.width) : imageInfo->size;
+  const double fitScale = std::min(static_cast<double>(viewportSize.width) / displaySize.width, static_cast<double>(viewportSize.height) / displaySize.height);
+
+  // The largest reduction that still covers the viewport
+  int reduction;
+  if (fitScale <= 1.0 / 8.0) {
+    reduction = 8;
+  } else if (fitScale <= 1.0 / 4.0) {
+    reduction = 4;
+  } else if (fitScale <= 1.0 / 2.0) {
+    reduction = 2;
+  } else {
+    return false;  // Not worth it. The full image is not much larger than the viewport.
+  }
+
+  if (!decoder->decodeReduced(file, reduction, imageData)) {
+    return false;
+  }
+
+  imageData.minValue = 0.0;
+  imageData.maxValue = 255.0;
+  imageData.isPreview = true;
+
+  return true;
+}
+
+bool AsyncImageLoader::decodeFullImage(const std::vector<ImageDecoder_t>& decoders, const MappedFile_t& file, ImageData& imageData) const {
+  for (const auto& decoder : decoders) {
+    try {
+      if (decoder->decode(file, imageData)) {
+        return true;
+      }
+    } catch (const cv::Exception& e) {
+      // Try the next backend
+      qInfo() << "Failed to decode with " << QString::fromStdString(decoder->getName()) << ": " << e.what();
+    }
+  }
+  return false;
+}
+
+std::optional<ImageInfo> AsyncImageLoader::probeImage(const fs::path& filePath) {
+  try {
+    const MappedFile file(filePath);
+    return probeImageImpl(file, ImageDecoderRegistry::findDecoders(file));
+  } catch (const std::exception&) {
+    return std::nullopt;
+  }
+}
+
+std::optional<ImageInfo> AsyncImageLoader::probeImageImpl(const MappedFile& file, const std::vector<ImageDecoder_t>& decoders) {
+  std::error_code errorCode;
+  const auto writeTime = fs::last_write_time(file.getPath(), errorCode);
+
+  {
+    std::lock_guard<std::mutex> lock(_imageMutex);
+    if (const auto it = _probedImages.find(file.getPath()); it != _probedImages.end() && !errorCode && it->second.writeTime == writeTime) {
+      return it->second.info;
+    }
+  }
+
+  // The first backend reading the header. The formats without a probe are remembered as well, not to parse them again.
+  std::optional<ImageInfo> imageInfo;
+  for (const auto& decoder : decoders) {
+    if (decoder->getCapabilities().headerProbe && (imageInfo = decoder->probe(file))) {
+      break;
+    }
   }
+
+  if (!errorCode) {
+    std::lock_guard<std::mutex> lock(_imageMutex);
+    _probedImages[file.getPath()] = ProbedImage{imageInfo, writeTime};
+  }
+
+  return imageInfo;
+}
+
+bool AsyncImageLoader::isTooLargeToPrefetch(const fs::path& filePath) const {
+  // NOTE: The caller must lock _imageMutex
+
+  // An image taking most of the cache would only evict the other prefetched images. It is loaded when requested.
+  const auto it = _probedImages.find(filePath);
+  return it != _probedImages.end() && it->second.info &&
+         static_cast<double>(it->second.info->getSizeInBytes()) > Common::PREFETCH_MEMORY_RATIO * static_cast<double>(_imageCache.getCapacity());
+}
+
+bool AsyncImageLoader::openTiledImage(const std::vector<ImageDecoder_t>& decoders, const fs::path& filePath, const std::optional<ImageInfo>& imageInfo, ImageData& imageData) const {
+  if (imageInfo && std::max(imageInfo->size.width, imageInfo->size.height) <= Common::TILED_RENDERING_MIN_SIZE) {
+    return false;  // Small enough to decode at once, as known from the header without opening the file to read by region
+  }
+
+  TiledImage_t tiledImage;
+  for (const auto& decoder : decoders) {
+    if (decoder->getCapabilities().region && decoder->openTiledImage(filePath, _threadPool, imageData)) {
+      tiledImage = imageData.tiledImage;
+      break;
+    }
+  }
+
+  if (tiledImage == nullptr) {
+    return false;
+  }
+
+  const cv::Size fullSize = tiledImage->getLevelSize(0);
+  if (std::max(fullSize.width, fullSize.height) <= Common::TILED_RENDERING_MIN_SIZE) {
+    imageData = ImageData();
+    return false;  // Small enough to decode at once
+  }
+
+  // The overview is the finest level that fits in the screen-size preview
+  int overviewLevel = 0;
+  while (overviewLevel + 1 < tiledImage->getNumLevels() &&
+         std::max(tiledImage->getLevelSize(overviewLevel).width, tiledImage->getLevelSize(overviewLevel).height) > Common::PREVIEW_SCREEN_SIZE) {
+    ++overviewLevel;
+  }
+
+  const cv::Mat overview = tiledImage->readRegion(overviewLevel, cv::Rect(cv::Point(0, 0), tiledImage->getLevelSize(overviewLevel)));
+  if (overview.empty()) {
+    return false;
+  }
+
+  imageData.image = overview;
+  return true;
 }
 
 void AsyncImageLoader::loadImages(const std::vector<fs::path>& filePaths) {
@@ -157,20 +660,36 @@ void AsyncImageLoader::loadImages(const std::vector<fs::path>& filePaths) {
 
   _imagePaths = filePaths;  // Store the paths of the images to be loaded
 
-  // 最初に読み込む画像の数を決定
-  const size_t numImagesToLoad = std::min(static_cast<size_t>(_numPreloadedImages), filePaths.size());
-  std::vector<fs::path> imagesToLoad(numImagesToLoad);
-  std::copy_n(filePaths.begin(), numImagesToLoad, imagesToLoad.begin());  // Copy the paths to load
+  // Cancel the tasks of the previous directory
+  for (auto& [path, loadTask] : _loadTasks) {
+    loadTask.token->cancel();
+  }
+  _loadTasks.clear();
 
-  for (const auto& filePath : imagesToLoad) {
-    std::promise<ImageData> promise;
-    auto future = promise.get_future();
+  _navigationTracker.reset();
+
+  // Probe the headers of all the images ahead of decoding them, so that the prefetch is budgeted by their sizes
+  _probeToken->cancel();
+  _probeToken = std::make_shared<CancellationToken>();
+  _probedImages.clear();
 
-    _futures[filePath] = std::move(future);  // Store the future in the map
+  _threadPool->post([this, filePaths, token = _probeToken]() {
+    for (const auto& filePath : filePaths) {
+      if (token->isCancelled()) {
+        return;
+      }
+      probeImage(filePath);
+    }
+  },
+                    PRIORITY_PROBE, _probeToken);
+
+  // 最初に読み込む画像の数を決定
+  const size_t numImagesToLoad = std::min(static_cast<size_t>(_numPreloadedImages), filePaths.size());
 
-    _threadPool->submit([this, filePath, promise = std::move(promise)]() mutable {
-      loadImageImpl(filePath, std::move(promise));
-    });
+  for (size_t i = 0; i < numImagesToLoad; ++i) {
+    if (!_imageCache.contains(filePaths[i])) {
+      submitLoadTask(filePaths[i], -static_cast<int>(i), false, true);
+    }
   }
 }
 
@@ -192,162 +711,334 @@ ImageData AsyncImageLoader::getImage(const fs::path& filePath) {
   {
     std::lock_guard<std::mutex> lock(_imageMutex);
 
-    if (_imageCache.find(filePath) != _imageCache.end()) {
-      imageData = _imageCache.at(filePath);
-    }
+    _imageCache.tryGet(filePath, imageData);
+    recordRequest(filePath, !imageData.empty());
   }
 
   // ------------------------------------------------------------------------------------------------------------
-  // Load from future
+  // Add to the queue. This makes sure that the image is being loaded.
+  // ------------------------------------------------------------------------------------------------------------
+  updatePreloadQueue(filePath);
+
   // ------------------------------------------------------------------------------------------------------------
-  if (imageData.empty()) {
+  // Wait for the decode in flight
+  // ------------------------------------------------------------------------------------------------------------
+  // NOTE: A decode cancelled after the user moved away may be replaced by a new one for the same file. The result is taken from that one.
+  for (bool isRecorded = true; imageData.empty(); isRecorded = false) {
     std::shared_future<ImageData> future;
+    CancellationToken_t token;
 
     {
       std::lock_guard<std::mutex> lock(_imageMutex);
 
-      auto futureIt = _futures.find(filePath);
-      if (futureIt != _futures.end()) {
-        future = futureIt->second.share();
+      if (auto loadTaskIt = _loadTasks.find(filePath); loadTaskIt != _loadTasks.end()) {
+        future = loadTaskIt->second.future;
+        token = loadTaskIt->second.token;
+
+        if (!isRecorded && !loadTaskIt->second.isPrefetched) {
+          ++loadTaskIt->second.numSharedConsumers;  // The first one is counted by recordRequest()
+        }
+      } else {
+        _imageCache.tryGet(filePath, imageData);  // Finished in the meantime
+        break;
       }
     }
 
-    if (future.valid()) {
-      // If the future is valid, wait for it to be ready and get the result
+    try {
       imageData = future.get();  // Wait for the image to be loaded (blocking call)
-
-      {
-        // Erase the future from the map
-        // NOTE: Once you call get() on a future, it will no longer be valid.
-        std::lock_guard<std::mutex> lock(_imageMutex);
-
-        auto futureIt = _futures.find(filePath);
-        if (futureIt != _futures.end()) {
-          _futures.erase(futureIt);  // Remove the future from the map
-        }
+    } catch (const std::exception& e) {
+      if (!token->isCancelled()) {
+        qInfo() << "Failed to load the image: " << e.what();
+        break;
       }
     }
   }
 
+#if defined(RVIEW_DEBUG_BUILD)
   // ------------------------------------------------------------------------------------------------------------
-  // Add to the queue
+  // Check
   // ------------------------------------------------------------------------------------------------------------
   {
-    // Add the image path to the list of paths to load
-    std::vector<fs::path> pathsToLoadAll;
-    pathsToLoadAll.reserve(_numPreloadedImages);
+    std::lock_guard<std::mutex> lock(_imageMutex);
 
-    const int currentIndex = std::distance(_imagePaths.begin(), std::find(_imagePaths.begin(), _imagePaths.end(), filePath));
-    const int startIndex = std::max(currentIndex - _numPreloadedImages / 2 + 1, 0);
+    qDebug() << "Load tasks: " << _loadTasks.size() << ", prefetch hit rate: " << _prefetchStatistics.getHitRate() << ", coalesced decodes: " << _prefetchStatistics.numCoalescedDecodes;
+    qDebug() << "Cached images: " << _imageCache.size() << " (" << _imageCache.getSizeInBytes() << " / " << _imageCache.getCapacity() << " bytes)";
+  }
+#endif
 
-    for (int i = 0; i < _numPreloadedImages; ++i) {
-      const int index = startIndex + i;
+  return imageData;  // Return an empty ImageData if not found
+}
 
-      if (index < static_cast<int>(_imagePaths.size())) {
-        pathsToLoadAll.push_back(_imagePaths[index]);
-      }
+void AsyncImageLoader::requestImage(const fs::path& filePath, ImageCallback_t callback) {
+  // ------------------------------------------------------------------------------------------------------------
+  // Check if the file is included in file entries
+  // ------------------------------------------------------------------------------------------------------------
+  if (const auto& it = std::find(_imagePaths.begin(), _imagePaths.end(), filePath); it == _imagePaths.end()) {
+    qInfo() << "File is not included in file entries: " << FileUtil::pathToQString(filePath);
+
+    // The user has moved past the previous request
+    std::lock_guard<std::mutex> lock(_imageMutex);
+    _pendingRequest = PendingRequest();
+    return;
+  }
+
+  // ------------------------------------------------------------------------------------------------------------
+  // Load from cache, or register the request to be delivered when the image is loaded
+  // ------------------------------------------------------------------------------------------------------------
+  ImageData imageData;
+
+  {
+    std::lock_guard<std::mutex> lock(_imageMutex);
+
+    const bool isCached = _imageCache.tryGet(filePath, imageData);
+    recordRequest(filePath, isCached);
+
+    if (isCached) {
+      _pendingRequest = PendingRequest();
+    } else {
+      // NOTE: This replaces the previous request, so that the result of the image the user has already moved past is discarded.
+      //       The decode in flight, if any, delivers the image. Otherwise, it is started below.
+      _pendingRequest = PendingRequest{filePath, std::move(callback)};
     }
+  }
 
-    {
-      std::lock_guard<std::mutex> lock(_imageMutex);
+  // ------------------------------------------------------------------------------------------------------------
+  // Add to the queue. This makes sure that the requested image is being loaded.
+  // ------------------------------------------------------------------------------------------------------------
+  updatePreloadQueue(filePath);
 
-      std::vector<fs::path> pathsToLoad(pathsToLoadAll.size());
-      // Preferencially load the image current filePath
-      pathsToLoad.push_back(filePath);
-      for (const auto& path : pathsToLoadAll) {
-        if (path != filePath) {
-          pathsToLoad.push_back(path);
-        }
-      }
+  if (!imageData.empty()) {
+    callback(imageData);
+  } else {
+    // Show a preview while the full image is being loaded
+    _threadPool->post([this, filePath]() { loadPreviewImpl(filePath); }, PRIORITY_PREVIEW);
+  }
+}
 
-      // Erase the futures that are not in the paths to load
-      for (auto it = _futures.begin(); it != _futures.end();) {
-        if (std::find(pathsToLoadAll.begin(), pathsToLoadAll.end(), it->first) == pathsToLoadAll.end()) {
-          it = _futures.erase(it);
-        } else {
-          ++it;
-        }
-      }
+std::shared_future<ImageData> AsyncImageLoader::loadImageAsync(const fs::path& filePath) {
+  std::lock_guard<std::mutex> lock(_imageMutex);
 
-      // Erase the paths that are already in the future
-      for (auto it = pathsToLoad.begin(); it != pathsToLoad.end();) {
-        if (_futures.find(*it) != _futures.end()) {
-          it = pathsToLoad.erase(it);
-        } else {
-          ++it;
-        }
-      }
+  if (ImageData imageData; _imageCache.tryGet(filePath, imageData)) {
+    std::promise<ImageData> promise;
+    promise.set_value(imageData);
+    return promise.get_future().share();
+  }
 
-      // Add the new image paths to the queue
-      for (const auto& path : pathsToLoad) {
-        std::promise<ImageData> promise;
-        auto future = promise.get_future();
+  if (auto loadTaskIt = _loadTasks.find(filePath); loadTaskIt != _loadTasks.end()) {
+    if (!loadTaskIt->second.isPrefetched) {
+      ++loadTaskIt->second.numSharedConsumers;
+    }
+    loadTaskIt->second.isKept = true;
+    return loadTaskIt->second.future;
+  }
 
-        _futures[path] = std::move(future);
+  submitLoadTask(filePath, 0, true, false);  // After the requested image, before the prefetched ones
+  return _loadTasks[filePath].future;
+}
 
-        _threadPool->submit([this, path, promise = std::move(promise)]() mutable {
-          loadImageImpl(path, std::move(promise));
-        });
-      }
+void AsyncImageLoader::setImageLoadedCallback(ImageCallback_t callback) {
+  std::lock_guard<std::mutex> lock(_imageLoadedMutex);
+  _imageLoadedCallback = std::move(callback);
+}
 
-      // Erase cache images that are not in the paths to load
-      for (auto it = _imageCache.begin(); it != _imageCache.end();) {
-        if (std::find(pathsToLoadAll.begin(), pathsToLoadAll.end(), it->first) == pathsToLoadAll.end()) {
-          it = _imageCache.erase(it);
-        } else {
-          ++it;
-        }
-      }
+std::vector<std::pair<int, int>> AsyncImageLoader::getPreloadWindow(int currentIndex) const {
+  const int direction = _navigationTracker.getDirection();
+  const double stepRate = _navigationTracker.getStepRate();
+
+  // Centered on the current image while the user is not moving
+  int numBehind = _numPreloadedImages / 2 - 1;
+  int numAhead = _numPreloadedImages - numBehind - 1;
+  int behindPriorityScale = 1;
+
+  if (direction != 0) {
+    // Skew the window in the direction of travel, and give lower priorities to the images behind
+    numBehind = std::max(1, _numPreloadedImages / 8);
+    numAhead = _numPreloadedImages - numBehind - 1;
+    behindPriorityScale = 2;
+
+    if (stepRate >= Common::FAST_NAVIGATION_STEP_RATE) {
+      // Widen the window ahead to cover the images reached in the lookahead time
+      const int numReached = static_cast<int>(std::ceil(stepRate * Common::PREFETCH_LOOKAHEAD_SECONDS));
+      numAhead = std::max(numAhead, std::min(numReached, 2 * _numPreloadedImages));
     }
   }
 
-  // ------------------------------------------------------------------------------------------------------------
-  // Try again to load from future
-  // ------------------------------------------------------------------------------------------------------------
-  if (imageData.empty()) {
-    std::shared_future<ImageData> future;
+  const int forward = direction >= 0 ? 1 : -1;
+  const int numImages = static_cast<int>(_imagePaths.size());
 
-    {
-      std::lock_guard<std::mutex> lock(_imageMutex);
+  // Pairs of the index and the priority
+  std::vector<std::pair<int, int>> window;
+  window.reserve(numBehind + numAhead + 1);
+  window.emplace_back(currentIndex, PRIORITY_REQUESTED_IMAGE);
 
-      auto futureIt = _futures.find(filePath);
-      if (futureIt != _futures.end()) {
-        future = futureIt->second.share();
-      }
+  for (int i = 1; i <= numAhead; ++i) {
+    if (const int index = currentIndex + forward * i; index >= 0 && index < numImages) {
+      window.emplace_back(index, -i);
+    }
+  }
+  for (int i = 1; i <= numBehind; ++i) {
+    if (const int index = currentIndex - forward * i; index >= 0 && index < numImages) {
+      window.emplace_back(index, -i * behindPriorityScale);
     }
+  }
 
-    if (future.valid()) {
-      // Wait for the image to be loaded (blocking call)
-      imageData = future.get();
+  return window;
+}
 
-      {
-        // Erase the future from the map
-        std::lock_guard<std::mutex> lock(_imageMutex);
+void AsyncImageLoader::recordRequest(const fs::path& filePath, bool isCached) {
+  // NOTE: The caller must lock _imageMutex
 
-        // Remove the future from the map
-        auto futureIt = _futures.find(filePath);
-        if (futureIt != _futures.end()) {
-          _futures.erase(futureIt);
-        }
-      }
+  ++_prefetchStatistics.numRequests;
+
+  if (isCached) {
+    ++_prefetchStatistics.numCacheHits;
+  } else if (auto loadTaskIt = _loadTasks.find(filePath); loadTaskIt != _loadTasks.end()) {
+    ++_prefetchStatistics.numInFlightHits;
+
+    // A hit on a prefetch is what the prefetch is for. Only a decode started on demand, e.g. by loadImageAsync(), is shared.
+    if (!loadTaskIt->second.isPrefetched) {
+      ++loadTaskIt->second.numSharedConsumers;
     }
+  } else {
+    ++_prefetchStatistics.numMisses;
   }
+}
 
-#if defined(RVIEW_DEBUG_BUILD)
-  // ------------------------------------------------------------------------------------------------------------
-  // Check
-  // ------------------------------------------------------------------------------------------------------------
-  {
-    std::lock_guard<std::mutex> lock(_imageMutex);
+void AsyncImageLoader::recordDecode(double decodeSeconds, size_t imageBytes) {
+  // NOTE: The caller must lock _imageMutex
+
+  // Exponential moving averages. The first sample is taken as is.
+  const double alpha = _numDecodeSamples == 0 ? 1.0 : Common::DECODE_STATISTICS_SMOOTHING;
+  _prefetchStatistics.averageDecodeSeconds += alpha * (decodeSeconds - _prefetchStatistics.averageDecodeSeconds);
+  _prefetchStatistics.averageImageBytes += alpha * (static_cast<double>(imageBytes) - _prefetchStatistics.averageImageBytes);
+  ++_numDecodeSamples;
+}
 
-    if (_futures.size() > _numPreloadedImages) {
-      qDebug() << "The number of futures " << _futures.size() << " exceeds the number of preloaded images " << _numPreloadedImages;
+void AsyncImageLoader::adaptPrefetchDepth() {
+  // NOTE: The caller must lock _imageMutex
+
+  if (_numDecodeSamples == 0) {
+    return;  // Nothing measured yet
+  }
+
+  const double stepRate = _navigationTracker.getStepRate();
+  const double decodeSeconds = _prefetchStatistics.averageDecodeSeconds;
+  const double imageBytes = std::max(_prefetchStatistics.averageImageBytes, 1.0);
+
+  // Number of images the prefetched ones may take within the memory budget
+  const double memoryBudget = _imageCache.getCapacity() * Common::PREFETCH_MEMORY_RATIO;
+  const int maxNumImagesInMemory = std::max(static_cast<int>(memoryBudget / imageBytes), Common::MIN_NUM_PRELOADED_IMAGES);
+
+  // The user reaches this number of images while one image is decoded. They must be decoded in parallel to keep up.
+  const int numImagesPerDecode = static_cast<int>(std::ceil(stepRate * decodeSeconds));
+
+  // Prefetch the images reached while decoding and looking ahead
+  const int numImagesToLookAhead = static_cast<int>(std::ceil(stepRate * (decodeSeconds + Common::PREFETCH_LOOKAHEAD_SECONDS)));
+  _numPreloadedImages = std::clamp(numImagesToLookAhead,
+                                   Common::MIN_NUM_PRELOADED_IMAGES,
+                                   std::min(Common::MAX_NUM_PRELOADED_IMAGES, maxNumImagesInMemory));
+
+  // Up to the cores of the machine. Every decoding thread holds an image, so the threads are also bounded by the memory budget.
+  const int numCores = static_cast<int>(std::thread::hardware_concurrency());
+  const int maxNumThreads = numCores > 0 ? std::min(numCores, _threadPool->getMaxNumThreads()) : _threadPool->getMaxNumThreads();
+  const int numThreads = std::clamp(std::max(numImagesPerDecode + 1, Common::MIN_NUM_THREADS),
+                                    1,
+                                    std::min({maxNumThreads, maxNumImagesInMemory, _numPreloadedImages}));
+
+  if (numThreads != _threadPool->getNumThreads()) {
+    _threadPool->setNumThreads(numThreads);
+  }
+
+  _prefetchStatistics.numThreads = numThreads;
+  _prefetchStatistics.numPreloadedImages = _numPreloadedImages;
+}
+
+void AsyncImageLoader::updatePreloadQueue(const fs::path& filePath) {
+  const int currentIndex = std::distance(_imagePaths.begin(), std::find(_imagePaths.begin(), _imagePaths.end(), filePath));
+
+  std::lock_guard<std::mutex> lock(_imageMutex);
+
+  // Predict the images requested next from the recent navigation
+  _navigationTracker.record(currentIndex);
+  adaptPrefetchDepth();
+  const auto window = getPreloadWindow(currentIndex);
+
+  // Cancel the tasks that are not in the window. The queued ones are dropped without running.
+  for (auto it = _loadTasks.begin(); it != _loadTasks.end();) {
+    const bool isInWindow = std::any_of(window.begin(), window.end(), [&](const auto& entry) { return _imagePaths[entry.first] == it->first; });
+
+    if (!isInWindow && !it->second.isKept) {
+      it->second.token->cancel();
+      it = _loadTasks.erase(it);
+    } else {
+      ++it;
     }
-    if (_imageCache.size() > _numPreloadedImages) {
-      qDebug() << "The number of cached images " << _imageCache.size() << " exceeds the number of preloaded images " << _numPreloadedImages;
+  }
+
+  // Add the new image paths to the queue, or update the priority of the queued ones.
+  // The requested image jumps to the front of the queue.
+  for (const auto& [index, priority] : window) {
+    const auto& path = _imagePaths[index];
+
+    if (auto loadTaskIt = _loadTasks.find(path); loadTaskIt != _loadTasks.end()) {
+      _threadPool->setPriority(loadTaskIt->second.token, priority);
+    } else if (!_imageCache.contains(path) && (path == filePath || !isTooLargeToPrefetch(path))) {
+      submitLoadTask(path, priority, false, path != filePath);
     }
   }
-#endif
 
-  return imageData;  // Return an empty ImageData if not found
+  // NOTE: The cached images outside the window are kept while the cache has room for them,
+  //       so that stepping back a few images does not decode them again.
+}
+
+void AsyncImageLoader::setCacheCapacity(size_t capacityBytes) {
+  std::lock_guard<std::mutex> lock(_imageMutex);
+  _imageCache.setCapacity(capacityBytes);
+}
+
+void AsyncImageLoader::submitLoadTask(const fs::path& filePath, int priority, bool isKept, bool isPrefetched) {
+  // NOTE: The caller must lock _imageMutex
+
+  std::promise<ImageData> promise;
+  auto future = promise.get_future().share();
+  auto token = std::make_shared<CancellationToken>();
+
+  _loadTasks[filePath] = LoadTask{std::move(future), token, isKept, isPrefetched, 0};
+
+  _threadPool->post([this, filePath, token, promise = std::move(promise)]() mutable {
+    loadImageImpl(filePath, std::move(promise), token);
+  },
+                    priority, token);
+}
+
+bool AsyncImageLoader::finishLoadTask(const fs::path& filePath, const CancellationToken_t& token, bool isLoaded) {
+  // NOTE: The caller must lock _imageMutex
+
+  // The entry may already be replaced by a new decode of the same file after this one was cancelled
+  if (auto loadTaskIt = _loadTasks.find(filePath); loadTaskIt != _loadTasks.end() && loadTaskIt->second.token == token) {
+    if (isLoaded) {
+      // NOTE: The consumers of a cancelled or failed decode got nothing from sharing it
+      _prefetchStatistics.numCoalescedDecodes += loadTaskIt->second.numSharedConsumers;
+    }
+
+    _loadTasks.erase(loadTaskIt);
+    return true;
+  }
+
+  return false;
+}
+
+void AsyncImageLoader::setViewportSize(int width, int height) {
+  std::lock_guard<std::mutex> lock(_imageMutex);
+  _viewportSize = cv::Size(width, height);
+}
+
+size_t AsyncImageLoader::getCacheCapacity() const {
+  std::lock_guard<std::mutex> lock(_imageMutex);
+  return _imageCache.getCapacity();
+}
+
+PrefetchStatistics AsyncImageLoader::getPrefetchStatistics() const {
+  std::lock_guard<std::mutex> lock(_imageMutex);
+  return _prefetchStatistics;
 }
@@ -4,7 +4,8 @@
 MainControl::MainControl()
     : _fileListModel(std::make_shared<FileListModel>()),
       _imageLoader(std::make_shared<AsyncImageLoader>(Common::NUM_THREADS,
-                                                      Common::NUM_PRELOADED_IMAGES)) {
+                                                      Common::NUM_PRELOADED_IMAGES,
+                                                      Common::DEFAULT_IMAGE_CACHE_CAPACITY_BYTES)) {
 }
 
 MainControl::~MainControl() = default;
@@ -25,12 +26,9 @@ void MainControl::setCurrentDir(const fs::path& dirPath) {
   // Filter out image files
   std::vector<fs::path> imageFiles;
   for (const auto& file : files) {
-    std::string fileExtension = file.extension().string();
-    std::transform(fileExtension.begin(), fileExtension.end(), fileExtension.begin(), ::tolower);
-
     if (fs::exists(file) &&
         fs::is_regular_file(file) &&
-        SUPPORTED_IMAGE_EXTENSIONS.find(fileExtension) != SUPPORTED_IMAGE_EXTENSIONS.end()) {
+        ImageDecoderRegistry::isSupportedExtension(file)) {
       imageFiles.push_back(file);
     }
   }
@@ -107,3 +105,38 @@ ImageData MainControl::getImageData(const fs::path& filename) const {
 
   return imageData;
 }
+
+void MainControl::requestImageData(const fs::path& filename, ImageCallback_t callback) const {
+  const auto currentDir = getCurrentDir();
+  const auto filePath = currentDir / filename;
+
+  // Check if the file exists and is a regular file
+  if (!fs::exists(filePath) || !fs::is_regular_file(filePath)) {
+    qInfo() << "File does not exist or is not a regular file: " << FileUtil::pathToQString(filePath);
+    return;
+  }
+
+  // Request the image data from the image loader. This returns immediately, and the callback is invoked
+  // (possibly on a worker thread) when the image is ready.
+  _imageLoader->requestImage(filePath, std::move(callback));
+}
+
+void MainControl::setImageLoadedCallback(ImageCallback_t callback) const {
+  _imageLoader->setImageLoadedCallback(std::move(callback));
+}
+
+void MainControl::setImageCacheCapacity(size_t capacityBytes) {
+  _imageLoader->setCacheCapacity(capacityBytes);
+}
+
+size_t MainControl::getImageCacheCapacity() const {
+  return _imageLoader->getCacheCapacity();
+}
+
+void MainControl::setViewportSize(int width, int height) {
+  _imageLoader->setViewportSize(width, height);
+}
+
+PrefetchStatistics MainControl::getPrefetchStatistics() const {
+  return _imageLoader->getPrefetchStatistics();
+}
@@ -17,7 +17,9 @@ MainWindow::MainWindow(QWidget* parent)
     : QMainWindow(parent),
       _ui(new Ui::MainWindow),
       _control(std::make_shared<MainControl>()),
-      _resampleActionGroup(new QActionGroup(this)) {
+      _resampleActionGroup(new QActionGroup(this)),
+      _requestedImagePath(),
+      _isRequestedImageLoaded(false) {
   // ------------------------------------------------------------------------------------------
   // Set up ui
   _ui->setupUi(this);
@@ -37,6 +39,10 @@ MainWindow::MainWindow(QWidget* parent)
   // Set main controller
   _ui->fileListWidget->setMainControl(_control);
 
+  // Upload the images decoded ahead, so that stepping to them only binds their textures
+  GLWidget* glwidget = _ui->glwidget;
+  _control->setImageLoadedCallback([glwidget](const ImageData& imageData) { glwidget->prefetchTexture(imageData); });
+
   // ------------------------------------------------------------------------------------------
   // Initialize file list
   const auto dirPath = fs::absolute(FileUtil::qStringToPath(QDir::homePath()));
@@ -58,11 +64,18 @@ MainWindow::MainWindow(QWidget* parent)
     _ui->actionNearest->setActionGroup(_resampleActionGroup);
     _ui->actionBilinear->setActionGroup(_resampleActionGroup);
     _ui->actionBicubic->setActionGroup(_resampleActionGroup);
+    _ui->actionMitchell->setActionGroup(_resampleActionGroup);
+    _ui->actionLanczos2->setActionGroup(_resampleActionGroup);
+    _ui->actionLanczos3->setActionGroup(_resampleActionGroup);
     _ui->actionLanczos4->setActionGroup(_resampleActionGroup);
+    _ui->actionGaussian->setActionGroup(_resampleActionGroup);
   }
 }
 
 MainWindow::~MainWindow() {
+  // NOTE: Cleared before the view is deleted, since the callback is called from the workers
+  _control->setImageLoadedCallback(nullptr);
+
   delete _ui;
   delete _resampleActionGroup;
 }
@@ -117,17 +130,39 @@ void MainWindow::updateFileList() {
 }
 
 void MainWindow::updateImage(const fs::path& fileName) {
-  const auto& imageData = _control->getImageData(fileName);
+  _requestedImagePath = _control->getCurrentDir() / fileName;
+  _isRequestedImageLoaded = false;
+
+  // The preview is decoded just large enough for the view
+  const qreal pixelRatio = _ui->glwidget->devicePixelRatioF();
+  _control->setViewportSize(static_cast<int>(_ui->glwidget->width() * pixelRatio), static_cast<int>(_ui->glwidget->height() * pixelRatio));
+
+  // The previous image stays on the screen until the requested one is ready
+  _control->requestImageData(fileName, [this](const ImageData& imageData) {
+    // This may be called from a worker thread. Deliver the result to the GUI thread.
+    QMetaObject::invokeMethod(this, [this, imageData]() { onImageLoaded(imageData); }, Qt::QueuedConnection);
+  });
+}
 
-  if (!imageData.empty()) {
-    // Set the image data to the OpenGL widget
-    updateImage(imageData);
+void MainWindow::onImageLoaded(const ImageData& imageData) {
+  if (imageData.empty() || imageData.path != _requestedImagePath) {
+    // Discard the image the user has already moved past
+    return;
+  }
 
-    // Set window title
-    const auto& filePath = imageData.path;
-    const auto& fileNameStr = FileUtil::pathToQString(filePath);
-    setWindowTitle(Common::WINDOW_TITLE + " - " + fileNameStr);
+  if (imageData.isPreview && _isRequestedImageLoaded) {
+    // The full image has overtaken the preview
+    return;
   }
+  _isRequestedImageLoaded = !imageData.isPreview;
+
+  // Set the image data to the OpenGL widget
+  updateImage(imageData);
+
+  // Set window title
+  const auto& filePath = imageData.path;
+  const auto& fileNameStr = FileUtil::pathToQString(filePath);
+  setWindowTitle(Common::WINDOW_TITLE + " - " + fileNameStr);
 }
 
 void MainWindow::updateImage(const ImageData& imageData) {
@@ -136,7 +171,7 @@ void MainWindow::updateImage(const ImageData& imageData) {
   }
 
   // Set the image data to the OpenGL widget
-  _ui->glwidget->updateTexture(imageData.image);
+  _ui->glwidget->updateTexture(imageData);
 }
 
 void MainWindow::goParent() {
@@ -331,6 +366,25 @@ void MainWindow::on_actionOpenDir_triggered() {
   }
 }
 
+// ----------------------------------------------------------------------------------------------------------------------------------
+// 'View' menu
+
+void MainWindow::on_actionRotateClockwise_triggered() {
+  _ui->glwidget->rotateView(true);
+}
+
+void MainWindow::on_actionRotateCounterclockwise_triggered() {
+  _ui->glwidget->rotateView(false);
+}
+
+void MainWindow::on_actionFlipHorizontally_triggered() {
+  _ui->glwidget->flipView(true);
+}
+
+void MainWindow::on_actionFlipVertically_triggered() {
+  _ui->glwidget->flipView(false);
+}
+
 // ----------------------------------------------------------------------------------------------------------------------------------
 // 'Resample' menu
 
@@ -349,7 +403,27 @@ void MainWindow::on_actionBicubic_triggered() {
   qDebug() << "Switched to Bicubic shader";
 }
 
+void MainWindow::on_actionMitchell_triggered() {
+  _ui->glwidget->setShaderType(ImageShaderType::MITCHELL);
+  qDebug() << "Switched to Mitchell shader";
+}
+
+void MainWindow::on_actionLanczos2_triggered() {
+  _ui->glwidget->setShaderType(ImageShaderType::LANCZOS2);
+  qDebug() << "Switched to Lanczos2 shader";
+}
+
+void MainWindow::on_actionLanczos3_triggered() {
+  _ui->glwidget->setShaderType(ImageShaderType::LANCZOS3);
+  qDebug() << "Switched to Lanczos3 shader";
+}
+
 void MainWindow::on_actionLanczos4_triggered() {
   _ui->glwidget->setShaderType(ImageShaderType::LANCZOS4);
   qDebug() << "Switched to Lanczos4 shader";
 }
+
+void MainWindow::on_actionGaussian_triggered() {
+  _ui->glwidget->setShaderType(ImageShaderType::GAUSSIAN);
+  qDebug() << "Switched to Gaussian shader";
+}
@@ -0,0 +1,102 @@
+#include <memoryutil.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+std::optional<size_t> MemoryUtil::getAvailableMemory() {
+#ifdef _WIN32
+  MEMORYSTATUSEX status;
+  status.dwLength = sizeof(status);
+  if (GlobalMemoryStatusEx(&status)) {
+    return static_cast<size_t>(status.ullAvailPhys);
+  }
+  return std::nullopt;
+#elif __linux__
+  const auto memAvailable = readMemAvailable();
+  const auto cgroupAvailable = readCgroupAvailable();
+
+  if (memAvailable && cgroupAvailable) {
+    return std::min(*memAvailable, *cgroupAvailable);
+  }
+  return memAvailable ? memAvailable : cgroupAvailable;
+#else
+  return std::nullopt;  // Unsupported OS
+#endif
+}
+
+#ifdef __linux__
+std::optional<size_t> MemoryUtil::readMemAvailable() {
+  std::ifstream ifs("/proc/meminfo");
+  if (!ifs) {
+    return std::nullopt;
+  }
+
+  // The line looks like "MemAvailable:    12345678 kB"
+  std::string line;
+  while (std::getline(ifs, line)) {
+    if (line.rfind("MemAvailable:", 0) == 0) {
+      std::istringstream iss(line.substr(std::string("MemAvailable:").size()));
+      size_t kiloBytes = 0;
+      if (iss >> kiloBytes) {
+        return kiloBytes * 1024;
+      }
+    }
+  }
+
+  return std::nullopt;
+}
+
+std::optional<size_t> MemoryUtil::readCgroupAvailable() {
+  // --------------------------------------------------------------------------------------------------
+  // cgroup v2. The path of the cgroup is written in /proc/self/cgroup as "0::/path/to/cgroup"
+  std::string cgroupPath;
+  {
+    std::ifstream ifs("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(ifs, line)) {
+      if (line.rfind("0::", 0) == 0) {
+        cgroupPath = line.substr(3);
+        break;
+      }
+    }
+  }
+
+  for (const auto& dirPath : {"/sys/fs/cgroup" + cgroupPath, std::string("/sys/fs/cgroup")}) {
+    const auto limit = readSizeFromFile(dirPath + "/memory.max");  // "max" if unlimited
+    const auto usage = readSizeFromFile(dirPath + "/memory.current");
+
+    if (limit && usage) {
+      return *limit > *usage ? *limit - *usage : 0;
+    }
+  }
+
+  // --------------------------------------------------------------------------------------------------
+  // cgroup v1
+  {
+    const auto limit = readSizeFromFile("/sys/fs/cgroup/memory/memory.limit_in_bytes");
+    const auto usage = readSizeFromFile("/sys/fs/cgroup/memory/memory.usage_in_bytes");
+
+    // NOTE: An unlimited cgroup v1 reports a huge number close to the maximum of int64
+    if (limit && usage && *limit < (static_cast<size_t>(1) << 60)) {
+      return *limit > *usage ? *limit - *usage : 0;
+    }
+  }
+
+  return std::nullopt;
+}
+
+std::optional<size_t> MemoryUtil::readSizeFromFile(const std::string& filePath) {
+  std::ifstream ifs(filePath);
+  if (!ifs) {
+    return std::nullopt;
+  }
+
+  size_t value = 0;
+  if (ifs >> value) {
+    return value;
+  }
+
+  return std::nullopt;  // Not a number (e.g. "max")
+}
+#endif
@@ -0,0 +1,342 @@
+#include <common.h>
+#include <previewstore.h>
+
+#include <QCoreApplication>
+#include <QStandardPaths>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+// ###########################################################################################################################################
+// PreviewStore
+// ###########################################################################################################################################
+
+PreviewStore::PreviewStore(const fs::path& storeDir, size_t capacityBytes)
+    : _storeDir(storeDir),
+      _capacityBytes(capacityBytes),
+      _isAvailable(false),
+      _nextTemporaryId(0),
+      _numStoresSinceEviction(0) {
+  std::error_code ec;
+  fs::create_directories(_storeDir, ec);
+  _isAvailable = fs::is_directory(_storeDir, ec);
+
+  if (!_isAvailable) {
+    qInfo() << "Preview store is not available: " << FileUtil::pathToQString(_storeDir);
+  }
+}
+
+PreviewStore::~PreviewStore() = default;
+
+fs::path PreviewStore::getDefaultDirectory() {
+  // ~/.cache/rview on Linux
+  const QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+  if (cacheDir.isEmpty()) {
+    return FileUtil::getHomeDirectory() / ".cache" / "rview";
+  }
+  return FileUtil::qStringToPath(cacheDir) / "rview";
+}
+
+ImageData PreviewStore::createPreview(const ImageData& imageData) {
+  const cv::Mat& image = imageData.image;
+
+  // Downscale first to convert fewer pixels
+  const double scale = std::min(1.0, static_cast<double>(getMaxSize(Level::Screen)) / std::max(image.cols, image.rows));
+
+  cv::Mat resized;
+  if (scale < 1.0) {
+    cv::resize(image, resized, cv::Size(), scale, scale, cv::INTER_AREA);
+  } else {
+    resized = image;
+  }
+
+  // Bake the value range into 8-bit, as the shader does on the screen
+  const double valueRange = imageData.maxValue > imageData.minValue ? imageData.maxValue - imageData.minValue : 1.0;
+  cv::Mat preview;
+  resized.convertTo(preview, CV_8U, 255.0 / valueRange, -imageData.minValue * 255.0 / valueRange);
+
+  if (resized.channels() == 4) {
+    // Alpha is not normalized by the value range
+    const double normalizedMax = resized.depth() == CV_8U ? 255.0 : (resized.depth() == CV_16U ? 65535.0 : 1.0);
+    cv::Mat alpha;
+    cv::extractChannel(resized, alpha, 3);
+    alpha.convertTo(alpha, CV_8U, 255.0 / normalizedMax);
+    cv::insertChannel(alpha, preview, 3);
+  }
+
+  if (imageData.channelOrder == ChannelOrder::RGB && preview.channels() >= 3) {
+    cv::cvtColor(preview, preview, preview.channels() == 4 ? cv::COLOR_RGBA2BGRA : cv::COLOR_RGB2BGR);
+  }
+
+  ImageData previewData(preview, imageData.path);
+  previewData.channelOrder = ChannelOrder::BGR;
+  previewData.orientation = imageData.orientation;
+  previewData.minValue = 0.0;
+  previewData.maxValue = 255.0;
+  previewData.isPreview = true;
+
+  return previewData;
+}
+
+bool PreviewStore::isAvailable() const {
+  return _isAvailable;
+}
+
+bool PreviewStore::contains(const fs::path& filePath, Level level) const {
+  if (!_isAvailable) {
+    return false;
+  }
+
+  const auto key = getKey(filePath);
+  return key && findPreview(*key, level);
+}
+
+bool PreviewStore::load(const fs::path& filePath, Level level, ImageData& preview) const {
+  if (!_isAvailable) {
+    return false;
+  }
+
+  const auto key = getKey(filePath);
+  if (!key) {
+    return false;
+  }
+
+  const auto previewPath = findPreview(*key, level);
+  if (!previewPath) {
+    return false;
+  }
+
+  cv::Mat image = cv::imread(FileUtil::pathToString(*previewPath), cv::IMREAD_UNCHANGED);
+  if (image.empty()) {
+    return false;  // Evicted or broken in the meantime
+  }
+
+  // The modification time of the preview is the time of the last use
+  std::error_code ec;
+  fs::last_write_time(*previewPath, fs::file_time_type::clock::now(), ec);
+
+  // NOTE: The preview is stored upright, and needs no orientation
+  preview = ImageData(image, filePath);
+  preview.channelOrder = ChannelOrder::BGR;
+  preview.minValue = 0.0;
+  preview.maxValue = 255.0;
+  preview.isPreview = true;
+
+  return true;
+}
+
+void PreviewStore::store(const fs::path& filePath, const ImageData& preview) {
+  if (!_isAvailable || preview.empty()) {
+    return;
+  }
+
+  const auto key = getKey(filePath);
+  if (!key) {
+    return;
+  }
+
+  try {
+    // Store upright, so that the stored preview is valid without the EXIF orientation
+    cv::Mat image = preview.image;
+    double minValue, maxValue;
+    ImagingUtil::transformPixels(image, preview.orientation, minValue, maxValue);
+
+    storeLevel(*key, Level::Screen, image);
+    storeThumbnailLevel(*key, image);
+  } catch (const cv::Exception& e) {
+    qInfo() << "Failed to store the preview: " << e.what();
+  }
+
+  countStore();
+}
+
+void PreviewStore::storeThumbnail(const fs::path& filePath, const ImageData& preview) {
+  if (!_isAvailable || preview.empty()) {
+    return;
+  }
+
+  const auto key = getKey(filePath);
+  if (!key) {
+    return;
+  }
+
+  try {
+    // Store upright, so that the stored preview is valid without the EXIF orientation
+    cv::Mat image = preview.image;
+    double minValue, maxValue;
+    ImagingUtil::transformPixels(image, preview.orientation, minValue, maxValue);
+
+    storeThumbnailLevel(*key, image);
+  } catch (const cv::Exception& e) {
+    qInfo() << "Failed to store the thumbnail: " << e.what();
+  }
+
+  countStore();
+}
+
+void PreviewStore::evict() {
+  if (!_isAvailable) {
+    return;
+  }
+
+  struct Entry {
+    fs::file_time_type lastWriteTime;
+    uintmax_t size;
+    fs::path path;
+  };
+
+  std::vector<Entry> entries;
+  uintmax_t totalSize = 0;
+
+  // NOTE: Another process may remove the files while iterating. Such files are just skipped.
+  std::error_code ec;
+  for (fs::directory_iterator it(_storeDir, ec), end; !ec && it != end; it.increment(ec)) {
+    std::error_code entryEc;
+
+    if (!it->is_regular_file(entryEc)) {
+      continue;
+    }
+
+    const uintmax_t size = it->file_size(entryEc);
+    const fs::file_time_type lastWriteTime = it->last_write_time(entryEc);
+    if (entryEc) {
+      continue;
+    }
+
+    entries.push_back(Entry{lastWriteTime, size, it->path()});
+    totalSize += size;
+  }
+
+  if (totalSize <= _capacityBytes) {
+    return;
+  }
+
+  // Shrink below the capacity with some margin, so that the eviction does not run again right away
+  const auto targetSize = static_cast<uintmax_t>(_capacityBytes * Common::PREVIEW_STORE_EVICTION_RATIO);
+
+  std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.lastWriteTime < b.lastWriteTime; });
+
+  for (const auto& entry : entries) {
+    if (totalSize <= targetSize) {
+      break;
+    }
+
+    std::error_code removeEc;
+    fs::remove(entry.path, removeEc);
+    totalSize -= entry.size;
+
+#if defined(RVIEW_DEBUG_BUILD)
+    qDebug() << "Evict from preview store:" << FileUtil::pathToQString(entry.path);
+#endif
+  }
+}
+
+std::optional<std::string> PreviewStore::getKey(const fs::path& filePath) const {
+  std::error_code ec;
+
+  const uintmax_t fileSize = fs::file_size(filePath, ec);
+  if (ec) {
+    return std::nullopt;
+  }
+
+  const int64_t lastWriteTime = fs::last_write_time(filePath, ec).time_since_epoch().count();
+  if (ec) {
+    return std::nullopt;
+  }
+
+  const fs::path absolutePath = fs::absolute(filePath, ec);
+  const std::string pathStr = FileUtil::pathToString(ec ? filePath : absolutePath);
+
+  // 64-bit FNV-1a hash of the path, the size and the modification time
+  uint64_t hash = 14695981039346656037ull;
+  const auto feed = [&hash](const void* data, size_t size) {
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+      hash ^= bytes[i];
+      hash *= 1099511628211ull;
+    }
+  };
+
+  feed(pathStr.data(), pathStr.size());
+  feed(&fileSize, sizeof(fileSize));
+  feed(&lastWriteTime, sizeof(lastWriteTime));
+
+  std::ostringstream oss;
+  oss << std::hex << std::setw(16) << std::setfill('0') << hash;
+  return oss.str();
+}
+
+std::optional<fs::path> PreviewStore::findPreview(const std::string& key, Level level) const {
+  const std::string stem = key + "_" + std::to_string(getMaxSize(level));
+
+  // JPEG for opaque images, and PNG for the images with alpha
+  for (const char* extension : {".jpg", ".png"}) {
+    const fs::path previewPath = _storeDir / (stem + extension);
+
+    std::error_code ec;
+    if (fs::is_regular_file(previewPath, ec)) {
+      return previewPath;
+    }
+  }
+
+  return std::nullopt;
+}
+
+void PreviewStore::storeLevel(const std::string& key, Level level, const cv::Mat& image) {
+  const std::string stem = key + "_" + std::to_string(getMaxSize(level));
+  const std::string extension = image.channels() == 4 ? ".png" : ".jpg";
+
+  // Write to a temporary file unique to this process and thread, and rename it into place.
+  // The rename replaces the file atomically, so that the readers see either the old or the new one.
+  const std::string temporarySuffix = ".tmp" + std::to_string(QCoreApplication::applicationPid()) + "_" + std::to_string(_nextTemporaryId.fetch_add(1));
+  const fs::path temporaryPath = _storeDir / (stem + temporarySuffix + extension);
+  const fs::path previewPath = _storeDir / (stem + extension);
+
+  std::vector<int> params;
+  if (extension == ".jpg") {
+    params = {cv::IMWRITE_JPEG_QUALITY, Common::PREVIEW_JPEG_QUALITY};
+  }
+
+  bool isWritten = false;
+  try {
+    isWritten = cv::imwrite(FileUtil::pathToString(temporaryPath), image, params);
+  } catch (const cv::Exception& e) {
+    qInfo() << "Failed to write the preview: " << e.what();
+  }
+
+  std::error_code ec;
+
+  if (!isWritten) {
+    fs::remove(temporaryPath, ec);
+    return;
+  }
+
+  fs::rename(temporaryPath, previewPath, ec);
+  if (ec) {
+    fs::remove(temporaryPath, ec);
+  }
+}
+
+void PreviewStore::storeThumbnailLevel(const std::string& key, const cv::Mat& image) {
+  const double scale = std::min(1.0, static_cast<double>(getMaxSize(Level::Thumbnail)) / std::max(image.cols, image.rows));
+
+  if (scale < 1.0) {
+    cv::Mat thumbnail;
+    cv::resize(image, thumbnail, cv::Size(), scale, scale, cv::INTER_AREA);
+    storeLevel(key, Level::Thumbnail, thumbnail);
+  } else {
+    storeLevel(key, Level::Thumbnail, image);
+  }
+}
+
+void PreviewStore::countStore() {
+  if (_numStoresSinceEviction.fetch_add(1) + 1 >= Common::PREVIEW_STORE_EVICTION_INTERVAL) {
+    _numStoresSinceEviction.store(0);
+    evict();
+  }
+}
+
+int PreviewStore::getMaxSize(Level level) {
+  return level == Level::Thumbnail ? Common::PREVIEW_THUMBNAIL_SIZE : Common::PREVIEW_SCREEN_SIZE;
+}
@@ -1,7 +1,9 @@
 #include <shaders.h>
 
 ImageShader::ImageShader()
-    : _shaderPrograms() {
+    : _shaderPrograms(),
+      _separablePassPrograms(),
+      _kernelLuts() {
   // Sure to call this constructor after making the context current
 
   for (const auto& shaderType : IMAGE_SHADER_TYPE_NAMES) {
@@ -12,14 +14,17 @@ ImageShader::ImageShader()
     // Get the shader code for the specified type
     const auto& [vertexShaderCode, fragmentShaderCode] = getShaderCode(type);
 
-    const std::shared_ptr<QOpenGLShaderProgram> program = std::make_shared<QOpenGLShaderProgram>();
+    _shaderPrograms[type] = buildShaderProgram(vertexShaderCode, fragmentShaderCode);
 
-    program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderCode);
-    program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShaderCode);
+    if (isSeparableShaderType(type)) {
+      _kernelLuts[type] = buildKernelLut(getResamplingKernel(type));
 
-    program->link();
-
-    _shaderPrograms[type] = program;
+      // The passes drawing the same filter in 1D kernels
+      for (int pass = 0; pass < 2; ++pass) {
+        const auto& [passVertexShaderCode, passFragmentShaderCode] = getSeparablePassShaderCode(type, pass);
+        _separablePassPrograms[type][pass] = buildShaderProgram(passVertexShaderCode, passFragmentShaderCode);
+      }
+    }
 
     qDebug() << "Done.";
   }
@@ -31,6 +36,18 @@ ImageShader::~ImageShader() {
     shaderProgram.second->release();
     shaderProgram.second->deleteLater();
   }
+
+  for (const auto& passPrograms : _separablePassPrograms) {
+    for (const auto& shaderProgram : passPrograms.second) {
+      shaderProgram->removeAllShaders();
+      shaderProgram->release();
+      shaderProgram->deleteLater();
+    }
+  }
+
+  for (const auto& kernelLut : _kernelLuts) {
+    kernelLut.second->destroy();
+  }
 }
 
 std::shared_ptr<QOpenGLShaderProgram> ImageShader::getShaderProgram(ImageShaderType type) const {
@@ -42,4 +59,57 @@ std::shared_ptr<QOpenGLShaderProgram> ImageShader::getShaderProgram(ImageShaderT
   throw std::invalid_argument("Invalid image shader type");
 
   return nullptr;
+}
+
+std::shared_ptr<QOpenGLShaderProgram> ImageShader::getSeparablePassProgram(ImageShaderType type, int pass) const {
+  auto it = _separablePassPrograms.find(type);
+  if (it != _separablePassPrograms.end()) {
+    return it->second[pass];
+  }
+
+  throw std::invalid_argument("Image shader type is not separable");
+
+  return nullptr;
+}
+
+std::shared_ptr<QOpenGLTexture> ImageShader::getKernelLut(ImageShaderType type) const {
+  auto it = _kernelLuts.find(type);
+  if (it != _kernelLuts.end()) {
+    return it->second;
+  }
+
+  return nullptr;
+}
+
+std::shared_ptr<QOpenGLShaderProgram> ImageShader::buildShaderProgram(const QString& vertexShaderCode, const QString& fragmentShaderCode) {
+  const std::shared_ptr<QOpenGLShaderProgram> program = std::make_shared<QOpenGLShaderProgram>();
+
+  program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderCode);
+  program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShaderCode);
+
+  program->link();
+
+  return program;
+}
+
+std::shared_ptr<QOpenGLTexture> ImageShader::buildKernelLut(const ResamplingKernel& kernel) {
+  // Tabulated over [0, radius] including both ends, and interpolated linearly by the sampler
+  const int numSamples = kernel.radius * Common::KERNEL_LUT_SAMPLES_PER_TEXEL + 1;
+
+  std::vector<float> weights(numSamples);
+  for (int i = 0; i < numSamples; ++i) {
+    weights[i] = static_cast<float>(kernel.weight(static_cast<double>(i) / Common::KERNEL_LUT_SAMPLES_PER_TEXEL));
+  }
+
+  const std::shared_ptr<QOpenGLTexture> texture = std::make_shared<QOpenGLTexture>(QOpenGLTexture::Target2D);
+  texture->setFormat(QOpenGLTexture::R32F);
+  texture->setSize(numSamples, 1);
+  texture->setMipLevels(1);
+  texture->allocateStorage(QOpenGLTexture::Red, QOpenGLTexture::Float32);
+  texture->setData(QOpenGLTexture::Red, QOpenGLTexture::Float32, weights.data());
+  texture->setMinificationFilter(QOpenGLTexture::Filter::Linear);
+  texture->setMagnificationFilter(QOpenGLTexture::Filter::Linear);
+  texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+
+  return texture;
 }
\ No newline at end of file
@@ -0,0 +1,289 @@
+#include <common.h>
+#include <texturecache.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// ###########################################################################################################################################
+// TextureCache
+// ###########################################################################################################################################
+
+TextureCache::TextureCache()
+    : _surface(nullptr),
+      _shareContext(nullptr),
+      _maxTextureSize(0),
+      _mutex(),
+      _condition(),
+      _pendingUploads(),
+      _entries(),
+      _sizeInBytes(0),
+      _isRunning(false),
+      _thread() {
+}
+
+TextureCache::~TextureCache() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _isRunning = false;
+    _pendingUploads.clear();
+  }
+  _condition.notify_all();
+
+  // The textures are released by the thread with its context current
+  if (_thread.joinable()) {
+    _thread.join();
+  }
+}
+
+void TextureCache::start(QOpenGLContext* shareContext, int maxTextureSize) {
+  if (_thread.joinable() || shareContext == nullptr) {
+    return;
+  }
+
+  if (!QOpenGLContext::supportsThreadedOpenGL()) {
+    qInfo() << "OpenGL is not available from the threads. The textures are not uploaded ahead.";
+    return;
+  }
+
+  // NOTE: The surface must be created on the GUI thread
+  _surface = std::make_unique<QOffscreenSurface>();
+  _surface->setFormat(shareContext->format());
+  _surface->create();
+
+  _shareContext = shareContext;
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _maxTextureSize = maxTextureSize;
+    _isRunning = true;
+  }
+
+  _thread = std::thread(&TextureCache::run, this);
+}
+
+void TextureCache::prefetch(const ImageData& imageData, QOpenGLTexture::TextureFormat textureFormat, QOpenGLTexture::PixelFormat pixelFormat, QOpenGLTexture::PixelType pixelType) {
+  // Only the full images drawn as a single texture, decoded by the loader so that they can be told apart. The large ones are streamed by the view instead.
+  if (imageData.empty() || imageData.isPreview || imageData.generation == 0 || imageData.tiledImage != nullptr ||
+      getTextureSizeInBytes(imageData.image) > Common::TEXTURE_CACHE_CAPACITY_BYTES / 4) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (!_isRunning || std::max(imageData.image.cols, imageData.image.rows) > _maxTextureSize || contains(imageData)) {
+      return;
+    }
+
+    // The same image may be decoded again after it has been evicted from the image cache
+    _pendingUploads.erase(std::remove_if(_pendingUploads.begin(), _pendingUploads.end(), [&](const PendingUpload& pendingUpload) { return pendingUpload.imageData.path == imageData.path; }),
+                          _pendingUploads.end());
+
+    _pendingUploads.push_back(PendingUpload{imageData, textureFormat, pixelFormat, pixelType});
+
+    // Drop the oldest ones, which the view has most likely moved past
+    while (_pendingUploads.size() > Common::TEXTURE_CACHE_MAX_PENDING_UPLOADS) {
+      _pendingUploads.pop_front();
+    }
+  }
+
+  _condition.notify_one();
+}
+
+CachedTexture_t TextureCache::acquire(const ImageData& imageData) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  for (auto it = _entries.begin(); it != _entries.end(); ++it) {
+    if (it->path == imageData.path && it->generation == imageData.generation) {
+      _entries.splice(_entries.begin(), _entries, it);  // Move the entry to the front
+      return _entries.front().texture;
+    }
+  }
+
+  return nullptr;
+}
+
+void TextureCache::run() {
+  QOpenGLContext context;
+  context.setFormat(_surface->format());
+  context.setShareContext(_shareContext);
+
+  if (!context.create() || !context.makeCurrent(_surface.get())) {
+    qInfo() << "Failed to create the OpenGL context to upload the textures.";
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _isRunning = false;
+    _pendingUploads.clear();
+    return;
+  }
+
+  QOpenGLExtraFunctions* functions = context.extraFunctions();
+
+  for (;;) {
+    PendingUpload pendingUpload;
+
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _condition.wait(lock, [this]() { return !_isRunning || !_pendingUploads.empty(); });
+
+      if (!_isRunning) {
+        break;
+      }
+
+      pendingUpload = std::move(_pendingUploads.front());
+      _pendingUploads.pop_front();
+
+      if (contains(pendingUpload.imageData)) {
+        continue;
+      }
+    }
+
+    upload(functions, pendingUpload);
+  }
+
+  // Release the textures with the context current. The view has released the ones it referred to.
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    for (const auto& entry : _entries) {
+      functions->glDeleteTextures(1, &entry.texture->id);
+    }
+    _entries.clear();
+    _sizeInBytes = 0;
+  }
+
+  context.doneCurrent();
+}
+
+void TextureCache::upload(QOpenGLExtraFunctions* functions, const PendingUpload& pendingUpload) {
+  cv::Mat image = pendingUpload.imageData.image;
+  if (image.step[0] % image.elemSize() != 0) {
+    image = image.clone();  // The stride must be a whole number of pixels for GL_UNPACK_ROW_LENGTH
+  }
+
+  const size_t sizeInBytes = getTextureSizeInBytes(image);
+
+  // The full chain down to 1x1
+  const int numLevels = static_cast<int>(std::log2(std::max(image.cols, image.rows))) + 1;
+
+  const std::shared_ptr<CachedTexture> texture = takeTexture(functions, image.size(), pendingUpload.textureFormat, sizeInBytes);
+  if (texture == nullptr) {
+    return;  // All the textures are in use
+  }
+
+  functions->glBindTexture(GL_TEXTURE_2D, texture->id);
+
+  if (texture->size.empty()) {
+    // A new texture. The same filters as the texture of the view.
+    functions->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    functions->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    functions->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    functions->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    for (int level = 0; level < numLevels; ++level) {
+      functions->glTexImage2D(GL_TEXTURE_2D, level, static_cast<GLint>(pendingUpload.textureFormat), std::max(image.cols >> level, 1), std::max(image.rows >> level, 1), 0,
+                              static_cast<GLenum>(pendingUpload.pixelFormat), static_cast<GLenum>(pendingUpload.pixelType), nullptr);
+    }
+
+    texture->size = image.size();
+    texture->textureFormat = pendingUpload.textureFormat;
+    texture->sizeInBytes = sizeInBytes;
+  }
+
+  // The mip levels averaged by the loader, or generated here if the image came without them
+  std::vector<cv::Mat> levels = {image};
+  const std::vector<cv::Mat>& mipLevels = pendingUpload.imageData.mipLevels;
+  if (static_cast<int>(mipLevels.size()) == numLevels - 1) {
+    levels.insert(levels.end(), mipLevels.begin(), mipLevels.end());
+  }
+
+  // NOTE: The rows of 1 or 3 channel images are not necessarily aligned to 4 bytes
+  functions->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (int level = 0; level < static_cast<int>(levels.size()); ++level) {
+    const cv::Mat& levelImage = levels[level];
+    functions->glPixelStorei(GL_UNPACK_ROW_LENGTH, static_cast<GLint>(levelImage.step[0] / levelImage.elemSize()));
+    functions->glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, levelImage.cols, levelImage.rows, static_cast<GLenum>(pendingUpload.pixelFormat), static_cast<GLenum>(pendingUpload.pixelType), levelImage.data);
+  }
+  functions->glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  functions->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  if (levels.size() == 1) {
+    functions->glGenerateMipmap(GL_TEXTURE_2D);
+  }
+  functions->glBindTexture(GL_TEXTURE_2D, 0);
+
+  // Wait here rather than in the view, so that the texture is complete whenever the view binds it
+  functions->glFinish();
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _entries.push_front(Entry{pendingUpload.imageData.path, pendingUpload.imageData.generation, texture});
+}
+
+std::shared_ptr<CachedTexture> TextureCache::takeTexture(QOpenGLExtraFunctions* functions, const cv::Size& size, QOpenGLTexture::TextureFormat textureFormat, size_t sizeInBytes) {
+  std::shared_ptr<CachedTexture> texture;
+  std::vector<GLuint> evictedTextureIds;
+  bool isReserved = false;
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // NOTE: The textures referred to only by the cache are not in use by the view
+
+    // Reuse the least recently used texture of the same size and format
+    for (auto it = _entries.rbegin(); it != _entries.rend(); ++it) {
+      if (it->texture.use_count() == 1 && it->texture->size == size && it->texture->textureFormat == textureFormat) {
+        texture = it->texture;
+        _sizeInBytes -= texture->sizeInBytes;
+        _entries.erase(std::next(it).base());
+        break;
+      }
+    }
+
+    // Evict the least recently used textures to make room
+    for (auto it = _entries.end(); it != _entries.begin() && _sizeInBytes + sizeInBytes > Common::TEXTURE_CACHE_CAPACITY_BYTES;) {
+      --it;
+
+      if (it->texture.use_count() == 1) {
+        evictedTextureIds.push_back(it->texture->id);
+        _sizeInBytes -= it->texture->sizeInBytes;
+        it = _entries.erase(it);
+      }
+    }
+
+    if (_sizeInBytes + sizeInBytes > Common::TEXTURE_CACHE_CAPACITY_BYTES) {
+      if (texture != nullptr) {
+        evictedTextureIds.push_back(texture->id);
+        texture.reset();
+      }
+    } else {
+      _sizeInBytes += sizeInBytes;  // Reserved while uploading
+      isReserved = true;
+    }
+  }
+
+  for (const GLuint id : evictedTextureIds) {
+    functions->glDeleteTextures(1, &id);
+  }
+
+  if (!isReserved) {
+    return nullptr;
+  }
+
+  if (texture == nullptr) {
+    // The storage is allocated by the caller
+    texture = std::make_shared<CachedTexture>();
+    functions->glGenTextures(1, &texture->id);
+  }
+
+  return texture;
+}
+
+bool TextureCache::contains(const ImageData& imageData) const {
+  // NOTE: The caller must lock _mutex
+  return std::any_of(_entries.begin(), _entries.end(), [&](const Entry& entry) { return entry.path == imageData.path && entry.generation == imageData.generation; });
+}
+
+size_t TextureCache::getTextureSizeInBytes(const cv::Mat& image) {
+  // The mipmaps take another third
+  return image.total() * image.elemSize() * 4 / 3;
+}
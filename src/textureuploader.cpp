@@ -0,0 +1,219 @@
+#include <common.h>
+#include <textureuploader.h>
+
+#include <QOpenGLContext>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+// ###########################################################################################################################################
+// TextureUploader
+// ###########################################################################################################################################
+
+TextureUploader::TextureUploader()
+    : _texture(nullptr),
+      _levels(),
+      _level(0),
+      _pixelFormat(QOpenGLTexture::RGBA),
+      _pixelType(QOpenGLTexture::UInt8),
+      _buffers(),
+      _bufferSize(0),
+      _nextBuffer(0),
+      _nextRow(0),
+      _bandRows(1) {
+}
+
+TextureUploader::~TextureUploader() {
+  destroy();
+}
+
+void TextureUploader::start(QOpenGLTexture* texture, const cv::Mat& image, const std::vector<cv::Mat>& mipLevels, QOpenGLTexture::PixelFormat pixelFormat, QOpenGLTexture::PixelType pixelType) {
+  cancel();
+
+  if (texture == nullptr || image.empty()) {
+    return;
+  }
+
+  QOpenGLExtraFunctions* functions = QOpenGLContext::currentContext()->extraFunctions();
+
+  // A buffer holds at least a row. The rows of the mip levels are shorter.
+  const size_t bufferSize = std::max(Common::TEXTURE_UPLOAD_BAND_BYTES, image.step[0]);
+  if (_buffers.empty() || _bufferSize < bufferSize) {
+    allocateBuffers(functions, bufferSize);
+  }
+
+  _texture = texture;
+  _levels.clear();
+  _levels.push_back(image);
+  _levels.insert(_levels.end(), mipLevels.begin(), mipLevels.end());
+  _pixelFormat = pixelFormat;
+  _pixelType = pixelType;
+  startLevel(0);
+}
+
+void TextureUploader::cancel() {
+  // NOTE: The bands already issued are left to the GPU, and their fences are waited for before the buffers are reused
+  _texture = nullptr;
+  _levels.clear();
+  _level = 0;
+  _nextRow = 0;
+}
+
+bool TextureUploader::update() {
+  if (!isUploading()) {
+    return false;
+  }
+
+  QOpenGLExtraFunctions* functions = QOpenGLContext::currentContext()->extraFunctions();
+  const auto startTime = std::chrono::steady_clock::now();
+
+  while (_level < static_cast<int>(_levels.size())) {
+    if (_nextRow >= _levels[_level].rows) {
+      startLevel(_level + 1);
+      continue;
+    }
+
+    Buffer& buffer = _buffers[_nextBuffer];
+
+    if (buffer.fence != nullptr) {
+      // The GPU may still be reading the previous band from the buffer. Try again in the next frame rather than waiting.
+      if (functions->glClientWaitSync(buffer.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) {
+        break;
+      }
+
+      functions->glDeleteSync(buffer.fence);
+      buffer.fence = nullptr;
+    }
+
+    uploadBand(functions, buffer);
+    _nextBuffer = (_nextBuffer + 1) % static_cast<int>(_buffers.size());
+
+    const std::chrono::duration<double, std::milli> elapsedTime = std::chrono::steady_clock::now() - startTime;
+    if (elapsedTime.count() >= Common::TEXTURE_UPLOAD_BUDGET_MS) {
+      break;
+    }
+  }
+
+  if (_level < static_cast<int>(_levels.size())) {
+    return false;
+  }
+
+  // All the bands are issued
+  _texture = nullptr;
+  _levels.clear();
+  return true;
+}
+
+bool TextureUploader::isUploading() const {
+  return _texture != nullptr;
+}
+
+void TextureUploader::destroy() {
+  cancel();
+
+  if (_buffers.empty()) {
+    return;
+  }
+
+  QOpenGLExtraFunctions* functions = QOpenGLContext::currentContext()->extraFunctions();
+
+  for (auto& buffer : _buffers) {
+    if (buffer.fence != nullptr) {
+      functions->glDeleteSync(buffer.fence);
+    }
+    functions->glDeleteBuffers(1, &buffer.id);
+  }
+
+  _buffers.clear();
+  _bufferSize = 0;
+  _nextBuffer = 0;
+}
+
+void TextureUploader::allocateBuffers(QOpenGLExtraFunctions* functions, size_t bufferSize) {
+  destroy();
+
+  _buffers.resize(Common::TEXTURE_UPLOAD_NUM_BUFFERS);
+
+  for (auto& buffer : _buffers) {
+    functions->glGenBuffers(1, &buffer.id);
+    functions->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+    functions->glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(bufferSize), nullptr, GL_STREAM_DRAW);
+  }
+  functions->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  _bufferSize = bufferSize;
+}
+
+void TextureUploader::startLevel(int level) {
+  _level = level;
+  _nextRow = 0;
+
+  if (_level < static_cast<int>(_levels.size())) {
+    _bandRows = std::max(static_cast<int>(_bufferSize / _levels[_level].step[0]), 1);
+  }
+}
+
+void TextureUploader::uploadBand(QOpenGLExtraFunctions* functions, Buffer& buffer) {
+  const cv::Mat& image = _levels[_level];
+
+  const int rowBegin = _nextRow;
+  const int rowEnd = std::min(rowBegin + _bandRows, image.rows);
+  const int numRows = rowEnd - rowBegin;
+
+  const size_t step = image.step[0];
+  const size_t rowBytes = static_cast<size_t>(image.cols) * image.elemSize();
+
+  // The rows are copied with the padding, unless the stride is not a whole number of pixels as in the mapped BMP files
+  const bool isStrided = step % image.elemSize() == 0;
+  const size_t bandSize = isStrided ? (numRows - 1) * step + rowBytes : numRows * rowBytes;
+
+  functions->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+
+  // NOTE: The fence has cleared the buffer, so the mapping does not have to synchronize with the GPU.
+  //       GL 4.1 has no persistent mapping, and the unsynchronized mapping does not stall either.
+  uint8_t* data = static_cast<uint8_t*>(functions->glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(bandSize),
+                                                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+
+  bool isBuffered = data != nullptr;
+  if (isBuffered) {
+    if (isStrided) {
+      std::memcpy(data, image.ptr(rowBegin), bandSize);
+    } else {
+      for (int y = rowBegin; y < rowEnd; ++y) {
+        std::memcpy(data + (y - rowBegin) * rowBytes, image.ptr(y), rowBytes);
+      }
+    }
+
+    // The content is lost if the display mode has changed meanwhile
+    isBuffered = functions->glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+  }
+
+  if (!isBuffered) {
+    // Upload the band from the image instead
+    functions->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+
+  functions->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  functions->glPixelStorei(GL_UNPACK_ROW_LENGTH, isStrided ? static_cast<GLint>(step / image.elemSize()) : image.cols);
+
+  _texture->bind();
+  if (isBuffered || isStrided) {
+    functions->glTexSubImage2D(GL_TEXTURE_2D, _level, 0, rowBegin, image.cols, numRows, static_cast<GLenum>(_pixelFormat), static_cast<GLenum>(_pixelType),
+                               isBuffered ? nullptr : image.ptr(rowBegin));
+  } else {
+    for (int y = rowBegin; y < rowEnd; ++y) {
+      functions->glTexSubImage2D(GL_TEXTURE_2D, _level, 0, y, image.cols, 1, static_cast<GLenum>(_pixelFormat), static_cast<GLenum>(_pixelType), image.ptr(y));
+    }
+  }
+  _texture->release();
+
+  functions->glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  functions->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  if (isBuffered) {
+    buffer.fence = functions->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    functions->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+
+  _nextRow = rowEnd;
+}
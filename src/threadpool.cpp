@@ -0,0 +1,422 @@
+#include <threadpool.h>
+
+#include <iterator>
+#include <stdexcept>
+
+// ###########################################################################################################################################
+// CancellationToken
+// ###########################################################################################################################################
+
+CancellationToken::CancellationToken()
+    : _isCancelled(false) {
+}
+
+CancellationToken::~CancellationToken() = default;
+
+void CancellationToken::cancel() {
+  _isCancelled.store(true, std::memory_order_release);
+}
+
+bool CancellationToken::isCancelled() const {
+  return _isCancelled.load(std::memory_order_acquire);
+}
+
+// ###########################################################################################################################################
+// WorkStealingDeque
+// ###########################################################################################################################################
+
+WorkStealingDeque::WorkStealingDeque()
+    : _top(0),
+      _bottom(0),
+      _slots(std::make_unique<Slot[]>(CAPACITY)) {
+}
+
+WorkStealingDeque::~WorkStealingDeque() = default;
+
+bool WorkStealingDeque::push(Task&& task) {
+  const int64_t bottom = _bottom.load(std::memory_order_relaxed);
+  const int64_t top = _top.load(std::memory_order_acquire);
+
+  Slot& slot = _slots[bottom & (CAPACITY - 1)];
+  if (bottom - top >= CAPACITY || slot.isOccupied.load(std::memory_order_acquire)) {
+    return false;
+  }
+
+  slot.task = std::move(task);
+  slot.isOccupied.store(true, std::memory_order_relaxed);
+
+  // Publish the task to the thieves
+  _bottom.store(bottom + 1, std::memory_order_release);
+
+  return true;
+}
+
+bool WorkStealingDeque::pop(Task& task) {
+  const int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+  _bottom.store(bottom, std::memory_order_relaxed);
+
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t top = _top.load(std::memory_order_relaxed);
+
+  if (top > bottom) {
+    // Empty
+    _bottom.store(bottom + 1, std::memory_order_relaxed);
+    return false;
+  }
+
+  if (top == bottom) {
+    // The last task. Race with the thieves for it.
+    const bool isWon = _top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    _bottom.store(bottom + 1, std::memory_order_relaxed);
+
+    if (!isWon) {
+      return false;
+    }
+  }
+
+  Slot& slot = _slots[bottom & (CAPACITY - 1)];
+  task = std::move(slot.task);
+  slot.isOccupied.store(false, std::memory_order_release);
+
+  return true;
+}
+
+bool WorkStealingDeque::steal(Task& task) {
+  int64_t top = _top.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  const int64_t bottom = _bottom.load(std::memory_order_acquire);
+
+  if (top >= bottom) {
+    return false;
+  }
+
+  // NOTE: Task cannot be copied speculatively, so the slot is claimed first and moved out afterwards.
+  //       The owner does not reuse the slot until isOccupied is cleared.
+  if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+    return false;
+  }
+
+  Slot& slot = _slots[top & (CAPACITY - 1)];
+  task = std::move(slot.task);
+  slot.isOccupied.store(false, std::memory_order_release);
+
+  return true;
+}
+
+// ###########################################################################################################################################
+// ThreadPool
+// ###########################################################################################################################################
+
+ThreadPool::ThreadPool(int numThreads)
+    : _workers(),
+      _localTasks(),
+      _sharedTasks(),
+      _injectedTasks(),
+      _nextSequence(0),
+      _nextInjectedQueue(0),
+      _taskMutex(),
+      _isRunning(true),
+      _condition(),
+      _parkCondition(),
+      _maxNumActiveWorkers(std::max(numThreads, 1)),
+      _numPendingTasks(0),
+      _numSleepingWorkers(0) {
+  // Launch all the threads up front, so that the deques never move while being stolen from.
+  // The number of running ones is limited by setNumThreads().
+  const int numWorkers = std::max({numThreads, static_cast<int>(std::thread::hardware_concurrency()), 1});
+
+  for (int i = 0; i < numWorkers; ++i) {
+    _localTasks.push_back(std::make_unique<WorkStealingDeque>());
+    _injectedTasks.push_back(std::make_unique<TaskQueue>());
+  }
+
+  for (int i = 0; i < numWorkers; ++i) {
+    _workers.emplace_back(&ThreadPool::worker, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  shutdown();
+}
+
+void ThreadPool::shutdown() {
+  {
+    // Refuse new tasks
+    std::lock_guard<std::mutex> lock(_taskMutex);
+    _isRunning = false;
+    _maxNumActiveWorkers.store(static_cast<int>(_workers.size()));  // Let all the workers drain the queue
+  }
+
+  // Notify all threads to wake up, drain the remaining tasks and exit
+  _condition.notify_all();
+  _parkCondition.notify_all();
+
+  for (auto& worker : _workers) {
+    if (worker.joinable()) {
+      worker.join();  // Wait for all threads to finish
+    }
+  }
+}
+
+bool ThreadPool::isRunning() const {
+  return _isRunning.load();
+}
+
+bool ThreadPool::setPriority(const CancellationToken_t& token, int priority) {
+  if (token == nullptr) {
+    return false;
+  }
+
+  // Take the tasks out of all the queues, since the new priority may belong to another queue
+  std::vector<std::pair<QueuedTask, uint64_t>> foundTasks;
+
+  const auto takeTasks = [&](TaskQueue& queue) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    const auto isOther = [&](const TaskKey& key) { return queue.slots[key.slot].token != token; };
+    const auto it = std::partition(queue.keys.begin(), queue.keys.end(), isOther);
+    if (it == queue.keys.end()) {
+      return;
+    }
+
+    for (auto keyIt = it; keyIt != queue.keys.end(); ++keyIt) {
+      foundTasks.emplace_back(std::move(queue.slots[keyIt->slot]), keyIt->sequence);
+      queue.freeSlots.push_back(keyIt->slot);
+    }
+
+    queue.keys.erase(it, queue.keys.end());
+    std::make_heap(queue.keys.begin(), queue.keys.end(), TaskCompare());
+    queue.topPriority.store(queue.keys.empty() ? TaskQueue::EMPTY : queue.keys.front().priority, std::memory_order_release);
+  };
+
+  takeTasks(_sharedTasks);
+  for (auto& queue : _injectedTasks) {
+    takeTasks(*queue);
+  }
+
+  // NOTE: The tasks keep their sequences, and are still counted in _numPendingTasks while they are moved
+  for (auto& [task, sequence] : foundTasks) {
+    pushQueuedTask(priority >= URGENT_PRIORITY ? _sharedTasks : *_injectedTasks[sequence % _injectedTasks.size()], std::move(task), priority, sequence);
+  }
+
+  return !foundTasks.empty();
+}
+
+void ThreadPool::setNumThreads(int numThreads) {
+  {
+    std::lock_guard<std::mutex> lock(_taskMutex);
+    _maxNumActiveWorkers.store(std::clamp(numThreads, 1, getMaxNumThreads()));
+  }
+
+  // Let the workers re-check whether they are active
+  _condition.notify_all();
+  _parkCondition.notify_all();
+}
+
+int ThreadPool::getNumThreads() const {
+  return _maxNumActiveWorkers.load();
+}
+
+int ThreadPool::getMaxNumThreads() const {
+  return static_cast<int>(_workers.size());
+}
+
+bool ThreadPool::isWorkerThread() const {
+  return _currentPool == this;
+}
+
+int ThreadPool::getWorkerIndex() const {
+  return isWorkerThread() ? _currentWorkerIndex : -1;
+}
+
+int ThreadPool::getCurrentPriority() {
+  return _currentPriority;
+}
+
+void ThreadPool::pushTask(Task&& task, int priority, CancellationToken_t token) {
+  if (!tryPushTask(std::move(task), priority, std::move(token))) {
+    throw std::runtime_error("ThreadPool is not running anymore.");
+  }
+}
+
+bool ThreadPool::tryPushTask(Task&& task, int priority, CancellationToken_t token) {
+  // NOTE: The task is counted before _isRunning is read, and a worker reads them in the opposite order before exiting.
+  //       Either the task is refused, or a worker stays to run it.
+  _numPendingTasks.fetch_add(1);
+
+  if (!_isRunning.load() && !isWorkerThread()) {
+    _numPendingTasks.fetch_sub(1);
+    return false;
+  }
+
+  // The workers add to their own injection queues, and the other threads take turns
+  const size_t queueIndex = isWorkerThread() ? _currentWorkerIndex : _nextInjectedQueue.fetch_add(1, std::memory_order_relaxed) % _injectedTasks.size();
+  TaskQueue& queue = priority >= URGENT_PRIORITY ? _sharedTasks : *_injectedTasks[queueIndex];
+
+  pushQueuedTask(queue, QueuedTask{std::move(task), std::move(token)}, priority, _nextSequence.fetch_add(1, std::memory_order_relaxed));
+
+  notifyWorker();
+  return true;
+}
+
+void ThreadPool::pushLocalTask(Task&& task) {
+  if (!_localTasks[_currentWorkerIndex]->push(std::move(task))) {
+    // The deque is full. Run it here rather than blocking on the shared queue.
+    task();
+    return;
+  }
+
+  _numPendingTasks.fetch_add(1);
+  notifyWorker();
+}
+
+bool ThreadPool::popTask(int workerIndex, Task& task, int& priority) {
+  // Own subtasks first for the locality, then the queues in the order of priority, and finally the subtasks of the others
+  priority = 0;
+  bool isFound = _localTasks[workerIndex]->pop(task);
+
+  if (!isFound && workerIndex < _maxNumActiveWorkers.load()) {
+    isFound = popQueuedTask(_sharedTasks, task, priority) || popInjectedTask(workerIndex, task, priority) || stealTask(workerIndex, task);
+  }
+
+  if (isFound) {
+    _numPendingTasks.fetch_sub(1);
+  }
+
+  return isFound;
+}
+
+bool ThreadPool::popInjectedTask(int workerIndex, Task& task, int& priority) {
+  const int numQueues = static_cast<int>(_injectedTasks.size());
+
+  for (;;) {
+    // The queue with the task of the highest priority. The own queue wins a tie.
+    int bestIndex = -1;
+    int64_t bestPriority = TaskQueue::EMPTY;
+
+    for (int i = 0; i < numQueues; ++i) {
+      const int index = (workerIndex + i) % numQueues;
+      if (const int64_t topPriority = _injectedTasks[index]->topPriority.load(std::memory_order_acquire); topPriority > bestPriority) {
+        bestIndex = index;
+        bestPriority = topPriority;
+      }
+    }
+
+    if (bestIndex < 0) {
+      return false;
+    }
+
+    if (popQueuedTask(*_injectedTasks[bestIndex], task, priority)) {
+      return true;
+    }
+
+    // Taken by another worker in the meantime. Look again.
+  }
+}
+
+void ThreadPool::pushQueuedTask(TaskQueue& queue, QueuedTask&& task, int priority, uint64_t sequence) {
+  std::lock_guard<std::mutex> lock(queue.mutex);
+
+  size_t slot = queue.slots.size();
+  if (queue.freeSlots.empty()) {
+    queue.slots.push_back(std::move(task));
+  } else {
+    slot = queue.freeSlots.back();
+    queue.freeSlots.pop_back();
+    queue.slots[slot] = std::move(task);
+  }
+
+  queue.keys.push_back(TaskKey{priority, sequence, slot});
+  std::push_heap(queue.keys.begin(), queue.keys.end(), TaskCompare());
+  queue.topPriority.store(queue.keys.front().priority, std::memory_order_release);
+}
+
+bool ThreadPool::popQueuedTask(TaskQueue& queue, Task& task, int& priority) {
+  if (queue.topPriority.load(std::memory_order_acquire) == TaskQueue::EMPTY) {
+    return false;  // Not worth the lock
+  }
+
+  std::lock_guard<std::mutex> lock(queue.mutex);
+
+  bool isFound = false;
+  while (!isFound && !queue.keys.empty()) {
+    // Get the task with the highest priority
+    std::pop_heap(queue.keys.begin(), queue.keys.end(), TaskCompare());
+    const TaskKey key = queue.keys.back();
+    queue.keys.pop_back();
+
+    QueuedTask queuedTask = std::move(queue.slots[key.slot]);
+    queue.freeSlots.push_back(key.slot);
+
+    if (queuedTask.token != nullptr && queuedTask.token->isCancelled()) {
+      _numPendingTasks.fetch_sub(1);
+      continue;  // Drop the cancelled task without running it
+    }
+
+    task = std::move(queuedTask.task);
+    priority = key.priority;
+    isFound = true;
+  }
+
+  queue.topPriority.store(queue.keys.empty() ? TaskQueue::EMPTY : queue.keys.front().priority, std::memory_order_release);
+
+  return isFound;
+}
+
+bool ThreadPool::stealTask(int workerIndex, Task& task) {
+  const int numWorkers = static_cast<int>(_localTasks.size());
+
+  for (int i = 1; i < numWorkers; ++i) {
+    if (_localTasks[(workerIndex + i) % numWorkers]->steal(task)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ThreadPool::notifyWorker() {
+  // NOTE: _numPendingTasks is increased before reading _numSleepingWorkers, and a worker does the opposite before sleeping.
+  //       Either of them sees the other, so that no wakeup is lost.
+  if (_numSleepingWorkers.load() > 0) {
+    { std::lock_guard<std::mutex> lock(_taskMutex); }
+    _condition.notify_one();
+  }
+}
+
+void ThreadPool::worker(int workerIndex) {
+  _currentPool = this;
+  _currentWorkerIndex = workerIndex;
+
+  for (;;) {
+    Task task;
+    int priority = 0;
+
+    if (popTask(workerIndex, task, priority)) {
+      _currentPriority = priority;  // Inherited by the chunks of parallelFor() in the task
+
+      try {
+        task();  // Execute the task
+      } catch (...) {
+        // Tasks from submit() keep the exception in the future. The others have no one to report to.
+      }
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(_taskMutex);
+
+    if (!_isRunning && _numPendingTasks.load() == 0) {
+      return;  // Exit if the pool is not running and there are no tasks
+    }
+
+    if (workerIndex >= _maxNumActiveWorkers.load()) {
+      // Park the surplus worker until it is needed
+      _parkCondition.wait(lock, [&] { return !_isRunning || workerIndex < _maxNumActiveWorkers.load(); });
+      continue;
+    }
+
+    _numSleepingWorkers.fetch_add(1);
+    _condition.wait(lock, [&] { return !_isRunning || workerIndex >= _maxNumActiveWorkers.load() || _numPendingTasks.load() > 0; });
+    _numSleepingWorkers.fetch_sub(1);
+  }
+}
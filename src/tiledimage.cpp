@@ -0,0 +1,419 @@
+#include <common.h>
+#include <tiledimage.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <optional>
+
+// ###########################################################################################################################################
+// TiledImage
+// ###########################################################################################################################################
+
+TiledImage::TiledImage(const ThreadPool_t& threadPool)
+    : _threadPool(threadPool) {
+}
+
+TiledImage::~TiledImage() = default;
+
+std::future<cv::Mat> TiledImage::readRegionAsync(int level, const cv::Rect& region, const CancellationToken_t& token) {
+  if (_threadPool == nullptr) {
+    std::promise<cv::Mat> promise;
+    try {
+      promise.set_value(readRegion(level, region));
+    } catch (...) {
+      promise.set_exception(std::current_exception());
+    }
+    return promise.get_future();
+  }
+
+  // NOTE: The task keeps the image alive until it finishes
+  return _threadPool->submit([self = shared_from_this(), level, region]() { return self->readRegion(level, region); }, PRIORITY_TILE, token);
+}
+
+int TiledImage::countLevels(const cv::Size& size) {
+  int numLevels = 1;
+  for (int longSide = std::max(size.width, size.height); longSide > Common::TILE_SIZE; longSide = (longSide + 1) / 2) {
+    ++numLevels;
+  }
+  return numLevels;
+}
+
+cv::Size TiledImage::getHalvedSize(const cv::Size& size, int count) {
+  cv::Size halvedSize = size;
+  for (int i = 0; i < count; ++i) {
+    halvedSize = cv::Size((halvedSize.width + 1) / 2, (halvedSize.height + 1) / 2);
+  }
+  return halvedSize;
+}
+
+// ###########################################################################################################################################
+// MemoryTiledImage
+// ###########################################################################################################################################
+
+MemoryTiledImage::MemoryTiledImage(const cv::Mat& image, const ThreadPool_t& threadPool)
+    : TiledImage(threadPool),
+      _levelMutex(),
+      _levels(1, image),
+      _numLevels(countLevels(image.size())) {
+}
+
+MemoryTiledImage::~MemoryTiledImage() = default;
+
+int MemoryTiledImage::getNumLevels() const {
+  return _numLevels;
+}
+
+cv::Size MemoryTiledImage::getLevelSize(int level) const {
+  // NOTE: Computed without the level, which may not be built yet
+  return getHalvedSize(_levels.front().size(), level);
+}
+
+cv::Mat MemoryTiledImage::readRegion(int level, const cv::Rect& region) {
+  std::lock_guard<std::mutex> lock(_levelMutex);
+
+  // Each level is downscaled from the previous one, so that a level costs a quarter of the previous one
+  while (static_cast<int>(_levels.size()) <= level) {
+    const cv::Mat& previous = _levels.back();
+
+    cv::Mat next;
+    cv::resize(previous, next, getHalvedSize(previous.size(), 1), 0.0, 0.0, cv::INTER_AREA);
+
+    _levels.push_back(next);
+  }
+
+  const cv::Mat& levelImage = _levels[level];
+  return levelImage(region & cv::Rect(0, 0, levelImage.cols, levelImage.rows));
+}
+
+#if defined(RVIEW_USE_LIBTIFF)
+
+// ###########################################################################################################################################
+// TiffTiledImage
+// ###########################################################################################################################################
+
+TiffTiledImage::TiffTiledImage(const fs::path& filePath, const ThreadPool_t& threadPool)
+    : TiledImage(threadPool),
+      _filePath(filePath),
+      _fileLevels(),
+      _type(CV_8UC1),
+      _isRGB(false),
+      _orientation(1),
+      _handleMutex(),
+      _freeHandles(),
+      _coarseMutex(),
+      _coarseLevels(nullptr) {
+}
+
+TiffTiledImage::~TiffTiledImage() {
+  for (const auto& handle : _freeHandles) {
+    TIFFClose(handle.tiff);
+  }
+}
+
+std::shared_ptr<TiffTiledImage> TiffTiledImage::open(const fs::path& filePath, const ThreadPool_t& threadPool) {
+  TIFF* tiff = openTiff(filePath);
+  if (tiff == nullptr) {
+    return nullptr;
+  }
+
+  // NOTE: The constructor is private, which make_shared cannot call
+  std::shared_ptr<TiffTiledImage> image(new TiffTiledImage(filePath, threadPool));
+  image->_freeHandles.push_back(Handle{tiff, -1});  // Closed by the destructor from now on
+
+  // -----------------------------------------------------------------------------
+  // Format of the full image, which all the levels must share
+  uint16_t samplesPerPixel = 1;
+  uint16_t bitsPerSample = 1;
+  uint16_t sampleFormat = SAMPLEFORMAT_UINT;
+  uint16_t planarConfig = PLANARCONFIG_CONTIG;
+  uint16_t photometric = PHOTOMETRIC_MINISBLACK;
+  uint16_t orientation = ORIENTATION_TOPLEFT;
+
+  TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
+  TIFFGetFieldDefaulted(tiff, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+  TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLEFORMAT, &sampleFormat);
+  TIFFGetFieldDefaulted(tiff, TIFFTAG_PLANARCONFIG, &planarConfig);
+  TIFFGetFieldDefaulted(tiff, TIFFTAG_ORIENTATION, &orientation);
+  TIFFGetField(tiff, TIFFTAG_PHOTOMETRIC, &photometric);
+
+  int depth = -1;
+  if (bitsPerSample == 8 && sampleFormat == SAMPLEFORMAT_UINT) {
+    depth = CV_8U;
+  } else if (bitsPerSample == 16 && sampleFormat == SAMPLEFORMAT_UINT) {
+    depth = CV_16U;
+  } else if (bitsPerSample == 32 && sampleFormat == SAMPLEFORMAT_IEEEFP) {
+    depth = CV_32F;
+  }
+
+  if (depth < 0 ||
+      (samplesPerPixel != 1 && samplesPerPixel != 3 && samplesPerPixel != 4) ||
+      (samplesPerPixel > 1 && planarConfig != PLANARCONFIG_CONTIG) ||
+      (photometric != PHOTOMETRIC_MINISBLACK && photometric != PHOTOMETRIC_RGB && photometric != PHOTOMETRIC_YCBCR)) {
+    return nullptr;  // Left to OpenCV
+  }
+
+  image->_type = CV_MAKETYPE(depth, samplesPerPixel);
+  image->_isRGB = samplesPerPixel >= 3;
+  image->_orientation = orientation >= 1 && orientation <= 8 ? orientation : 1;
+
+  // -----------------------------------------------------------------------------
+  // Collect the levels of the pyramid
+  const auto readLevel = [&](tdir_t directory, toff_t subIfdOffset) -> std::optional<Level> {
+    uint32_t width = 0, height = 0, tileWidth = 0, tileHeight = 0;
+    uint16_t levelSamplesPerPixel = 1, levelBitsPerSample = 1, levelSampleFormat = SAMPLEFORMAT_UINT, levelPlanarConfig = PLANARCONFIG_CONTIG;
+    uint16_t compression = COMPRESSION_NONE, levelPhotometric = PHOTOMETRIC_MINISBLACK;
+
+    if (!TIFFIsTiled(tiff) ||
+        !TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width) ||
+        !TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height) ||
+        !TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &tileWidth) ||
+        !TIFFGetField(tiff, TIFFTAG_TILELENGTH, &tileHeight)) {
+      return std::nullopt;
+    }
+
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLESPERPIXEL, &levelSamplesPerPixel);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_BITSPERSAMPLE, &levelBitsPerSample);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLEFORMAT, &levelSampleFormat);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_PLANARCONFIG, &levelPlanarConfig);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_COMPRESSION, &compression);
+    TIFFGetField(tiff, TIFFTAG_PHOTOMETRIC, &levelPhotometric);
+
+    if (levelSamplesPerPixel != samplesPerPixel ||
+        levelBitsPerSample != bitsPerSample ||
+        levelSampleFormat != sampleFormat ||
+        (levelSamplesPerPixel > 1 && levelPlanarConfig != PLANARCONFIG_CONTIG) ||
+        (levelPhotometric == PHOTOMETRIC_YCBCR && compression != COMPRESSION_JPEG) ||  // Subsampled, which libtiff does not convert
+        width > static_cast<uint32_t>(std::numeric_limits<int>::max()) ||
+        height > static_cast<uint32_t>(std::numeric_limits<int>::max())) {
+      return std::nullopt;
+    }
+
+    return Level{
+        directory,
+        subIfdOffset,
+        cv::Size(static_cast<int>(width), static_cast<int>(height)),
+        cv::Size(static_cast<int>(tileWidth), static_cast<int>(tileHeight)),
+        compression == COMPRESSION_JPEG && levelPhotometric == PHOTOMETRIC_YCBCR,
+    };
+  };
+
+  const auto fullLevel = readLevel(0, 0);
+  if (!fullLevel) {
+    return nullptr;  // Not tiled. Left to OpenCV.
+  }
+
+  std::vector<Level> candidates;
+
+  // The SubIFDs of the full image, as in OME-TIFF
+  uint16_t numSubIfds = 0;
+  toff_t* subIfdOffsetsPtr = nullptr;
+  if (TIFFGetField(tiff, TIFFTAG_SUBIFD, &numSubIfds, &subIfdOffsetsPtr) && subIfdOffsetsPtr != nullptr) {
+    // NOTE: The array is owned by the directory, which changes below
+    const std::vector<toff_t> subIfdOffsets(subIfdOffsetsPtr, subIfdOffsetsPtr + numSubIfds);
+
+    for (const toff_t offset : subIfdOffsets) {
+      if (offset != 0 && TIFFSetSubDirectory(tiff, offset)) {
+        if (const auto level = readLevel(0, offset)) {
+          candidates.push_back(*level);
+        }
+      }
+    }
+  }
+
+  // The reduced-resolution images following the full one in the main chain
+  const tdir_t numDirectories = TIFFNumberOfDirectories(tiff);
+  for (tdir_t directory = 1; directory < numDirectories; ++directory) {
+    if (TIFFSetDirectory(tiff, directory)) {
+      if (const auto level = readLevel(directory, 0)) {
+        candidates.push_back(*level);
+      }
+    }
+  }
+
+  std::sort(candidates.begin(), candidates.end(), [](const Level& a, const Level& b) { return a.size.width > b.size.width; });
+
+  // Keep the downscaled copies of the full image, which are strictly smaller and of the same aspect ratio.
+  // The other images, such as the labels of the slide scanners and the planes of the same size, are skipped.
+  const double fullAspect = static_cast<double>(fullLevel->size.width) / fullLevel->size.height;
+  image->_fileLevels.push_back(*fullLevel);
+
+  for (const auto& level : candidates) {
+    const cv::Size& previousSize = image->_fileLevels.back().size;
+    const double aspect = static_cast<double>(level.size.width) / level.size.height;
+
+    if (level.size.width < previousSize.width && level.size.height < previousSize.height && std::abs(aspect / fullAspect - 1.0) < 0.02) {
+      image->_fileLevels.push_back(level);
+    }
+  }
+
+  // The coarsest level is read as a whole to build the coarser ones
+  const cv::Size& coarsestSize = image->_fileLevels.back().size;
+  if (std::max(coarsestSize.width, coarsestSize.height) > Common::TILED_RENDERING_MIN_SIZE) {
+    return nullptr;  // No pyramid to show the whole image from. Left to OpenCV.
+  }
+
+  return image;
+}
+
+int TiffTiledImage::getNumLevels() const {
+  return static_cast<int>(_fileLevels.size()) + countLevels(_fileLevels.back().size) - 1;
+}
+
+cv::Size TiffTiledImage::getLevelSize(int level) const {
+  const int numFileLevels = static_cast<int>(_fileLevels.size());
+
+  if (level < numFileLevels) {
+    return _fileLevels[level].size;
+  }
+  return getHalvedSize(_fileLevels.back().size, level - numFileLevels + 1);
+}
+
+cv::Mat TiffTiledImage::readRegion(int level, const cv::Rect& region) {
+  const int numFileLevels = static_cast<int>(_fileLevels.size());
+
+  if (level >= numFileLevels) {
+    return getCoarseLevels().readRegion(level - numFileLevels + 1, region);
+  }
+
+  const Level& fileLevel = _fileLevels[level];
+  const cv::Rect rect = region & cv::Rect(cv::Point(0, 0), fileLevel.size);
+
+  // NOTE: The tiles failing to decode are left black
+  cv::Mat result = cv::Mat::zeros(rect.size(), _type);
+
+  const int tileHeight = fileLevel.tileSize.height;
+  const int tileRowBegin = rect.y / tileHeight;
+  const int tileRowEnd = (rect.br().y + tileHeight - 1) / tileHeight;
+
+  if (_threadPool != nullptr && tileRowEnd - tileRowBegin > 1) {
+    // The rows of the tiles are decoded across the workers, each with its own handle, such as for the overview of a large image
+    _threadPool->parallelFor(tileRowBegin, tileRowEnd, 1, [&](int chunkBegin, int chunkEnd) {
+      readTileRows(level, rect, chunkBegin, chunkEnd, result);
+    },
+                             ThreadPool::getCurrentPriority());
+  } else {
+    readTileRows(level, rect, tileRowBegin, tileRowEnd, result);
+  }
+
+  return result;
+}
+
+void TiffTiledImage::readTileRows(int level, const cv::Rect& rect, int tileRowBegin, int tileRowEnd, cv::Mat& result) {
+  Handle handle = acquireHandle();
+  if (handle.tiff == nullptr) {
+    return;
+  }
+
+  if (setLevel(handle, level)) {
+    const cv::Size& tileSize = _fileLevels[level].tileSize;
+    std::vector<uint8_t> buffer(static_cast<size_t>(TIFFTileSize(handle.tiff)));
+
+    for (int y = tileRowBegin * tileSize.height; y < tileRowEnd * tileSize.height; y += tileSize.height) {
+      for (int x = rect.x / tileSize.width * tileSize.width; x < rect.br().x; x += tileSize.width) {
+        if (TIFFReadTile(handle.tiff, buffer.data(), static_cast<uint32_t>(x), static_cast<uint32_t>(y), 0, 0) < 0) {
+          continue;
+        }
+
+        // Copy the part of the tile inside the region
+        const cv::Rect tileRect(cv::Point(x, y), tileSize);
+        const cv::Rect overlap = tileRect & rect;
+        const cv::Mat tile(tileSize, _type, buffer.data());
+
+        tile(overlap - tileRect.tl()).copyTo(result(overlap - rect.tl()));
+      }
+    }
+  }
+
+  releaseHandle(handle);
+}
+
+int TiffTiledImage::getType() const {
+  return _type;
+}
+
+bool TiffTiledImage::isRGB() const {
+  return _isRGB;
+}
+
+int TiffTiledImage::getOrientation() const {
+  return _orientation;
+}
+
+TiffTiledImage::Handle TiffTiledImage::acquireHandle() {
+  {
+    std::lock_guard<std::mutex> lock(_handleMutex);
+
+    if (!_freeHandles.empty()) {
+      const Handle handle = _freeHandles.back();
+      _freeHandles.pop_back();
+      return handle;
+    }
+  }
+
+  // All the handles are in use by the other threads
+  return Handle{openTiff(_filePath), -1};
+}
+
+void TiffTiledImage::releaseHandle(Handle handle) {
+  if (handle.tiff == nullptr) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(_handleMutex);
+  _freeHandles.push_back(handle);
+}
+
+bool TiffTiledImage::setLevel(Handle& handle, int level) const {
+  if (handle.level == level) {
+    return true;
+  }
+
+  const Level& fileLevel = _fileLevels[level];
+  const bool isSet = fileLevel.subIfdOffset != 0 ? TIFFSetSubDirectory(handle.tiff, fileLevel.subIfdOffset) : TIFFSetDirectory(handle.tiff, fileLevel.directory);
+
+  if (!isSet) {
+    handle.level = -1;
+    return false;
+  }
+
+  if (fileLevel.isJpegYCbCr) {
+    // Let libjpeg convert to RGB, which also makes the tiles the size of the RGB pixels
+    TIFFSetField(handle.tiff, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+  }
+
+  handle.level = level;
+  return true;
+}
+
+MemoryTiledImage& TiffTiledImage::getCoarseLevels() {
+  std::lock_guard<std::mutex> lock(_coarseMutex);
+
+  if (_coarseLevels == nullptr) {
+    const int coarsestLevel = static_cast<int>(_fileLevels.size()) - 1;
+    const cv::Mat coarsestImage = readRegion(coarsestLevel, cv::Rect(cv::Point(0, 0), _fileLevels[coarsestLevel].size));
+
+    _coarseLevels = std::make_shared<MemoryTiledImage>(coarsestImage, nullptr);
+  }
+
+  return *_coarseLevels;
+}
+
+TIFF* TiffTiledImage::openTiff(const fs::path& filePath) {
+  // Silence libtiff, which prints the unknown tags and the broken files to stderr
+  static const bool isHandlerSet = []() {
+    TIFFSetWarningHandler(nullptr);
+    TIFFSetErrorHandler(nullptr);
+    return true;
+  }();
+  (void)isHandlerSet;
+
+#if defined(_WIN32)
+  return TIFFOpenW(filePath.c_str(), "r");
+#else
+  return TIFFOpen(filePath.c_str(), "r");
+#endif
+}
+
+#endif
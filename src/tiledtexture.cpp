@@ -0,0 +1,390 @@
+#include <common.h>
+#include <tiledtexture.h>
+
+#include <QOpenGLPixelTransferOptions>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <unordered_set>
+
+// ###########################################################################################################################################
+// TiledTexture
+// ###########################################################################################################################################
+
+TiledTexture::TiledTexture()
+    : _image(nullptr),
+      _numLevels(0),
+      _textureFormat(QOpenGLTexture::NoFormat),
+      _pixelFormat(QOpenGLTexture::RGBA),
+      _pixelType(QOpenGLTexture::UInt8),
+      _atlas(nullptr),
+      _atlasSizeInTiles(0, 0),
+      _freeSlots(),
+      _lruTiles(),
+      _residentTiles(),
+      _pendingTiles(),
+      _table(nullptr),
+      _tableData(),
+      _tableLevel(-1),
+      _tableTileRange(0, 0, -1, -1),
+      _isTableDirty(true) {
+}
+
+TiledTexture::~TiledTexture() {
+  cancelPendingTiles();
+}
+
+void TiledTexture::setImage(const TiledImage_t& image,
+                            QOpenGLTexture::TextureFormat textureFormat,
+                            QOpenGLTexture::PixelFormat pixelFormat,
+                            QOpenGLTexture::PixelType pixelType,
+                            int maxTextureSize) {
+  const bool isFormatChanged = _atlas == nullptr || _textureFormat != textureFormat;
+
+  // The tiles of the previous image are stale
+  cancelPendingTiles();
+
+  _image = image;
+  _numLevels = image->getNumLevels();
+
+  _textureFormat = textureFormat;
+  _pixelFormat = pixelFormat;
+  _pixelType = pixelType;
+
+  if (isFormatChanged) {
+    allocateAtlas(maxTextureSize);
+  }
+
+  _lruTiles.clear();
+  _residentTiles.clear();
+
+  _freeSlots.clear();
+  for (int y = 0; y < _atlasSizeInTiles.y; ++y) {
+    for (int x = 0; x < _atlasSizeInTiles.x; ++x) {
+      _freeSlots.emplace_back(x, y);
+    }
+  }
+
+  _tableLevel = -1;
+  _isTableDirty = true;
+}
+
+void TiledTexture::clear() {
+  cancelPendingTiles();
+
+  _image.reset();
+  _numLevels = 0;
+
+  _atlas.reset();
+  _atlasSizeInTiles = glm::ivec2(0, 0);
+  _freeSlots.clear();
+
+  _lruTiles.clear();
+  _residentTiles.clear();
+
+  _table.reset();
+  _tableData.clear();
+  _tableLevel = -1;
+  _isTableDirty = true;
+}
+
+bool TiledTexture::empty() const {
+  return _image == nullptr;
+}
+
+int TiledTexture::update(const glm::vec2& regionMin, const glm::vec2& regionMax, float texelsPerPixel) {
+  if (empty()) {
+    return 0;
+  }
+
+  const int tileSize = Common::TILE_SIZE;
+  const int capacity = _atlasSizeInTiles.x * _atlasSizeInTiles.y;
+  const int coarsestLevel = _numLevels - 1;
+
+  int level = selectLevel(texelsPerPixel);
+
+  glm::ivec2 tileMin;
+  glm::ivec2 tileMax;
+
+  for (;; ++level) {
+    const glm::ivec2 levelSize = getLevelSize(level);
+    const glm::ivec2 numTiles = (levelSize + tileSize - 1) / tileSize;
+
+    // The resampling filters read a few texels around the region
+    const glm::vec2 texelMin = regionMin * glm::vec2(levelSize) - static_cast<float>(Common::TILE_FILTER_MARGIN);
+    const glm::vec2 texelMax = regionMax * glm::vec2(levelSize) + static_cast<float>(Common::TILE_FILTER_MARGIN);
+
+    tileMin = glm::clamp(glm::ivec2(glm::floor(texelMin / static_cast<float>(tileSize))), glm::ivec2(0), numTiles - 1);
+    tileMax = glm::clamp(glm::ivec2(glm::floor(texelMax / static_cast<float>(tileSize))), glm::ivec2(0), numTiles - 1);
+
+    // A coarser level covers the region with fewer tiles if the atlas cannot hold all of them.
+    // One slot is kept for the tile of the coarsest level.
+    const glm::ivec2 numVisibleTiles = tileMax - tileMin + 1;
+    if (numVisibleTiles.x * numVisibleTiles.y < capacity || level == coarsestLevel) {
+      break;
+    }
+  }
+
+  // The coarsest level is a single tile, which is drawn while the visible tiles are read
+  std::vector<uint64_t> neededKeys = {getTileKey(coarsestLevel, glm::ivec2(0, 0))};
+  if (level != coarsestLevel) {
+    for (int y = tileMin.y; y <= tileMax.y; ++y) {
+      for (int x = tileMin.x; x <= tileMax.x; ++x) {
+        neededKeys.push_back(getTileKey(level, glm::ivec2(x, y)));
+      }
+    }
+  }
+
+  // Drop the reads of the tiles scrolled out or of the other levels
+  const std::unordered_set<uint64_t> neededKeySet(neededKeys.begin(), neededKeys.end());
+  for (auto it = _pendingTiles.begin(); it != _pendingTiles.end();) {
+    if (neededKeySet.count(it->first) == 0) {
+      it->second.token->cancel();
+      it = _pendingTiles.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  // Mark the resident tiles as used first, so that the eviction below never drops a needed tile
+  for (const uint64_t key : neededKeys) {
+    const auto it = _residentTiles.find(key);
+
+    if (it != _residentTiles.end()) {
+      _lruTiles.splice(_lruTiles.begin(), _lruTiles, it->second.it);
+    } else if (_pendingTiles.count(key) == 0) {
+      const cv::Rect region(cv::Point(getTile(key).x * tileSize, getTile(key).y * tileSize), cv::Size(tileSize, tileSize));
+      const auto token = std::make_shared<CancellationToken>();
+
+      _pendingTiles.emplace(key, PendingTile{_image->readRegionAsync(getTileLevel(key), region, token), token});
+    }
+  }
+
+  // Upload the tiles read so far
+  for (auto it = _pendingTiles.begin(); it != _pendingTiles.end();) {
+    if (it->second.future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      ++it;
+      continue;
+    }
+
+    cv::Mat tileImage;
+    try {
+      tileImage = it->second.future.get();
+    } catch (const std::exception& e) {
+      qInfo() << "Failed to read the tile: " << e.what();
+    }
+
+    // NOTE: A tile failing to read is uploaded black, so that it is not read again and again
+    uploadTile(it->first, tileImage);
+    it = _pendingTiles.erase(it);
+  }
+
+  if (level != _tableLevel || _isTableDirty || glm::ivec4(tileMin, tileMax) != _tableTileRange) {
+    updateTable(level, tileMin, tileMax);
+  }
+
+  return level;
+}
+
+bool TiledTexture::hasPendingTiles() const {
+  return !_pendingTiles.empty();
+}
+
+glm::ivec2 TiledTexture::getLevelSize(int level) const {
+  if (empty()) {
+    return glm::ivec2(0, 0);
+  }
+
+  const cv::Size size = _image->getLevelSize(level);
+  return glm::ivec2(size.width, size.height);
+}
+
+void TiledTexture::bind(int atlasUnit, int tableUnit) {
+  if (_atlas != nullptr) {
+    _atlas->bind(atlasUnit);
+  }
+  if (_table != nullptr) {
+    _table->bind(tableUnit);
+  }
+}
+
+void TiledTexture::release(int atlasUnit, int tableUnit) {
+  if (_atlas != nullptr) {
+    _atlas->release(atlasUnit);
+  }
+  if (_table != nullptr) {
+    _table->release(tableUnit);
+  }
+}
+
+int TiledTexture::getMaxSingleTextureSize(int maxTextureSize) {
+  return std::min(maxTextureSize, Common::TILED_RENDERING_MIN_SIZE);
+}
+
+int TiledTexture::selectLevel(float texelsPerPixel) const {
+  // The finest level with at most one texel per screen pixel.
+  // NOTE: The levels of the files are not necessarily halved one by one.
+  const float fullWidth = static_cast<float>(getLevelSize(0).x);
+
+  int level = 0;
+  while (level + 1 < _numLevels && fullWidth / getLevelSize(level).x < texelsPerPixel * 0.999f) {
+    ++level;
+  }
+  return level;
+}
+
+void TiledTexture::allocateAtlas(int maxTextureSize) {
+  const int tileSize = Common::TILE_SIZE;
+
+  // The largest square atlas within the capacity
+  int atlasSize = static_cast<int>(std::sqrt(static_cast<double>(Common::TILE_CACHE_CAPACITY_BYTES) / getBytesPerTexel(_pixelFormat, _pixelType)));
+  atlasSize = std::max(std::min(atlasSize, maxTextureSize) / tileSize, 1) * tileSize;
+
+  _atlas = std::make_unique<QOpenGLTexture>(QOpenGLTexture::Target2D);
+  _atlas->create();
+  _atlas->bind();
+  _atlas->setFormat(_textureFormat);
+  _atlas->setSize(atlasSize, atlasSize);
+  _atlas->setMipLevels(1);
+  _atlas->setMinificationFilter(QOpenGLTexture::Filter::Nearest);
+  _atlas->setMagnificationFilter(QOpenGLTexture::Filter::Nearest);
+  _atlas->setWrapMode(QOpenGLTexture::ClampToEdge);
+  _atlas->allocateStorage(_pixelFormat, _pixelType);
+  _atlas->release();
+
+  _atlasSizeInTiles = glm::ivec2(atlasSize / tileSize);
+
+#if defined(RVIEW_DEBUG_BUILD)
+  qDebug() << "Tile atlas allocated:" << atlasSize << "x" << atlasSize;
+#endif
+}
+
+void TiledTexture::uploadTile(uint64_t key, const cv::Mat& tileImage) {
+  const int tileSize = Common::TILE_SIZE;
+
+  glm::ivec2 slot;
+
+  if (!_freeSlots.empty()) {
+    slot = _freeSlots.back();
+    _freeSlots.pop_back();
+  } else {
+    // Evict the least recently used tile
+    const uint64_t evictedKey = _lruTiles.back();
+    slot = _residentTiles.at(evictedKey).slot;
+
+    _residentTiles.erase(evictedKey);
+    _lruTiles.pop_back();
+  }
+
+  if (!tileImage.empty()) {
+    // Upload the tile directly from the image. The tiles on the right and the bottom edges are smaller, and the rest of their slots is never sampled.
+    QOpenGLPixelTransferOptions transferOptions;
+    transferOptions.setAlignment(1);
+    transferOptions.setRowLength(static_cast<int>(tileImage.step[0] / tileImage.elemSize()));
+
+    _atlas->setData(slot.x * tileSize, slot.y * tileSize, 0, tileImage.cols, tileImage.rows, 1, _pixelFormat, _pixelType, tileImage.data, &transferOptions);
+  } else {
+    const std::vector<uint8_t> zeros(static_cast<size_t>(tileSize) * tileSize * getBytesPerTexel(_pixelFormat, _pixelType), 0);
+
+    QOpenGLPixelTransferOptions transferOptions;
+    transferOptions.setAlignment(1);
+
+    _atlas->setData(slot.x * tileSize, slot.y * tileSize, 0, tileSize, tileSize, 1, _pixelFormat, _pixelType, zeros.data(), &transferOptions);
+  }
+
+  _lruTiles.push_front(key);
+  _residentTiles[key] = ResidentTile{slot, _lruTiles.begin()};
+
+  _isTableDirty = true;
+}
+
+void TiledTexture::cancelPendingTiles() {
+  for (auto& [key, pendingTile] : _pendingTiles) {
+    pendingTile.token->cancel();
+  }
+  _pendingTiles.clear();
+}
+
+void TiledTexture::updateTable(int level, const glm::ivec2& tileMin, const glm::ivec2& tileMax) {
+  const int tileSize = Common::TILE_SIZE;
+  const glm::ivec2 levelSize = getLevelSize(level);
+  const glm::ivec2 numTiles = (levelSize + tileSize - 1) / tileSize;
+
+  _tableData.assign(static_cast<size_t>(numTiles.x) * numTiles.y * 4, -1.0f);
+
+  const auto setEntry = [&](const glm::ivec2& tile, const glm::ivec2& slot, const glm::vec2& scale) {
+    const size_t index = (static_cast<size_t>(tile.y) * numTiles.x + tile.x) * 4;
+
+    _tableData[index] = static_cast<float>(slot.x);
+    _tableData[index + 1] = static_cast<float>(slot.y);
+    _tableData[index + 2] = scale.x;
+    _tableData[index + 3] = scale.y;
+  };
+
+  for (const auto& [key, residentTile] : _residentTiles) {
+    if (getTileLevel(key) == level) {
+      setEntry(getTile(key), residentTile.slot, glm::vec2(1.0f));
+    }
+  }
+
+  // The visible tiles still being read are drawn from the finest resident tile of a coarser level.
+  // The scale maps the texel coordinates of the level to the ones of the coarser level.
+  for (int y = tileMin.y; y <= tileMax.y; ++y) {
+    for (int x = tileMin.x; x <= tileMax.x; ++x) {
+      if (_tableData[(static_cast<size_t>(y) * numTiles.x + x) * 4] >= 0.0f) {
+        continue;
+      }
+
+      const glm::vec2 center = glm::min((glm::vec2(x, y) + 0.5f) * static_cast<float>(tileSize), glm::vec2(levelSize) - 0.5f);
+
+      for (int coarserLevel = level + 1; coarserLevel < _numLevels; ++coarserLevel) {
+        const glm::vec2 scale = glm::vec2(getLevelSize(coarserLevel)) / glm::vec2(levelSize);
+        const glm::ivec2 coarserTile = glm::ivec2(center * scale) / tileSize;
+        const auto it = _residentTiles.find(getTileKey(coarserLevel, coarserTile));
+
+        if (it != _residentTiles.end()) {
+          setEntry(glm::ivec2(x, y), it->second.slot, scale);
+          break;
+        }
+      }
+    }
+  }
+
+  if (_table == nullptr || _table->width() != numTiles.x || _table->height() != numTiles.y) {
+    _table = std::make_unique<QOpenGLTexture>(QOpenGLTexture::Target2D);
+    _table->create();
+    _table->bind();
+    _table->setFormat(QOpenGLTexture::RGBA32F);
+    _table->setSize(numTiles.x, numTiles.y);
+    _table->setMipLevels(1);
+    _table->setMinificationFilter(QOpenGLTexture::Filter::Nearest);
+    _table->setMagnificationFilter(QOpenGLTexture::Filter::Nearest);
+    _table->setWrapMode(QOpenGLTexture::ClampToEdge);
+    _table->allocateStorage(QOpenGLTexture::RGBA, QOpenGLTexture::Float32);
+    _table->release();
+  }
+
+  _table->setData(QOpenGLTexture::RGBA, QOpenGLTexture::Float32, _tableData.data());
+
+  _tableLevel = level;
+  _tableTileRange = glm::ivec4(tileMin, tileMax);
+  _isTableDirty = false;
+}
+
+uint64_t TiledTexture::getTileKey(int level, const glm::ivec2& tile) {
+  return (static_cast<uint64_t>(level) << 48) | (static_cast<uint64_t>(tile.y) << 24) | static_cast<uint64_t>(tile.x);
+}
+
+int TiledTexture::getTileLevel(uint64_t key) {
+  return static_cast<int>(key >> 48);
+}
+
+glm::ivec2 TiledTexture::getTile(uint64_t key) {
+  return glm::ivec2(static_cast<int>(key & 0xFFFFFF), static_cast<int>((key >> 24) & 0xFFFFFF));
+}
+
+int TiledTexture::getBytesPerTexel(QOpenGLTexture::PixelFormat pixelFormat, QOpenGLTexture::PixelType pixelType) {
+  const int numChannels = pixelFormat == QOpenGLTexture::Red ? 1 : (pixelFormat == QOpenGLTexture::RG ? 2 : (pixelFormat == QOpenGLTexture::RGB ? 3 : 4));
+  const int bytesPerChannel = pixelType == QOpenGLTexture::UInt8 ? 1 : (pixelType == QOpenGLTexture::UInt16 ? 2 : 4);
+  return numChannels * bytesPerChannel;
+}
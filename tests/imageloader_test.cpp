@@ -0,0 +1,187 @@
+// Decodes shared among the consumers of an image while one of them is cancelled by moving away.
+//
+//   cmake -S . -B build -DRVIEW_BUILD_TESTS=ON && cmake --build build --target imageloader_test && ctest --test-dir build
+
+#include <imageloader.h>
+
+#include <QCoreApplication>
+#include <QStandardPaths>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CHECK(condition)                                                                 \
+  do {                                                                                   \
+    if (!(condition)) {                                                                  \
+      std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+      std::exit(1);                                                                      \
+    }                                                                                    \
+  } while (false)
+
+// ###########################################################################################################################################
+// Fixture
+// ###########################################################################################################################################
+
+static const int NUM_FILES = 16;
+static const int SLOW_INDEX = 8;  // Not in the window prefetched by loadImages()
+static const int FAR_INDEX = NUM_FILES - 1;
+static const cv::Size SLOW_SIZE(6000, 6000);
+
+// A directory of small images, and a large one at SLOW_INDEX that takes a while to decode
+static std::vector<fs::path> createImages(const fs::path& directory) {
+  fs::remove_all(directory);
+  fs::create_directories(directory);
+
+  std::vector<fs::path> filePaths;
+  for (int i = 0; i < NUM_FILES; ++i) {
+    const fs::path filePath = directory / ("image" + std::to_string(100 + i) + ".png");
+
+    cv::Mat image(i == SLOW_INDEX ? SLOW_SIZE : cv::Size(64, 64), CV_8UC3);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(256));  // Noise, so that the decode is not trivial
+    CHECK(cv::imwrite(filePath.string(), image, {cv::IMWRITE_PNG_COMPRESSION, 1}));
+
+    filePaths.push_back(filePath);
+  }
+
+  return filePaths;
+}
+
+// Collects the full images delivered to the callback of requestImage(), skipping the previews
+class Receiver {
+ public:
+  ImageCallback_t callback() {
+    return [this](const ImageData& imageData) {
+      if (imageData.isPreview) {
+        return;
+      }
+
+      std::lock_guard<std::mutex> lock(_mutex);
+      _images.push_back(imageData);
+      _condition.notify_all();
+    };
+  }
+
+  bool wait(ImageData& imageData, std::chrono::seconds timeout) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (!_condition.wait_for(lock, timeout, [this] { return !_images.empty(); })) {
+      return false;
+    }
+
+    imageData = _images.front();
+    return true;
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _images.size();
+  }
+
+ private:
+  std::mutex _mutex;
+  std::condition_variable _condition;
+  std::vector<ImageData> _images;
+};
+
+static const auto TIMEOUT = std::chrono::seconds(60);
+static const auto DECODE_START_WAIT = std::chrono::milliseconds(200);
+
+// ###########################################################################################################################################
+// Tests
+// ###########################################################################################################################################
+
+// The request for an image cancelled while decoding gets the image from the decode that replaces it, not the empty result of the cancelled one
+static void testRequestAfterCancel(const std::vector<fs::path>& filePaths) {
+  AsyncImageLoader loader(2, 2, static_cast<size_t>(1) * 1024 * 1024 * 1024);
+  loader.loadImages(filePaths);
+
+  Receiver first;
+  loader.requestImage(filePaths[SLOW_INDEX], first.callback());
+  std::this_thread::sleep_for(DECODE_START_WAIT);
+
+  // Move away, which cancels the decode in flight, and come back while it is still running
+  Receiver away;
+  loader.requestImage(filePaths[FAR_INDEX], away.callback());
+
+  Receiver second;
+  loader.requestImage(filePaths[SLOW_INDEX], second.callback());
+
+  ImageData imageData;
+  CHECK(second.wait(imageData, TIMEOUT));
+  CHECK(!imageData.empty());
+  CHECK(imageData.image.size() == SLOW_SIZE);
+  CHECK(first.size() == 0);  // Superseded by the later requests
+}
+
+// A consumer waiting on a decode cancelled while it runs takes the image from the decode that replaces it
+static void testSharedDecodeAfterCancel(const std::vector<fs::path>& filePaths) {
+  AsyncImageLoader loader(2, 2, static_cast<size_t>(1) * 1024 * 1024 * 1024);
+  loader.loadImages(filePaths);
+
+  Receiver first;
+  loader.requestImage(filePaths[SLOW_INDEX], first.callback());
+
+  // Joins the decode started by the request
+  auto waiter = std::async(std::launch::async, [&]() { return loader.getImage(filePaths[SLOW_INDEX]); });
+  std::this_thread::sleep_for(DECODE_START_WAIT);
+
+  Receiver away;
+  loader.requestImage(filePaths[FAR_INDEX], away.callback());
+
+  Receiver second;
+  loader.requestImage(filePaths[SLOW_INDEX], second.callback());
+
+  CHECK(waiter.wait_for(TIMEOUT) == std::future_status::ready);
+  const ImageData imageData = waiter.get();
+  CHECK(!imageData.empty());
+  CHECK(imageData.image.size() == SLOW_SIZE);
+
+  // The waiter has shared the decode started by the second request
+  ImageData requestedImageData;
+  CHECK(second.wait(requestedImageData, TIMEOUT));
+  CHECK(loader.getPrefetchStatistics().numCoalescedDecodes == 1);
+}
+
+// A consumer of a decode cancelled while it runs gets nothing, and is not counted as coalesced
+static void testCancelledSharingIsNotCounted(const std::vector<fs::path>& filePaths) {
+  AsyncImageLoader loader(2, 2, static_cast<size_t>(1) * 1024 * 1024 * 1024);
+  loader.loadImages(filePaths);
+
+  Receiver first;
+  loader.requestImage(filePaths[SLOW_INDEX], first.callback());
+
+  auto waiter = std::async(std::launch::async, [&]() { return loader.getImage(filePaths[SLOW_INDEX]); });
+  std::this_thread::sleep_for(DECODE_START_WAIT);
+
+  // Move away for good
+  Receiver away;
+  loader.requestImage(filePaths[FAR_INDEX], away.callback());
+
+  CHECK(waiter.wait_for(TIMEOUT) == std::future_status::ready);
+  CHECK(waiter.get().empty());
+  CHECK(loader.getPrefetchStatistics().numCoalescedDecodes == 0);
+}
+
+int main(int argc, char** argv) {
+  QCoreApplication app(argc, argv);
+  QStandardPaths::setTestModeEnabled(true);  // Keep the preview store out of the user's cache
+
+  const fs::path directory = fs::temp_directory_path() / "rview_imageloader_test";
+  const auto filePaths = createImages(directory);
+
+  testRequestAfterCancel(filePaths);
+  testSharedDecodeAfterCancel(filePaths);
+  testCancelledSharingIsNotCounted(filePaths);
+
+  fs::remove_all(directory);
+
+  std::printf("OK\n");
+  return 0;
+}